@@ -0,0 +1,358 @@
+#include <ulib/process.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+// Spawn and pipe benchmarks against the loadgen helper. Every result is printed as one JSON object per line:
+//   {"benchmark":"spawn/ulib","iterations":200,"mean_us":...,"p50_us":...,"p99_us":...}
+// usage: bench [--filter <substring>] [--iterations <n>] [--bytes <n>]
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    struct config
+    {
+        std::string filter;
+        size_t iterations = 200;
+        unsigned long long bytes = 256ull << 20;
+    };
+
+    double seconds_since(clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    struct json_line
+    {
+        std::string text;
+
+        explicit json_line(const std::string &name) { text = "{\"benchmark\":\"" + name + "\""; }
+
+        json_line &add(const char *key, double value)
+        {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), ",\"%s\":%.3f", key, value);
+            text += buf;
+            return *this;
+        }
+
+        json_line &add(const char *key, unsigned long long value)
+        {
+            text += ",\"" + std::string{key} + "\":" + std::to_string(value);
+            return *this;
+        }
+
+        void print()
+        {
+            std::printf("%s}\n", text.c_str());
+            std::fflush(stdout);
+        }
+    };
+
+    void report_latency(const std::string &name, std::vector<double> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+
+        double sum = 0;
+        for (double s : samples)
+            sum += s;
+
+        auto at = [&](double q) { return samples[std::min(samples.size() - 1, size_t(q * double(samples.size())))]; };
+
+        json_line{name}
+            .add("iterations", (unsigned long long)samples.size())
+            .add("mean_us", sum / double(samples.size()))
+            .add("min_us", samples.front())
+            .add("p50_us", at(0.5))
+            .add("p90_us", at(0.9))
+            .add("p99_us", at(0.99))
+            .add("max_us", samples.back())
+            .add("ops_per_sec", double(samples.size()) / (sum / 1e6))
+            .print();
+    }
+
+    void report_throughput(const std::string &name, unsigned long long bytes, double seconds)
+    {
+        json_line{name}
+            .add("bytes", bytes)
+            .add("seconds", seconds)
+            .add("mb_per_sec", double(bytes) / double(1 << 20) / seconds)
+            .print();
+    }
+
+    void measure_spawn(const config &cfg, const std::string &name, const std::function<void()> &spawn)
+    {
+        spawn(); // warm up the page cache and the dynamic loader
+
+        std::vector<double> samples;
+        samples.reserve(cfg.iterations);
+        for (size_t i = 0; i < cfg.iterations; i++)
+        {
+            auto start = clock::now();
+            spawn();
+            samples.push_back(seconds_since(start) * 1e6);
+        }
+
+        report_latency(name, std::move(samples));
+    }
+
+    void spawn_ulib()
+    {
+        ulib::process proc(u8"loadgen", {u8"exit", u8"0"});
+        if (proc.wait() != 0)
+            throw std::runtime_error{"loadgen failed"};
+    }
+
+    void bench_spawn(const config &cfg)
+    {
+        measure_spawn(cfg, "spawn/ulib", spawn_ulib);
+
+#ifndef _WIN32
+        measure_spawn(cfg, "spawn/posix_spawn", [] {
+            char *argv[] = {(char *)"loadgen", (char *)"exit", (char *)"0", nullptr};
+            pid_t pid;
+            if (::posix_spawn(&pid, "./loadgen", nullptr, nullptr, argv, environ) != 0)
+                throw std::runtime_error{"posix_spawn failed"};
+
+            int status;
+            ::waitpid(pid, &status, 0);
+        });
+
+        measure_spawn(cfg, "spawn/popen", [] {
+            FILE *file = ::popen("./loadgen exit 0", "r");
+            if (!file)
+                throw std::runtime_error{"popen failed"};
+
+            ::pclose(file);
+        });
+
+        measure_spawn(cfg, "spawn/system", [] {
+            if (std::system("./loadgen exit 0") != 0)
+                throw std::runtime_error{"system failed"};
+        });
+#else
+        measure_spawn(cfg, "spawn/system", [] {
+            if (std::system("loadgen.exe exit 0") != 0)
+                throw std::runtime_error{"system failed"};
+        });
+#endif
+    }
+
+    void bench_concurrent_spawn(const config &cfg)
+    {
+        size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            size_t perThread = std::max<size_t>(1, cfg.iterations / threads);
+            std::vector<std::thread> workers;
+            std::atomic<bool> failed{false};
+
+            auto start = clock::now();
+            for (size_t t = 0; t < threads; t++)
+            {
+                workers.emplace_back([&] {
+                    try
+                    {
+                        for (size_t i = 0; i < perThread; i++)
+                            spawn_ulib();
+                    }
+                    catch (const std::exception &)
+                    {
+                        failed = true;
+                    }
+                });
+            }
+
+            for (auto &w : workers)
+                w.join();
+
+            double seconds = seconds_since(start);
+            if (failed)
+                throw std::runtime_error{"concurrent spawn failed"};
+
+            json_line{"spawn/concurrent"}
+                .add("threads", (unsigned long long)threads)
+                .add("spawns", (unsigned long long)(perThread * threads))
+                .add("seconds", seconds)
+                .add("spawns_per_sec", double(perThread * threads) / seconds)
+                .print();
+        }
+    }
+
+    void bench_pipe_read(const config &cfg)
+    {
+        std::string size = std::to_string(cfg.bytes);
+        std::vector<char> buf(64 * 1024);
+
+        auto start = clock::now();
+        ulib::process proc(u8"loadgen", {u8"bytes", ulib::u8string{(const char8_t *)size.c_str()}},
+                           ulib::process::pipe_stdout);
+
+        unsigned long long total = 0;
+        while (true)
+        {
+            size_t rv = proc.out().read(buf.data(), buf.size());
+            if (rv == 0 || rv == size_t(-1))
+                break;
+
+            total += rv;
+        }
+
+        proc.wait();
+        report_throughput("pipe/read_64k", total, seconds_since(start));
+    }
+
+    void bench_read_all(const config &cfg)
+    {
+        // read_all is byte-at-a-time, keep the payload small
+        std::string size = std::to_string(std::min<unsigned long long>(cfg.bytes, 4ull << 20));
+
+        auto start = clock::now();
+        ulib::process proc(u8"loadgen", {u8"bytes", ulib::u8string{(const char8_t *)size.c_str()}},
+                           ulib::process::pipe_stdout);
+        auto data = proc.out().read_all();
+        proc.wait();
+
+        report_throughput("pipe/read_all", data.size(), seconds_since(start));
+    }
+
+    void bench_getline(const config &cfg)
+    {
+        // 63 characters and the newline, so --bytes sizes this one too
+        unsigned long long lines = std::min<unsigned long long>(cfg.bytes, 64ull << 20) / 64;
+        lines = std::max<unsigned long long>(lines, 1);
+        std::string count = std::to_string(lines);
+
+        auto start = clock::now();
+        ulib::process proc(u8"loadgen", {u8"lines", ulib::u8string{(const char8_t *)count.c_str()}, u8"63"},
+                           ulib::process::pipe_stdout);
+
+        unsigned long long bytes = 0;
+        for (unsigned long long i = 0; i < lines; i++)
+            bytes += proc.out().getline().size() + 1;
+
+        proc.wait();
+
+        double seconds = seconds_since(start);
+        json_line{"pipe/getline"}
+            .add("lines", lines)
+            .add("seconds", seconds)
+            .add("lines_per_sec", double(lines) / seconds)
+            .add("mb_per_sec", double(bytes) / double(1 << 20) / seconds)
+            .print();
+    }
+
+    void bench_echo(const config &cfg)
+    {
+        unsigned long long total = std::min<unsigned long long>(cfg.bytes, 64ull << 20);
+
+        auto start = clock::now();
+        ulib::process proc(u8"loadgen", {u8"echo"}, ulib::process::pipe_stdin | ulib::process::pipe_stdout);
+
+        std::thread writer([&] {
+            std::vector<char> chunk(64 * 1024, 'x');
+            unsigned long long written = 0;
+            while (written < total)
+            {
+                size_t size = size_t(std::min<unsigned long long>(chunk.size(), total - written));
+                size_t rv = proc.in().write(chunk.data(), size);
+                if (rv == 0 || rv == size_t(-1))
+                    break;
+
+                written += rv;
+            }
+
+            proc.in().close();
+        });
+
+        std::vector<char> buf(64 * 1024);
+        unsigned long long received = 0;
+        while (true)
+        {
+            size_t rv = proc.out().read(buf.data(), buf.size());
+            if (rv == 0 || rv == size_t(-1))
+                break;
+
+            received += rv;
+        }
+
+        writer.join();
+        proc.wait();
+        report_throughput("pipe/echo", received, seconds_since(start));
+    }
+
+    int usage()
+    {
+        std::fprintf(stderr, "usage: bench [--filter <substring>] [--iterations <n>] [--bytes <n>]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, const char **argv)
+{
+    config cfg;
+    for (int i = 1; i < argc; i += 2)
+    {
+        // every option takes a value, a trailing one without it is a usage error
+        if (i + 1 == argc)
+            return usage();
+
+        if (std::strcmp(argv[i], "--filter") == 0)
+            cfg.filter = argv[i + 1];
+        else if (std::strcmp(argv[i], "--iterations") == 0)
+            cfg.iterations = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--bytes") == 0)
+            cfg.bytes = std::strtoull(argv[i + 1], nullptr, 10);
+        else
+            return usage();
+    }
+
+    struct
+    {
+        const char *name;
+        void (*run)(const config &);
+    } benchmarks[] = {
+        {"spawn", bench_spawn},
+        {"spawn/concurrent", bench_concurrent_spawn},
+        {"pipe/read_64k", bench_pipe_read},
+        {"pipe/read_all", bench_read_all},
+        {"pipe/getline", bench_getline},
+        {"pipe/echo", bench_echo},
+    };
+
+    try
+    {
+        for (auto &bench : benchmarks)
+        {
+            if (std::string{bench.name}.find(cfg.filter) == std::string::npos)
+                continue;
+
+            bench.run(cfg);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::fprintf(stderr, "[bench] exception: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Configurable child for benchmarks:
+//   loadgen bytes <n> [bytes-per-second] [err]  write n bytes to stdout (or stderr), optionally rate limited
+//   loadgen lines <m> [width]                   write m lines of width characters plus '\n'
+//   loadgen echo                                copy stdin to stdout until eof
+//   loadgen exit <ms> [code]                    sleep ms milliseconds and exit with code
+
+static unsigned long long parse_number(const char *str)
+{
+    char *end = nullptr;
+    unsigned long long value = std::strtoull(str, &end, 10);
+    if (!end || *end)
+    {
+        std::fprintf(stderr, "loadgen: invalid number '%s'\n", str);
+        std::exit(2);
+    }
+
+    return value;
+}
+
+static int emit_bytes(unsigned long long total, unsigned long long rate, FILE *out)
+{
+    std::vector<char> chunk(64 * 1024, 'x');
+    if (rate)
+        chunk.resize(std::max<size_t>(1, std::min<size_t>(chunk.size(), size_t(rate / 100))));
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long written = 0;
+    while (written < total)
+    {
+        size_t size = size_t(std::min<unsigned long long>(chunk.size(), total - written));
+        if (std::fwrite(chunk.data(), 1, size, out) != size)
+            return 1;
+
+        written += size;
+        if (rate)
+        {
+            std::fflush(out);
+            std::this_thread::sleep_until(start + std::chrono::microseconds{written * 1000000 / rate});
+        }
+    }
+
+    return std::fflush(out) == 0 ? 0 : 1;
+}
+
+static int emit_lines(unsigned long long count, size_t width)
+{
+    std::string line(width, 'x');
+    line.push_back('\n');
+
+    for (unsigned long long i = 0; i < count; i++)
+    {
+        if (std::fwrite(line.data(), 1, line.size(), stdout) != line.size())
+            return 1;
+    }
+
+    return std::fflush(stdout) == 0 ? 0 : 1;
+}
+
+static int echo()
+{
+    std::vector<char> buf(64 * 1024);
+    size_t size;
+    while ((size = std::fread(buf.data(), 1, buf.size(), stdin)) > 0)
+    {
+        if (std::fwrite(buf.data(), 1, size, stdout) != size)
+            return 1;
+
+        // keep request/response style callers moving
+        std::fflush(stdout);
+    }
+
+    return 0;
+}
+
+int main(int argc, const char **argv)
+{
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+    _setmode(_fileno(stderr), _O_BINARY);
+#endif
+
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: loadgen bytes|lines|echo|exit ...\n");
+        return 2;
+    }
+
+    const char *mode = argv[1];
+    if (std::strcmp(mode, "bytes") == 0 && argc >= 3)
+    {
+        unsigned long long rate = argc >= 4 ? parse_number(argv[3]) : 0;
+        FILE *out = argc >= 5 && std::strcmp(argv[4], "err") == 0 ? stderr : stdout;
+        return emit_bytes(parse_number(argv[2]), rate, out);
+    }
+    else if (std::strcmp(mode, "lines") == 0 && argc >= 3)
+    {
+        return emit_lines(parse_number(argv[2]), argc >= 4 ? size_t(parse_number(argv[3])) : 63);
+    }
+    else if (std::strcmp(mode, "echo") == 0)
+    {
+        return echo();
+    }
+    else if (std::strcmp(mode, "exit") == 0 && argc >= 3)
+    {
+        unsigned long long ms = parse_number(argv[2]);
+        if (ms)
+            std::this_thread::sleep_for(std::chrono::milliseconds{ms});
+
+        return argc >= 4 ? int(parse_number(argv[3])) : 0;
+    }
+
+    std::fprintf(stderr, "loadgen: unknown mode '%s'\n", mode);
+    return 2;
+}
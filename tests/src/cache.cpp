@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+#include <ulib/process_cache.h>
+
+#ifdef __linux__
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+    std::string to_std(ulib::string_view str) { return std::string{str.data(), str.size()}; }
+
+    struct temp_dir
+    {
+        temp_dir()
+        {
+            path = std::filesystem::temp_directory_path() / ("ulib-cache-test-" + std::to_string(::getpid()));
+            std::filesystem::remove_all(path);
+        }
+        ~temp_dir() { std::filesystem::remove_all(path); }
+
+        std::filesystem::path path;
+    };
+
+    size_t count_lines(const std::filesystem::path &path)
+    {
+        std::ifstream file{path};
+        std::string line;
+        size_t count = 0;
+        while (std::getline(file, line))
+            count++;
+
+        return count;
+    }
+} // namespace
+
+TEST(Cache, HitSkipsTheRun)
+{
+    temp_dir dir;
+    ulib::result_cache cache{dir.path / "cache"};
+
+    auto counter = dir.path / "runs";
+    std::string script = "echo run >> " + counter.string() + "; cat; echo err >&2; exit 3";
+
+    ulib::result_cache::command cmd;
+    cmd.path = "sh";
+    cmd.args = {u8"-c", ulib::u8string{(const char8_t *)script.c_str()}};
+    cmd.input = "hello";
+
+    auto first = cache.run(cmd);
+    ASSERT_FALSE(first.hit());
+    ASSERT_EQ(first.code(), 3);
+    ASSERT_EQ(to_std(first.out()), "hello");
+    ASSERT_EQ(to_std(first.err()), "err\n");
+
+    auto second = cache.run(cmd);
+    ASSERT_TRUE(second.hit());
+    ASSERT_EQ(second.code(), 3);
+    ASSERT_EQ(to_std(second.out()), "hello");
+    ASSERT_EQ(to_std(second.err()), "err\n");
+    ASSERT_EQ(count_lines(counter), 1u);
+
+    // a moved result keeps pointing at its mapping
+    ulib::cached_result moved = std::move(second);
+    ASSERT_EQ(to_std(moved.out()), "hello");
+
+    cmd.input = "other";
+    auto third = cache.run(cmd);
+    ASSERT_FALSE(third.hit());
+    ASSERT_EQ(to_std(third.out()), "other");
+    ASSERT_EQ(count_lines(counter), 2u);
+
+    auto stats = cache.statistics();
+    ASSERT_EQ(stats.hits, 1u);
+    ASSERT_EQ(stats.misses, 2u);
+}
+
+TEST(Cache, KeyCoversEnvAndCwd)
+{
+    temp_dir dir;
+    ulib::result_cache cache{dir.path};
+
+    ulib::result_cache::command cmd;
+    cmd.path = "/bin/sh";
+    cmd.args = {u8"-c", u8"echo $ULIB_CACHE_TEST"};
+    cmd.env = {"ULIB_CACHE_TEST"};
+
+    ::unsetenv("ULIB_CACHE_TEST");
+    auto unset = cache.make_key(cmd);
+    ::setenv("ULIB_CACHE_TEST", "", 1);
+    auto empty = cache.make_key(cmd);
+    ::setenv("ULIB_CACHE_TEST", "a", 1);
+    auto a = cache.make_key(cmd);
+
+    ASSERT_FALSE(unset == empty);
+    ASSERT_FALSE(empty == a);
+    ASSERT_TRUE(a == cache.make_key(cmd));
+
+    ASSERT_EQ(to_std(cache.run(cmd).out()), "a\n");
+    ::setenv("ULIB_CACHE_TEST", "b", 1);
+    ASSERT_EQ(to_std(cache.run(cmd).out()), "b\n");
+    ::unsetenv("ULIB_CACHE_TEST");
+
+    cmd.workingDirectory = "/";
+    ASSERT_FALSE(a == cache.make_key(cmd));
+}
+
+TEST(Cache, EvictsLeastRecentlyUsed)
+{
+    temp_dir dir;
+    ulib::result_cache cache{dir.path, 4096};
+
+    ulib::result_cache::key keys[8];
+    std::string payload(1000, 'x');
+    for (uint64 i = 0; i < 8; i++)
+    {
+        keys[i] = {i, i};
+        cache.store(keys[i], 0, payload, "");
+
+        // keep the first entry in use
+        ASSERT_TRUE(cache.lookup(keys[0]));
+    }
+
+    ASSERT_LE(cache.statistics().bytes, 4096u);
+    ASSERT_GT(cache.statistics().evictions, 0u);
+    ASSERT_TRUE(cache.lookup(keys[0]));
+    ASSERT_TRUE(cache.lookup(keys[7]));
+    ASSERT_FALSE(cache.lookup(keys[1]));
+
+    cache.clear();
+    ASSERT_FALSE(cache.lookup(keys[7]));
+}
+
+TEST(Cache, DropsCorruptEntries)
+{
+    temp_dir dir;
+    ulib::result_cache cache{dir.path};
+
+    ulib::result_cache::key k{1, 2};
+    std::ofstream{dir.path / (to_std(k.hex()) + ".res")} << "garbage";
+    ASSERT_FALSE(cache.lookup(k));
+    ASSERT_FALSE(std::filesystem::exists(dir.path / (to_std(k.hex()) + ".res")));
+}
+
+TEST(Cache, SignaledRunsAreNotStored)
+{
+    temp_dir dir;
+    ulib::result_cache cache{dir.path / "cache"};
+
+    ulib::result_cache::command cmd;
+    cmd.path = "sh";
+    cmd.args = {u8"-c", u8"kill -9 $$"};
+
+    auto first = cache.run(cmd);
+    ASSERT_FALSE(first.hit());
+    ASSERT_EQ(first.code(), 128 + 9);
+
+    ASSERT_FALSE(cache.run(cmd).hit());
+    ASSERT_FALSE(cache.lookup(cache.make_key(cmd)));
+}
+
+TEST(Cache, ResolvesFromWorkingDirectory)
+{
+    temp_dir dir;
+    ulib::result_cache cache{dir.path / "cache"};
+
+    auto tools = dir.path / "tools";
+    std::filesystem::create_directories(tools);
+
+    auto write_tool = [&](const std::string &text) {
+        std::ofstream{tools / "tool"} << "#!/bin/sh\necho " << text << "\n";
+        std::filesystem::permissions(tools / "tool", std::filesystem::perms::owner_all);
+    };
+    write_tool("one");
+
+    // ./tool only exists relative to the child's working directory
+    ulib::result_cache::command cmd;
+    cmd.path = "./tool";
+    cmd.workingDirectory = tools;
+    cmd.hash_executable = true;
+
+    auto first = cache.run(cmd);
+    ASSERT_EQ(to_std(first.out()), "one\n");
+    ASSERT_TRUE(cache.run(cmd).hit());
+
+    write_tool("two");
+    auto second = cache.run(cmd);
+    ASSERT_FALSE(second.hit());
+    ASSERT_EQ(to_std(second.out()), "two\n");
+}
+
+#endif
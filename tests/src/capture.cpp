@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#include <string>
+
+namespace
+{
+    std::string to_std(const ulib::string &str) { return std::string{str.data(), str.size()}; }
+} // namespace
+
+TEST(Capture, KeepsEverythingUnderLimits)
+{
+    ulib::bounded_capture capture{8, 8};
+    capture.append("hello ", 6);
+    capture.append("world", 5);
+
+    ASSERT_EQ(capture.total(), 11u);
+    ASSERT_FALSE(capture.truncated());
+    ASSERT_EQ(to_std(capture.head()), "hello wo");
+    ASSERT_EQ(to_std(capture.tail()), "rld");
+    ASSERT_EQ(to_std(capture.str()), "hello world");
+}
+
+TEST(Capture, DropsTheMiddle)
+{
+    ulib::bounded_capture capture{4, 6};
+
+    std::string all;
+    for (int i = 0; i < 100; i++)
+    {
+        std::string chunk = std::to_string(i) + ",";
+        all += chunk;
+        capture.append(chunk.data(), chunk.size());
+    }
+
+    ASSERT_EQ(capture.total(), all.size());
+    ASSERT_EQ(capture.omitted(), all.size() - 10);
+    ASSERT_EQ(to_std(capture.head()), all.substr(0, 4));
+    ASSERT_EQ(to_std(capture.tail()), all.substr(all.size() - 6));
+
+    // one chunk larger than the ring
+    std::string big(100, 'x');
+    big.back() = 'y';
+    capture.append(big.data(), big.size());
+    ASSERT_EQ(to_std(capture.tail()), "xxxxxy");
+    ASSERT_EQ(capture.omitted(), all.size() + big.size() - 10);
+
+    std::string text = to_std(capture.str());
+    ASSERT_NE(text.find(" bytes omitted ...]"), std::string::npos);
+}
+
+TEST(Capture, ZeroTail)
+{
+    ulib::bounded_capture capture{2, 0};
+    capture.append("abcdef", 6);
+    ASSERT_EQ(to_std(capture.head()), "ab");
+    ASSERT_EQ(capture.tail().size(), 0u);
+    ASSERT_EQ(capture.omitted(), 4u);
+}
+
+#ifdef __linux__
+TEST(Capture, ReadBounded)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"printf start; head -c 10000000 /dev/zero; printf end"},
+                       ulib::process::pipe_stdout);
+
+    auto capture = proc.out().read_bounded(5, 3);
+    ASSERT_EQ(proc.wait(), 0);
+
+    ASSERT_EQ(capture.total(), 10000008u);
+    ASSERT_EQ(to_std(capture.head()), "start");
+    ASSERT_EQ(to_std(capture.tail()), "end");
+    ASSERT_EQ(capture.omitted(), 10000000u);
+}
+#endif
+
+TEST(Capture, StreamLogKeepsOrder)
+{
+    ulib::stream_log log;
+    log.append(ulib::process_stream::out, 10, "one ", 4);
+    log.append(ulib::process_stream::err, 20, "two ", 4);
+    log.append(ulib::process_stream::out, 30, "three", 5);
+    log.append(ulib::process_stream::err, 40, "", 0);
+
+    ASSERT_EQ(log.size(), 3u);
+    ASSERT_EQ(log.bytes(ulib::process_stream::out), 9u);
+    ASSERT_EQ(log.bytes(ulib::process_stream::err), 4u);
+
+    uint64 last = 0;
+    size_t count = 0;
+    for (auto record : log)
+    {
+        ASSERT_GT(record.time_ns, last);
+        last = record.time_ns;
+        count++;
+    }
+
+    ASSERT_EQ(count, 3u);
+    ASSERT_EQ((*log.begin()).stream, ulib::process_stream::out);
+    ASSERT_EQ(to_std(log.str()), "one two three");
+    ASSERT_EQ(to_std(log.str(ulib::process_stream::out)), "one three");
+    ASSERT_EQ(to_std(log.str(ulib::process_stream::err)), "two ");
+
+    log.clear();
+    ASSERT_TRUE(log.empty());
+    ASSERT_TRUE(log.begin() == log.end());
+}
+
+#ifdef __linux__
+TEST(Capture, ReadMerged)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"printf a; sleep 0.1; printf b >&2; sleep 0.1; printf c"},
+                       ulib::process::pipe_stdout | ulib::process::pipe_stderr);
+
+    auto log = proc.read_merged();
+    ASSERT_EQ(proc.wait(), 0);
+
+    ASSERT_EQ(log.size(), 3u);
+    ASSERT_EQ(to_std(log.str()), "abc");
+    ASSERT_EQ(to_std(log.str(ulib::process_stream::err)), "b");
+
+    auto it = log.begin();
+    ASSERT_EQ((*it++).stream, ulib::process_stream::out);
+    ASSERT_EQ((*it++).stream, ulib::process_stream::err);
+    ASSERT_EQ((*it++).stream, ulib::process_stream::out);
+    ASSERT_TRUE(it == log.end());
+}
+#endif
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+TEST(Cgroup, DedicatedGroupLimitsOrThrows)
+{
+    ulib::spawn_options opts;
+    opts.limits = ulib::cgroup_limits{};
+    opts.limits->memory_max = 256 * 1024 * 1024;
+    opts.limits->pids_max = 64;
+
+    ulib::cgroup probe{u8"ulib-process-tests-probe", *opts.limits};
+    if (!probe.limits_applied())
+    {
+        // a child asked to be constrained must not run unconstrained
+        ASSERT_THROW(ulib::process(u8"return5", ulib::process::noflags, std::nullopt, opts),
+                     ulib::process_invalid_options_error);
+        return;
+    }
+
+    ulib::process proc(u8"return5", ulib::process::noflags, std::nullopt, opts);
+    auto &res = proc.wait_for_result();
+    ASSERT_EQ(res.exit_code, 5);
+    ASSERT_TRUE(res.cgroup.has_value());
+}
+
+TEST(Cgroup, UnavailableParentWithLimits)
+{
+    ulib::spawn_options opts;
+    opts.limits = ulib::cgroup_limits{};
+    opts.limits->pids_max = 64;
+    opts.cgroup_parent = "/nonexistent-cgroup-parent";
+
+    ASSERT_THROW(ulib::process(u8"return5", ulib::process::noflags, std::nullopt, opts),
+                 ulib::process_invalid_options_error);
+}
+
+TEST(Cgroup, DedicatedGroupRemovedWithoutWait)
+{
+    ulib::cgroup_limits limits;
+    limits.pids_max = 64;
+
+    ulib::cgroup parent{u8"ulib-process-tests-unwaited", limits};
+    if (!parent.limits_applied())
+        GTEST_SKIP() << "cgroup v2 controllers are not delegated";
+
+    ulib::spawn_options opts;
+    opts.limits = limits;
+    opts.cgroup_parent = parent.path();
+
+    {
+        ulib::process detached(u8"/bin/sh", {u8"-c", u8"sleep 0.1"}, ulib::process::noflags, std::nullopt, opts);
+        detached.detach();
+
+        // the destructor kills it and leaves the rest to the reaper
+        ulib::process dropped(u8"sleeper", ulib::process::noflags, std::nullopt, opts);
+    }
+
+    auto groups = [&] {
+        size_t count = 0;
+        for (auto &entry : std::filesystem::directory_iterator{parent.path()})
+            count += entry.is_directory();
+        return count;
+    };
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (groups() != 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+    ASSERT_EQ(groups(), 0u);
+}
+
+TEST(Cgroup, SharedGroupAccounting)
+{
+    ulib::cgroup group{u8"ulib-process-tests-shared"};
+    if (!group.is_available())
+        GTEST_SKIP() << "cgroup v2 delegation is not available";
+
+    ulib::spawn_options opts;
+    opts.group = &group;
+
+    for (int i = 0; i < 2; i++)
+    {
+        ulib::process proc(u8"errout", ulib::process::pipe_output, std::nullopt, opts);
+        ASSERT_EQ(proc.wait(), 0);
+    }
+
+    auto stats = group.stats();
+    ASSERT_TRUE(stats.has_value());
+    ASSERT_GT(stats->usage_usec, 0u);
+
+    auto path = group.path();
+    group.close();
+    ASSERT_FALSE(std::filesystem::exists(path));
+}
+
+TEST(Cgroup, UnavailableParent)
+{
+    ulib::cgroup group{"/nonexistent-cgroup-parent", u8"child"};
+    ASSERT_FALSE(group.is_available());
+    ASSERT_FALSE(group.stats().has_value());
+
+    ulib::spawn_options opts;
+    opts.group = &group;
+
+    ulib::process proc(u8"return5", ulib::process::noflags, std::nullopt, opts);
+    ASSERT_EQ(proc.wait(), 5);
+}
+
+#endif
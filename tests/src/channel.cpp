@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+#include <ulib/process_channel.h>
+
+#ifdef __linux__
+
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    int socket_type(int fd)
+    {
+        int type = 0;
+        socklen_t len = sizeof(type);
+        if (::getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == -1)
+            return -1;
+
+        return type;
+    }
+} // namespace
+
+TEST(Channel, PassesDescriptors)
+{
+    auto [a, b] = ulib::unix_channel::pair();
+
+    int p[2];
+    ASSERT_EQ(::pipe(p), 0);
+
+    a.send("pipe", {&p[1], 1});
+    ::close(p[1]);
+
+    char buf[16];
+    ulib::list<int> fds;
+    size_t size = b.receive(buf, sizeof(buf), fds);
+    ASSERT_EQ(std::string(buf, size), "pipe");
+    ASSERT_EQ(fds.size(), 1u);
+
+    ASSERT_EQ(::write(fds[0], "x", 1), 1);
+    ::close(fds[0]);
+
+    char ch = 0;
+    ASSERT_EQ(::read(p[0], &ch, 1), 1);
+    ASSERT_EQ(ch, 'x');
+    ::close(p[0]);
+
+    // seqpacket keeps message boundaries
+    a.send("one");
+    a.send("two");
+    ASSERT_EQ(b.receive(buf, sizeof(buf)), 3u);
+    ASSERT_EQ(b.receive(buf, sizeof(buf)), 3u);
+
+    a.send_fd(STDIN_FILENO);
+    int fd = b.receive_fd();
+    ASSERT_GT(fd, 2);
+    ::close(fd);
+}
+
+TEST(Channel, ChildChannel)
+{
+    ulib::spawn_options options;
+    options.channel = ulib::socket_kind::stream;
+    options.channel_fd = 5;
+
+    ulib::process proc("/bin/sh", {u8"-c", u8"read line <&5; echo \"got $line\" >&5"}, ulib::process::noflags,
+                       std::nullopt, options);
+
+    auto &channel = proc.channel();
+    ASSERT_TRUE(channel.is_open());
+    ASSERT_EQ(socket_type(channel.native_handle()), SOCK_STREAM);
+
+    channel.send("hello\n");
+
+    std::string reply;
+    char buf[64];
+    while (size_t size = channel.receive(buf, sizeof(buf)))
+        reply.append(buf, size);
+
+    ASSERT_EQ(reply, "got hello\n");
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Channel, StdioSockets)
+{
+    ulib::spawn_options options;
+    options.stdio_sockets = ulib::socket_kind::stream;
+
+    ulib::process proc("/bin/sh", {u8"-c", u8"read line; echo \"$line$line\""},
+                       ulib::process::pipe_stdin | ulib::process::pipe_stdout, std::nullopt, options);
+
+    ASSERT_EQ(socket_type(proc.in().native_handle()), SOCK_STREAM);
+    ASSERT_EQ(socket_type(proc.out().native_handle()), SOCK_STREAM);
+
+    proc.in().write_all("ab\n");
+    ASSERT_EQ(proc.out().getline(), "abab");
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Channel, RejectsStdioChannelFd)
+{
+    ulib::spawn_options options;
+    options.channel = ulib::socket_kind::stream;
+    options.channel_fd = 1;
+
+    ASSERT_THROW(ulib::process("/bin/true", {}, ulib::process::noflags, std::nullopt, options),
+                 ulib::process_invalid_options_error);
+}
+
+#endif
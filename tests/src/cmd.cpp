@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace ulib::literals;
+
+namespace
+{
+    constexpr bool words_are(const ulib::command_line &cmd, std::initializer_list<std::string_view> words)
+    {
+        if (cmd.argc != words.size() || cmd.argv[cmd.argc] != nullptr)
+            return false;
+
+        size_t i = 0;
+        for (auto word : words)
+        {
+            if (std::string_view{cmd.argv[i++]} != word)
+                return false;
+        }
+
+        return true;
+    }
+
+    // runtime counterpart of operator""_cmd
+    struct collect
+    {
+        std::vector<std::string> words;
+
+        void begin() { words.emplace_back(); }
+        void put(char ch) { words.back().push_back(ch); }
+        void end() {}
+    };
+
+    std::vector<std::string> scan(std::string_view line)
+    {
+        collect sink;
+        if (const char *error = ulib::detail::cmd_scan(line.data(), line.size(), sink))
+            throw std::runtime_error{error};
+
+        return sink.words;
+    }
+} // namespace
+
+// all of these are checked by the compiler
+static_assert("git log --oneline"_cmd.argc == 3);
+static_assert(words_are("git log --oneline"_cmd, {"git", "log", "--oneline"}));
+static_assert(words_are("/usr/bin/git  \t status"_cmd, {"git", "status"}));
+static_assert(std::string_view{"/usr/bin/git status"_cmd.path} == "/usr/bin/git");
+static_assert(words_are("sh -c 'echo \"hi\"'"_cmd, {"sh", "-c", "echo \"hi\""}));
+static_assert(words_are("echo \"a \\\"b\\\" \\\\c\""_cmd, {"echo", "a \"b\" \\c"}));
+static_assert(words_are("echo a\\ b"_cmd, {"echo", "a b"}));
+static_assert(words_are("echo x\"y z\"w '' \"\""_cmd, {"echo", "xy zw", "", ""}));
+static_assert(words_are("echo 'a\\b'"_cmd, {"echo", "a\\b"}));
+
+TEST(Cmd, LiteralTable)
+{
+    constexpr auto cmd = "./return5 one \"two three\""_cmd;
+    ASSERT_EQ(cmd.argc, 3);
+    ASSERT_STREQ(cmd.path, "./return5");
+    ASSERT_STREQ(cmd.argv[0], "return5");
+    ASSERT_STREQ(cmd.argv[2], "two three");
+    ASSERT_EQ(cmd.argv[3], nullptr);
+    ASSERT_STREQ(cmd.line, "./return5 one \"two three\"");
+}
+
+TEST(Cmd, RunLiteral)
+{
+    ulib::process proc("return5"_cmd);
+    ASSERT_EQ(proc.wait(), 5);
+}
+
+TEST(Cmd, RunLiteralWithPipes)
+{
+    ulib::process proc("errout"_cmd, ulib::process::pipe_stdout | ulib::process::pipe_stderr);
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Cmd, ScanErrors)
+{
+    ASSERT_THROW(scan("echo \"abc"), std::runtime_error);
+    ASSERT_THROW(scan("echo 'abc"), std::runtime_error);
+    ASSERT_THROW(scan("echo abc\\"), std::runtime_error);
+    ASSERT_THROW(scan(std::string_view{"echo a\0b", 9}), std::runtime_error);
+    ASSERT_TRUE(scan("   ").empty());
+}
+
+#ifdef __linux__
+
+TEST(Cmd, RuntimeLineEscapedQuotes)
+{
+    // used to split at the inner quotes
+    ulib::process proc(u8"/bin/sh -c \"exit \\\"3\\\"\"");
+    ASSERT_EQ(proc.wait(), 3);
+}
+
+TEST(Cmd, RuntimeLineSingleQuotes)
+{
+    ulib::process proc(u8"/bin/sh -c 'test \"a b\" = \"a b\" && exit 4'");
+    ASSERT_EQ(proc.wait(), 4);
+}
+
+TEST(Cmd, RuntimeLineMalformed)
+{
+    ASSERT_THROW(ulib::process proc(u8"/bin/sh -c \"exit 3"), ulib::process_invalid_options_error);
+    ASSERT_THROW(ulib::process proc(u8"/bin/sh -c exit\\"), ulib::process_invalid_options_error);
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+    std::string read_fd(int fd)
+    {
+        std::string result;
+        char buf[256];
+        ssize_t rv;
+        while ((rv = ::read(fd, buf, sizeof(buf))) > 0)
+            result.append(buf, size_t(rv));
+
+        return result;
+    }
+
+    std::string to_std(const ulib::string &str) { return std::string{str.data(), str.size()}; }
+} // namespace
+
+TEST(FdMap, ExtraPipes)
+{
+    ulib::spawn_options options;
+    options.fds.push_back(ulib::fd_mapping::input(4));
+    options.fds.push_back(ulib::fd_mapping::output(3));
+
+    ulib::process proc("/bin/sh", {u8"-c", u8"read x <&4; echo \"status $x\" >&3"}, ulib::process::noflags,
+                       std::nullopt, options);
+
+    proc.input(4).write_all("ok\n");
+    proc.input(4).close();
+
+    ASSERT_EQ(to_std(proc.output(3).read_all()), "status ok\n");
+    ASSERT_EQ(proc.wait(), 0);
+
+    ASSERT_THROW(proc.output(4), ulib::process_invalid_options_error);
+}
+
+TEST(FdMap, SwapsCycle)
+{
+    int a[2], b[2];
+    ASSERT_EQ(::pipe(a), 0);
+    ASSERT_EQ(::pipe(b), 0);
+
+    // the child's a[1] is our b[1] and the other way round
+    ulib::spawn_options options;
+    options.fds.push_back(ulib::fd_mapping::from_parent(a[1], b[1]));
+    options.fds.push_back(ulib::fd_mapping::from_parent(b[1], a[1]));
+
+    auto script = "printf one >&" + std::to_string(a[1]) + "; printf two >&" + std::to_string(b[1]);
+    ulib::process proc("/bin/sh", {u8"-c", ulib::u8string{(const char8_t *)script.c_str()}}, ulib::process::noflags,
+                       std::nullopt, options);
+    ASSERT_EQ(proc.wait(), 0);
+
+    ::close(a[1]);
+    ::close(b[1]);
+    ASSERT_EQ(read_fd(a[0]), "two");
+    ASSERT_EQ(read_fd(b[0]), "one");
+    ::close(a[0]);
+    ::close(b[0]);
+}
+
+TEST(FdMap, ParentFdAsStdin)
+{
+    int p[2];
+    ASSERT_EQ(::pipe(p), 0);
+    ASSERT_EQ(::write(p[1], "hi\n", 3), 3);
+    ::close(p[1]);
+
+    ulib::spawn_options options;
+    options.fds.push_back(ulib::fd_mapping::from_parent(p[0], 0));
+
+    ulib::process proc("/bin/sh", {u8"-c", u8"read x; echo $x$x"}, ulib::process::pipe_stdout, std::nullopt,
+                       options);
+    ::close(p[0]);
+
+    ASSERT_EQ(to_std(proc.out().read_all()), "hihi\n");
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(FdMap, RejectsConflicts)
+{
+    ulib::spawn_options options;
+    options.fds.push_back(ulib::fd_mapping::output(1));
+    ASSERT_THROW(ulib::process("/bin/true", {}, ulib::process::pipe_stdout, std::nullopt, options),
+                 ulib::process_invalid_options_error);
+
+    options.fds = {ulib::fd_mapping::output(3), ulib::fd_mapping::input(3)};
+    ASSERT_THROW(ulib::process("/bin/true", {}, ulib::process::noflags, std::nullopt, options),
+                 ulib::process_invalid_options_error);
+
+    options.fds = {ulib::fd_mapping::from_parent(1000, 3)};
+    ASSERT_THROW(ulib::process("/bin/true", {}, ulib::process::noflags, std::nullopt, options),
+                 ulib::process_invalid_options_error);
+}
+
+TEST(FdMap, HighTargetWithProfile)
+{
+    // the go pipe sits below fd 40 and is lifted above it, its original write end must not stay open
+    ulib::spawn_options options;
+    options.profile = true;
+    options.fds.push_back(ulib::fd_mapping::from_parent(STDERR_FILENO, 40));
+
+    // hung in the constructor, waiting for the go pipe to close
+    ulib::process proc("/bin/sh", {u8"-c", u8"test -e /proc/$$/fd/40"}, ulib::process::noflags, std::nullopt,
+                       options);
+
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <ulib/process_graph.h>
+
+using namespace std::chrono_literals;
+using state = ulib::process_graph::node_state;
+
+TEST(ProcessGraph, RunsDependenciesFirst)
+{
+    ulib::process_graph graph;
+    auto a = graph.add(u8"a", u8"return5", {});
+    auto b = graph.add(u8"b", u8"errout", {}, {a});
+
+    ulib::process_graph::options opts;
+    opts.mode = ulib::process_graph::failure_mode::keep_going;
+    auto res = graph.run(opts);
+
+    ASSERT_EQ(res.nodes[a].state, state::failed);
+    ASSERT_EQ(res.nodes[a].exit_code, 5);
+    ASSERT_EQ(res.nodes[b].state, state::skipped);
+    ASSERT_FALSE(res.succeeded());
+}
+
+TEST(ProcessGraph, CriticalPathFirst)
+{
+    ulib::process_graph graph;
+    auto lone = graph.add(u8"lone", u8"return5", {});
+    auto head = graph.add(u8"head", u8"errout", {});
+    auto tail = graph.add(u8"tail", u8"errout", {}, {head});
+
+    ulib::process_graph::history times;
+    times.record(u8"lone", 100ms);
+    times.record(u8"head", 50ms);
+    times.record(u8"tail", 100ms);
+
+    ulib::process_graph::options opts;
+    opts.max_jobs = 1;
+    opts.mode = ulib::process_graph::failure_mode::keep_going;
+    opts.times = &times;
+    auto res = graph.run(opts);
+
+    ASSERT_EQ(res.nodes[head].state, state::succeeded);
+    ASSERT_EQ(res.nodes[tail].state, state::succeeded);
+    ASSERT_EQ(res.nodes[lone].state, state::failed);
+    ASSERT_LE(res.nodes[head].finished_at, res.nodes[tail].started_at);
+    ASSERT_LE(res.nodes[head].finished_at, res.nodes[lone].started_at);
+    ASSERT_EQ(res.critical_path, std::chrono::steady_clock::duration{150ms});
+    ASSERT_FALSE(res.report().empty());
+}
+
+TEST(ProcessGraph, FailFastCancelsRunning)
+{
+    ulib::process_graph graph;
+    auto sleeper = graph.add(u8"sleeper", u8"sleeper", {});
+    auto fail = graph.add(u8"fail", u8"return5", {});
+    auto after = graph.add(u8"after", u8"errout", {}, {sleeper});
+
+    ulib::process_graph::options opts;
+    opts.max_jobs = 2;
+    auto res = graph.run(opts);
+
+    ASSERT_EQ(res.nodes[fail].state, state::failed);
+    ASSERT_EQ(res.nodes[sleeper].state, state::cancelled);
+    ASSERT_EQ(res.nodes[after].state, state::cancelled);
+    ASSERT_LT(res.wall_time, std::chrono::steady_clock::duration{10s});
+}
+
+TEST(ProcessGraph, SpawnErrorFailsNode)
+{
+    ulib::process_graph graph;
+    auto bad = graph.add(u8"bad", u8"ech111221ddo", {});
+
+    auto res = graph.run();
+    ASSERT_EQ(res.nodes[bad].state, state::failed);
+    ASSERT_FALSE(res.nodes[bad].error.empty());
+}
+
+TEST(ProcessGraph, CycleError)
+{
+    ulib::process_graph graph;
+    auto a = graph.add(u8"a", u8"return5", {});
+    auto b = graph.add(u8"b", u8"return5", {}, {a});
+    graph.depend(a, b);
+
+    ASSERT_THROW(graph.run(), ulib::process_graph_error);
+}
+
+#ifdef __linux__
+
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+TEST(ProcessGraph, WideGraphNeedsNoThreadPerNode)
+{
+    ulib::process_graph graph;
+    for (int i = 0; i < 64; i++)
+        graph.add(u8"sleep", u8"/bin/sh", {u8"-c", u8"sleep 0.3"});
+
+    auto threads = [] {
+        size_t count = 0;
+        for (auto it = std::filesystem::directory_iterator{"/proc/self/task"}; it != decltype(it){}; ++it)
+            count++;
+        return count;
+    };
+
+    size_t before = threads();
+    std::atomic<bool> done{false};
+    size_t peak = 0;
+
+    ulib::process_graph::options opts;
+    opts.max_jobs = 64;
+    ulib::process_graph::result res;
+    std::thread runner([&] {
+        res = graph.run(opts);
+        done = true;
+    });
+
+    while (!done)
+    {
+        peak = std::max(peak, threads());
+        std::this_thread::sleep_for(10ms);
+    }
+    runner.join();
+
+    ASSERT_TRUE(res.succeeded());
+    // the runner itself, plus the library's reaper thread at most
+    ASSERT_LE(peak, before + 2);
+}
+
+TEST(ProcessGraph, ExitedNodesAreNotCancelled)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        ulib::process_graph graph;
+        for (int i = 0; i < 8; i++)
+            graph.add(u8"ok", u8"/bin/sh", {u8"-c", u8"true"});
+        graph.add(u8"fail", u8"/bin/sh", {u8"-c", u8"exit 1"});
+
+        ulib::process_graph::options opts;
+        opts.max_jobs = 9;
+        auto res = graph.run(opts);
+
+        // a node that exited 0 before fail_fast got to it ran successfully, whatever the order of the waits
+        for (auto &node : res.nodes)
+        {
+            if (node.exit_code == 0)
+            {
+                ASSERT_EQ(node.state, state::succeeded);
+            }
+            else
+            {
+                ASSERT_NE(node.state, state::succeeded);
+            }
+        }
+    }
+}
+
+#endif
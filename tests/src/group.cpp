@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+#include <ulib/process_tree.h>
+
+#ifdef __linux__
+
+#include <chrono>
+#include <csignal>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    ulib::list<int> wait_for_descendants(int pid, size_t count)
+    {
+        ulib::process_tree tree;
+        for (int i = 0; i < 200; i++)
+        {
+            tree.refresh();
+            auto descendants = tree.descendants(pid);
+            if (descendants.size() >= count)
+                return descendants;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+
+        return {};
+    }
+} // namespace
+
+TEST(Group, NewProcessGroup)
+{
+    ulib::process proc(u8"sleeper", ulib::process::new_process_group);
+    ASSERT_EQ(getpgid(proc.pid()), proc.pid());
+    ASSERT_EQ(getsid(proc.pid()), getsid(0));
+
+    ASSERT_EQ(proc.terminate(std::chrono::milliseconds{1000}), 128 + SIGTERM);
+    ASSERT_EQ(proc.pidfd(), -1);
+}
+
+TEST(Group, NewSession)
+{
+    ulib::process proc(u8"sleeper", ulib::process::new_session);
+    ASSERT_EQ(getsid(proc.pid()), proc.pid());
+    ASSERT_EQ(getpgid(proc.pid()), proc.pid());
+
+    proc.terminate();
+    proc.wait();
+}
+
+TEST(Group, GracefulExit)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"trap 'exit 7' TERM; ./sleeper & wait"},
+                       ulib::process::new_process_group);
+    ASSERT_EQ(wait_for_descendants(proc.pid(), 1).size(), 1u);
+
+    ASSERT_EQ(proc.terminate(std::chrono::milliseconds{5000}), 7);
+}
+
+TEST(Group, EscalatesToKill)
+{
+    // ignored signals stay ignored across exec, so neither sh nor sleeper reacts to SIGTERM
+    ulib::process proc("/bin/sh", {u8"-c", u8"trap '' TERM; ./sleeper; :"}, ulib::process::new_process_group);
+    ASSERT_EQ(wait_for_descendants(proc.pid(), 1).size(), 1u);
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(proc.terminate(std::chrono::milliseconds{200}), 128 + SIGKILL);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{200});
+    ASSERT_EQ(proc.result()->signal, SIGKILL);
+}
+
+TEST(Group, SubreaperCollectsGrandchildren)
+{
+    ASSERT_TRUE(ulib::set_child_subreaper(true));
+
+    ulib::process proc("/bin/sh", {u8"-c", u8"./sleeper & ./sleeper & wait"}, ulib::process::new_session);
+    auto grandchildren = wait_for_descendants(proc.pid(), 2);
+    ASSERT_EQ(grandchildren.size(), 2u);
+
+    proc.terminate(std::chrono::milliseconds{1000});
+
+    // re-parented to us instead of init
+    for (int pid : grandchildren)
+    {
+        int status = 0;
+        ASSERT_EQ(waitpid(pid, &status, 0), pid);
+        ASSERT_TRUE(WIFSIGNALED(status));
+    }
+
+    ASSERT_TRUE(ulib::set_child_subreaper(false));
+}
+
+#endif
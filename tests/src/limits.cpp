@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string run_output(ulib::u8string_view line, const ulib::spawn_options &opts)
+    {
+        ulib::process proc(line, ulib::process::pipe_stdout, std::nullopt, opts);
+        ulib::string raw = proc.out().read_all();
+        proc.wait();
+        return std::string{raw.data(), raw.size()};
+    }
+
+    // the n-th (1-based) field of /proc/<pid>/stat, counted after the command name
+    std::string stat_field(const std::string &stat, int n)
+    {
+        size_t pos = stat.rfind(')') + 2;
+        for (int i = 3; i < n; i++)
+            pos = stat.find(' ', pos) + 1;
+
+        return stat.substr(pos, stat.find(' ', pos) - pos);
+    }
+} // namespace
+
+TEST(Limits, Rlimits)
+{
+    ulib::spawn_options opts;
+    opts.rlimits.push_back({RLIMIT_NOFILE, 64, 64});
+    opts.rlimits.push_back({RLIMIT_CORE, 0, 0});
+
+    std::string limits = run_output(u8"cat /proc/self/limits", opts);
+    ASSERT_NE(limits.find("Max open files            64                   64"), std::string::npos);
+    ASSERT_NE(limits.find("Max core file size        0                    0"), std::string::npos);
+}
+
+TEST(Limits, NiceAndScheduler)
+{
+    ulib::spawn_options opts;
+    opts.nice = 10;
+    opts.scheduler = ulib::sched_policy::batch;
+
+    std::string stat = run_output(u8"cat /proc/self/stat", opts);
+    ASSERT_EQ(stat_field(stat, 19), "10"); // nice
+    ASSERT_EQ(stat_field(stat, 41), "3");  // policy
+}
+
+TEST(Limits, IoPriority)
+{
+    ulib::spawn_options opts;
+    opts.io = ulib::io_priority{ulib::io_priority::idle, 0};
+
+    try
+    {
+        ASSERT_EQ(run_output(u8"ionice", opts), "idle\n");
+    }
+    catch (const ulib::process_file_not_found_error &)
+    {
+        GTEST_SKIP() << "ionice is not available";
+    }
+}
+
+TEST(Limits, InvalidValues)
+{
+    ulib::spawn_options opts;
+    opts.nice = 40;
+    ASSERT_THROW({ ulib::process proc(u8"return5", ulib::process::noflags, std::nullopt, opts); },
+                 ulib::process_invalid_options_error);
+
+    ulib::spawn_options raise;
+    raise.rlimits.push_back({RLIMIT_NOFILE, RLIM_INFINITY, RLIM_INFINITY});
+    if (::geteuid() != 0)
+    {
+        ASSERT_THROW({ ulib::process proc(u8"return5", ulib::process::noflags, std::nullopt, raise); },
+                     ulib::process_internal_error);
+    }
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+#include <ulib/process_memfd.h>
+
+#ifdef __linux__
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string to_std(const ulib::string &str) { return std::string{str.data(), str.size()}; }
+
+    // stands in for an image embedded in the binary
+    const std::string &shell_image()
+    {
+        static std::string image = [] {
+            std::ifstream file{"/bin/sh", std::ios::binary};
+            return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        }();
+
+        return image;
+    }
+} // namespace
+
+TEST(Memfd, RunsImage)
+{
+    const std::string &image = shell_image();
+    ASSERT_FALSE(image.empty());
+
+    ulib::memfd_executable exe{"embedded-sh", image.data(), image.size()};
+    ASSERT_TRUE(exe.is_open());
+    ASSERT_EQ(exe.size(), image.size());
+
+    ulib::process proc(exe, {u8"-c", u8"exit 7"});
+    ASSERT_EQ(proc.wait(), 7);
+}
+
+TEST(Memfd, ArgvAndPipes)
+{
+    const std::string &image = shell_image();
+    ulib::memfd_executable exe{"embedded-sh", image.data(), image.size()};
+
+    ulib::process proc(exe, {u8"-c", u8"echo $0 $1", u8"zero", u8"one"}, ulib::process::pipe_stdout);
+    ASSERT_EQ(to_std(proc.out().read_all()), "zero one\n");
+    ASSERT_EQ(proc.wait(), 0);
+
+    ulib::process link(exe, {u8"-c", u8"readlink /proc/$$/exe"}, ulib::process::pipe_stdout);
+    ASSERT_EQ(to_std(link.out().read_all()).rfind("/memfd:embedded-sh", 0), 0);
+    ASSERT_EQ(link.wait(), 0);
+}
+
+TEST(Memfd, Sealed)
+{
+    const std::string &image = shell_image();
+    ulib::memfd_executable exe{"embedded-sh", image.data(), image.size()};
+
+    ASSERT_EQ(::pwrite(exe.native_handle(), "x", 1, 0), -1);
+    ASSERT_EQ(::ftruncate(exe.native_handle(), 0), -1);
+}
+
+TEST(Memfd, CachedOncePerImage)
+{
+    const std::string &image = shell_image();
+
+    const ulib::memfd_executable &first = ulib::memfd_executable::cached("embedded-sh", image.data(), image.size());
+    const ulib::memfd_executable &second = ulib::memfd_executable::cached("embedded-sh", image.data(), image.size());
+    ASSERT_EQ(&first, &second);
+    ASSERT_EQ(first.native_handle(), second.native_handle());
+
+    for (int i = 0; i < 5; i++)
+    {
+        ulib::process proc(first, {u8"-c", u8"exit 4"});
+        ASSERT_EQ(proc.wait(), 4);
+    }
+}
+
+TEST(Memfd, SurvivesFdMappings)
+{
+    const std::string &image = shell_image();
+    ulib::memfd_executable exe{"embedded-sh", image.data(), image.size()};
+
+    // the child descriptor numbers cover the memfd's own number, it must still be exec'd
+    ulib::spawn_options options;
+    for (int fd = 3; fd <= exe.native_handle() + 1; fd++)
+        options.fds.push_back(ulib::fd_mapping::from_parent(STDERR_FILENO, fd));
+
+    ulib::process proc(exe, {u8"-c", u8"exit 9"}, ulib::process::noflags, std::nullopt, options);
+    ASSERT_EQ(proc.wait(), 9);
+}
+
+TEST(Memfd, AdoptRequiresSeals)
+{
+    int fd = ::memfd_create("unsealed", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    ASSERT_NE(fd, -1);
+    ASSERT_THROW(ulib::memfd_executable::adopt("unsealed", fd), ulib::process_invalid_options_error);
+
+    const std::string &image = shell_image();
+    ASSERT_EQ(::write(fd, image.data(), image.size()), ssize_t(image.size()));
+    ASSERT_EQ(::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE), 0);
+
+    ulib::memfd_executable exe = ulib::memfd_executable::adopt("adopted", fd);
+    ASSERT_EQ(exe.size(), image.size());
+
+    ulib::process proc(exe, {u8"-c", u8"exit 3"});
+    ASSERT_EQ(proc.wait(), 3);
+}
+
+TEST(Memfd, ClosedExecutableThrows)
+{
+    ulib::memfd_executable exe;
+    ASSERT_THROW(ulib::process(exe, {}), ulib::process_invalid_options_error);
+}
+
+TEST(Memfd, CaptureStdout)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"head -c 1000000 /dev/zero | tr '\\0' a"},
+                       ulib::process::capture_stdout);
+    ASSERT_EQ(proc.wait(), 0);
+
+    ulib::mapped_output out = proc.captured_stdout();
+    ASSERT_EQ(out.size(), 1000000);
+    ASSERT_EQ(std::string(out.data(), out.size()), std::string(1000000, 'a'));
+}
+
+TEST(Memfd, CaptureWithStderrPipe)
+{
+    ulib::process proc(u8"errout", ulib::process::capture_stdout | ulib::process::pipe_stderr);
+    ASSERT_EQ(to_std(proc.err().read_all()), "cerr\n");
+    proc.wait();
+
+    ulib::mapped_output out = proc.captured_stdout();
+    ASSERT_EQ(std::string(out.data(), out.size()), "cout\n");
+}
+
+TEST(Memfd, CaptureOutlivesProcess)
+{
+    ulib::mapped_output out;
+    ulib::mapped_output empty;
+    {
+        ulib::process proc("/bin/sh", {u8"-c", u8"echo kept"}, ulib::process::capture_stdout);
+        proc.wait();
+        out = proc.captured_stdout();
+
+        ulib::process silent("/bin/sh", {u8"-c", u8"true"}, ulib::process::capture_stdout);
+        silent.wait();
+        empty = silent.captured_stdout();
+    }
+
+    ASSERT_EQ(std::string(out.data(), out.size()), "kept\n");
+    ASSERT_TRUE(empty.empty());
+}
+
+TEST(Memfd, CaptureFlagChecks)
+{
+    ASSERT_THROW(ulib::process(u8"return5", ulib::process::capture_stdout | ulib::process::pipe_stdout),
+                 ulib::process_invalid_flags_error);
+    ASSERT_THROW(ulib::process(u8"return5", ulib::process::capture_stdout | ulib::process::pipe_output),
+                 ulib::process_invalid_flags_error);
+
+    ulib::process proc(u8"return5");
+    proc.wait();
+    ASSERT_THROW(proc.captured_stdout(), ulib::process_invalid_flags_error);
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+#include <ulib/process_metrics.h>
+
+#include <string>
+
+TEST(Metrics, HistogramBuckets)
+{
+    using h = ulib::latency_histogram;
+
+    for (uint64_t ns : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 40})
+    {
+        size_t index = h::bucket_index(ns);
+        ASSERT_LE(h::bucket_lower(index), ns);
+        ASSERT_GT(h::bucket_upper(index), ns);
+    }
+
+    ASSERT_EQ(h::bucket_index(~0ull), h::bucket_count - 1);
+
+    // buckets stay within 1/16 of the value
+    size_t index = h::bucket_index(1000000);
+    ASSERT_LE(h::bucket_upper(index) - h::bucket_lower(index), 1000000u / 16);
+}
+
+TEST(Metrics, HistogramPercentile)
+{
+    ulib::latency_histogram h;
+    for (uint64_t ns = 1; ns <= 100; ns++)
+    {
+        h.buckets[h.bucket_index(ns * 1000)]++;
+        h.count++;
+        h.sum_ns += ns * 1000;
+    }
+
+    ASSERT_EQ(h.mean().count(), 50500);
+
+    auto p50 = h.percentile(0.5).count();
+    ASSERT_GE(p50, 50000);
+    ASSERT_LE(p50, 50000 * 17 / 16);
+
+    ASSERT_GE(h.percentile(1.0).count(), 100000);
+    ASSERT_EQ(h.count_below(1 << 9), 0u);
+    ASSERT_EQ(h.count_below(1 << 17), 100u);
+}
+
+TEST(Metrics, RecordsSpawns)
+{
+    if (!ulib::process_metrics::available)
+        GTEST_SKIP() << "built with ULIB_PROCESS_NO_METRICS";
+
+    ulib::process_metrics::enable();
+    ulib::process_metrics::reset();
+
+    ulib::process proc(u8"errout", ulib::process::pipe_stdout | ulib::process::pipe_stderr);
+    proc.out().read_all();
+    proc.err().read_all();
+    proc.wait();
+
+    ASSERT_THROW(ulib::process(u8"no-such-binary-ulib-process"), ulib::process_file_not_found_error);
+
+    auto snap = ulib::process_metrics::snapshot();
+    ulib::process_metrics::enable(false);
+
+    ASSERT_EQ(snap.spawns, 1u);
+    ASSERT_EQ(snap.spawn_failures, 1u);
+    ASSERT_EQ(snap.exec_failures, 1u);
+    ASSERT_EQ(snap.phase(ulib::spawn_phase::fork).count, 2u);
+    ASSERT_EQ(snap.phase(ulib::spawn_phase::child_setup).count, 2u);
+    ASSERT_EQ(snap.phase(ulib::spawn_phase::total).count, 1u);
+    ASSERT_GT(snap.stream_bytes(ulib::process_stream::out) + snap.stream_bytes(ulib::process_stream::err), 0u);
+    ASSERT_GT(snap.read_calls, 0u);
+
+    std::string text = ulib::process_metrics::prometheus(snap).c_str();
+    ASSERT_NE(text.find("# TYPE ulib_process_spawn_phase_seconds histogram"), std::string::npos);
+    ASSERT_NE(text.find("ulib_process_spawn_phase_seconds_count{phase=\"total\"} 1"), std::string::npos);
+    ASSERT_NE(text.find("ulib_process_spawns_total 1"), std::string::npos);
+}
+
+TEST(Metrics, DisabledRecordsNothing)
+{
+    ulib::process_metrics::enable(false);
+    ulib::process_metrics::reset();
+
+    ulib::process proc(u8"errout", ulib::process::pipe_stdout | ulib::process::pipe_stderr);
+    proc.out().read_all();
+    proc.err().read_all();
+    proc.wait();
+
+    auto snap = ulib::process_metrics::snapshot();
+    ASSERT_FALSE(ulib::process_metrics::is_enabled());
+    ASSERT_EQ(snap.spawns, 0u);
+    ASSERT_EQ(snap.read_calls, 0u);
+    ASSERT_EQ(snap.phase(ulib::spawn_phase::child_setup).count, 0u);
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <ulib/process_monitor.h>
+
+#ifdef __linux__
+
+#include <atomic>
+#include <thread>
+
+TEST(Monitor, SamplesChild)
+{
+    ulib::process proc(u8"sleeper");
+
+    ulib::process_monitor::options opts;
+    opts.sample_io = true;
+    ulib::process_monitor monitor{opts};
+    monitor.add(proc);
+
+    // right after exec the new address space may not have faulted anything in yet
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    monitor.tick();
+
+    auto sample = monitor.sample(proc.pid());
+    ASSERT_TRUE(sample.has_value());
+    ASSERT_TRUE(sample->alive);
+    ASSERT_GE(sample->threads, 1u);
+    ASSERT_GT(sample->rss_bytes, 0u);
+    ASSERT_EQ(monitor.snapshot().size(), 1u);
+
+    proc.terminate();
+    proc.wait();
+    monitor.tick();
+    ASSERT_FALSE(monitor.sample(proc.pid())->alive);
+
+    monitor.remove(proc.pid());
+    ASSERT_EQ(monitor.size(), 0u);
+}
+
+TEST(Monitor, RssLimitTerminates)
+{
+    ulib::process proc(u8"sleeper");
+
+    ulib::process_monitor::options opts;
+    opts.interval = std::chrono::milliseconds{10};
+    ulib::process_monitor monitor{opts};
+
+    std::atomic<int> killed{0};
+    monitor.on_terminate([&](const ulib::process_sample &s) { killed = s.pid; });
+    monitor.add(proc, ulib::rss_limit{1, std::chrono::milliseconds{20}});
+    monitor.start();
+
+    auto &res = proc.wait_for_result();
+    monitor.stop();
+
+    ASSERT_EQ(res.signal, SIGKILL);
+    ASSERT_EQ(killed, proc.pid());
+    ASSERT_TRUE(monitor.sample(proc.pid())->terminated);
+}
+
+#endif
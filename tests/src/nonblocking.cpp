@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <chrono>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(Nonblocking, TryReadAndDeadline)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"sleep 0.3; printf hi"}, ulib::process::pipe_stdout);
+    auto &out = proc.out();
+
+    char buf[16];
+    ASSERT_FALSE(out.try_read(buf, sizeof(buf)));
+    ASSERT_FALSE(out.readable());
+    ASSERT_FALSE(out.read(buf, sizeof(buf), std::chrono::steady_clock::now() + 20ms));
+
+    auto rv = out.read(buf, sizeof(buf), std::chrono::steady_clock::now() + 5s);
+    ASSERT_TRUE(rv);
+    ASSERT_EQ(std::string(buf, *rv), "hi");
+
+    rv = out.read(buf, sizeof(buf), std::chrono::steady_clock::now() + 5s);
+    ASSERT_TRUE(rv);
+    ASSERT_EQ(*rv, 0u);
+
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Nonblocking, NonblockingMode)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"sleep 0.2; printf x"}, ulib::process::pipe_stdout);
+    auto &out = proc.out();
+
+    ASSERT_FALSE(out.is_nonblocking());
+    out.set_nonblocking();
+    ASSERT_TRUE(out.is_nonblocking());
+
+    char ch;
+    ASSERT_EQ(ssize_t(out.read(&ch, 1)), -1);
+    ASSERT_EQ(errno, EAGAIN);
+    ASSERT_FALSE(out.try_read(&ch, 1));
+
+    ASSERT_TRUE(out.readable(5000ms));
+    ASSERT_EQ(out.try_read(&ch, 1), 1u);
+    ASSERT_EQ(ch, 'x');
+
+    // read_bounded keeps working by waiting for the rest
+    ASSERT_EQ(out.read_bounded(16, 16).total(), 0u);
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Nonblocking, WriteDeadline)
+{
+    for (bool nonblocking : {false, true})
+    {
+        ulib::process proc("/bin/sh", {u8"-c", u8"sleep 5"}, ulib::process::pipe_stdin);
+        auto &in = proc.in();
+        if (nonblocking)
+            in.set_nonblocking();
+
+        std::vector<char> data(4 * 1024 * 1024, 'a');
+        auto start = std::chrono::steady_clock::now();
+        size_t written = in.write(data.data(), data.size(), start + 100ms);
+
+        ASSERT_GT(written, 0u);
+        ASSERT_LT(written, data.size());
+        ASSERT_LT(std::chrono::steady_clock::now() - start, 3s);
+
+        ASSERT_FALSE(in.writable());
+        ASSERT_FALSE(in.try_write(data.data(), data.size()));
+
+        proc.terminate();
+        proc.wait();
+    }
+}
+
+TEST(Nonblocking, ReaderGoneThrows)
+{
+    for (bool nonblocking : {false, true})
+    {
+        ulib::process proc(u8"return5", ulib::process::pipe_stdin);
+        ASSERT_EQ(proc.wait(), 5);
+
+        auto &in = proc.in();
+        if (nonblocking)
+            in.set_nonblocking();
+
+        // EPIPE, where SIGPIPE would have killed the test
+        ASSERT_EQ(in.write("x", 1), size_t(-1));
+        ASSERT_EQ(errno, EPIPE);
+        ASSERT_THROW(in.try_write("x", 1), ulib::process_internal_error);
+        ASSERT_THROW(in.write("x", 1, std::chrono::steady_clock::now() + 100ms), ulib::process_internal_error);
+    }
+}
+
+#endif
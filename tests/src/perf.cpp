@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+TEST(Perf, CountersOrUnavailable)
+{
+    ulib::spawn_options opts;
+    opts.profile = true;
+
+    ulib::process proc(u8"errout", ulib::process::pipe_output, std::nullopt, opts);
+    auto &res = proc.wait_for_result();
+    ASSERT_EQ(res.exit_code, 0);
+    ASSERT_TRUE(res.perf.has_value());
+
+    if (res.perf->available)
+    {
+        ASSERT_TRUE(res.perf->task_clock.has_value());
+        ASSERT_GT(res.perf->task_clock->count(), 0);
+        if (res.perf->instructions)
+        {
+            ASSERT_GT(*res.perf->instructions, 0u);
+        }
+    }
+    else
+    {
+        ASSERT_FALSE(res.perf->error.empty());
+    }
+}
+
+TEST(Perf, NotRequested)
+{
+    ulib::process proc(u8"return5");
+    ASSERT_FALSE(proc.wait_for_result().perf.has_value());
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+namespace
+{
+    std::string status_field(ulib::process &proc, std::string_view key)
+    {
+        ulib::string raw = proc.out().read_all();
+        std::string out{raw.data(), raw.size()};
+        size_t pos = out.find(key);
+        if (pos == std::string::npos)
+            return {};
+
+        size_t begin = out.find_first_not_of(":\t ", pos + key.size());
+        size_t end = out.find('\n', begin);
+        return out.substr(begin, end - begin);
+    }
+} // namespace
+
+TEST(Placement, ParseCpuList)
+{
+    auto cpus = ulib::detail::parse_cpu_list("0-2,5,8-9\n");
+    ASSERT_EQ(cpus, (ulib::list<int>{0, 1, 2, 5, 8, 9}));
+}
+
+TEST(Placement, Affinity)
+{
+    auto topology = ulib::cpu_topology::current();
+    ASSERT_GT(topology.cpus().size(), 0u);
+    ASSERT_GT(topology.nodes().size(), 0u);
+
+    int cpu = topology.cpus().back();
+
+    ulib::spawn_options opts;
+    opts.cpus.push_back(cpu);
+
+    ulib::process proc(u8"cat /proc/self/status", ulib::process::pipe_stdout, std::nullopt, opts);
+    ASSERT_EQ(status_field(proc, "Cpus_allowed_list"), std::to_string(cpu));
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Placement, SpreadByNode)
+{
+    auto topology = ulib::cpu_topology::current();
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        ulib::spawn_options opts;
+        topology.place(opts, i, ulib::cpu_topology::by_node);
+
+        auto &node = topology.nodes()[i % topology.nodes().size()];
+        ASSERT_EQ(opts.cpus, node.cpus);
+        ASSERT_TRUE(opts.memory_policy.has_value());
+
+        ulib::process proc(u8"return5", ulib::process::noflags, std::nullopt, opts);
+        ASSERT_EQ(proc.wait(), 5);
+    }
+}
+
+TEST(Placement, InvalidCpu)
+{
+    ulib::spawn_options opts;
+    opts.cpus.push_back(-1);
+    ASSERT_THROW({ ulib::process proc(u8"return5", ulib::process::noflags, std::nullopt, opts); },
+                 ulib::process_invalid_options_error);
+}
+
+#endif
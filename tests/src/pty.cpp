@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+
+#ifdef __linux__
+
+#include <chrono>
+#include <string>
+
+namespace
+{
+    std::string to_std(const ulib::string &str) { return std::string{str.data(), str.size()}; }
+
+    // reads until text shows up or the pty is closed
+    std::string read_until(ulib::process::rpipe &out, const std::string &text)
+    {
+        std::string result;
+        char buf[256];
+        while (result.find(text) == std::string::npos)
+        {
+            auto rv = out.read(buf, sizeof(buf), std::chrono::steady_clock::now() + std::chrono::seconds{5});
+            if (!rv || *rv == 0)
+                break;
+
+            result.append(buf, *rv);
+        }
+
+        return result;
+    }
+} // namespace
+
+TEST(Pty, StdioIsATerminal)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"test -t 0 && test -t 1 && test -t 2 && echo tty"},
+                       ulib::process::pty);
+    ASSERT_EQ(to_std(proc.out().read_all()), "tty\r\n");
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Pty, WindowSize)
+{
+    ulib::spawn_options options;
+    options.pty_size = {30, 100};
+
+    ulib::process proc("/bin/sh",
+                       {u8"-c", u8"trap 'stty size; exit 0' WINCH; stty size; while :; do sleep 0.05; done"},
+                       ulib::process::pty, std::nullopt, options);
+
+    ASSERT_NE(read_until(proc.out(), "30 100\r\n").find("30 100"), std::string::npos);
+
+    proc.resize_terminal(40, 120);
+    ASSERT_NE(read_until(proc.out(), "40 120\r\n").find("40 120"), std::string::npos);
+    ASSERT_EQ(read_until(proc.out(), "never"), "");
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Pty, NoEchoAndSeparateStderr)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"read x; echo \"[$x]\"; echo err >&2"},
+                       ulib::process::pty | ulib::process::pipe_stderr);
+
+    proc.in().write_all("abc\n");
+    ASSERT_EQ(to_std(proc.out().read_all()), "[abc]\r\n");
+    ASSERT_EQ(to_std(proc.err().read_all()), "err\n");
+    ASSERT_EQ(proc.wait(), 0);
+}
+
+TEST(Pty, RejectsPipes)
+{
+    ASSERT_THROW(ulib::process("/bin/true", {}, ulib::process::pty | ulib::process::pipe_stdout),
+                 ulib::process_invalid_flags_error);
+
+    ulib::process proc("/bin/true", {}, ulib::process::pipe_stdout);
+    ASSERT_THROW(proc.resize_terminal(10, 10), ulib::process_invalid_flags_error);
+    proc.wait();
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <ulib/process_reaper.h>
+#include <ulib/process_tree.h>
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+namespace
+{
+    // zombies stay in /proc until reaped
+    bool wait_until_gone(const ulib::list<int> &pids, std::chrono::milliseconds timeout)
+    {
+        ulib::process_tree tree;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            tree.refresh();
+
+            bool any = false;
+            for (int pid : pids)
+                any |= tree.contains(pid);
+
+            if (!any)
+                return true;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+
+        return false;
+    }
+} // namespace
+
+TEST(Reaper, DetachedChildIsReaped)
+{
+    ulib::process proc(u8"return5");
+    int pid = proc.pid();
+    proc.detach();
+
+    ASSERT_TRUE(wait_until_gone({pid}, std::chrono::seconds{5}));
+}
+
+TEST(Reaper, DestroyedChildIsReaped)
+{
+    int pid;
+    {
+        ulib::process proc(u8"sleeper");
+        pid = proc.pid();
+    }
+
+    ASSERT_TRUE(wait_until_gone({pid}, std::chrono::seconds{5}));
+}
+
+TEST(Reaper, ExitNotification)
+{
+    std::promise<std::pair<int, int>> exited;
+
+    ulib::process proc(u8"return5");
+    proc.on_exit([&](int pid, int code) { exited.set_value({pid, code}); });
+
+    auto future = exited.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds{5}), std::future_status::ready);
+
+    auto [pid, code] = future.get();
+    ASSERT_EQ(pid, proc.pid());
+    ASSERT_EQ(code, 5);
+
+    // the status is left for the owner
+    ASSERT_EQ(proc.wait(), 5);
+}
+
+TEST(Reaper, NotificationDeliveredOnce)
+{
+    std::atomic<int> calls{0};
+
+    ulib::process proc(u8"return5");
+    proc.on_exit([&](int, int code) {
+        EXPECT_EQ(code, 5);
+        calls++;
+    });
+
+    ASSERT_EQ(proc.wait(), 5);
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    ASSERT_EQ(calls, 1);
+}
+
+TEST(Reaper, NotificationSurvivesDetach)
+{
+    std::promise<int> exited;
+
+    ulib::process proc("/bin/sh", {u8"-c", u8"sleep 0.05; exit 3"});
+    int pid = proc.pid();
+    proc.on_exit([&](int, int code) { exited.set_value(code); });
+    proc.detach();
+
+    auto future = exited.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds{5}), std::future_status::ready);
+    ASSERT_EQ(future.get(), 3);
+    ASSERT_TRUE(wait_until_gone({pid}, std::chrono::seconds{5}));
+}
+
+TEST(Reaper, ManyDetachedChildren)
+{
+    ulib::list<int> pids;
+    for (int i = 0; i < 200; i++)
+    {
+        ulib::process proc(u8"return5");
+        pids.push_back(proc.pid());
+        proc.detach();
+    }
+
+    ASSERT_TRUE(wait_until_gone(pids, std::chrono::seconds{10}));
+}
+
+#endif
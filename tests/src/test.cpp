@@ -216,4 +216,39 @@ TEST(Process, WithoutDieWithParent)
     EXPECT_TRUE(is_pid_process_working(childPid));
 
     kill_pid(childPid);
-}
\ No newline at end of file
+}
+
+#ifndef ULIB_PROCESS_WINDOWS
+
+TEST(Process, WaitResult)
+{
+    ulib::process proc(u8"return5");
+    auto &res = proc.wait_for_result();
+
+    ASSERT_EQ(res.exit_code, 5);
+    ASSERT_FALSE(res.signal.has_value());
+    ASSERT_FALSE(res.succeeded());
+    ASSERT_GT(res.max_rss_bytes, 0u);
+    ASSERT_GT(res.wall_time().count(), 0);
+    ASSERT_EQ(proc.wait(), 5);
+    ASSERT_EQ(proc.check(), 5);
+}
+
+TEST(Process, WaitResultSignal)
+{
+    ulib::process proc(u8"sleeper");
+    ASSERT_FALSE(proc.wait(std::chrono::milliseconds{50}).has_value());
+    ASSERT_TRUE(proc.is_running());
+
+    proc.terminate();
+    ASSERT_EQ(proc.wait(), 128 + SIGKILL);
+    ASSERT_FALSE(proc.is_running());
+
+    auto res = proc.result();
+    ASSERT_TRUE(res.has_value());
+    ASSERT_EQ(res->signal, SIGKILL);
+    ASSERT_FALSE(res->exit_code.has_value());
+    ASSERT_GE(res->wall_time(), std::chrono::milliseconds{50});
+}
+
+#endif
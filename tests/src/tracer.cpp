@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+#include <ulib/process_tracer.h>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace
+{
+    std::optional<ulib::trace_event> find_event(int pid, ulib::trace_event_type type)
+    {
+        for (auto &ev : ulib::process_tracer::events())
+        {
+            if (ev.pid == pid && ev.type == type)
+                return ev;
+        }
+
+        return std::nullopt;
+    }
+} // namespace
+
+TEST(Tracer, RecordsLifecycle)
+{
+    ulib::process_tracer::start();
+
+    ulib::process proc(u8"errout", ulib::process::pipe_stdout | ulib::process::pipe_stderr);
+    proc.out().read_all();
+    proc.err().read_all();
+    proc.wait();
+
+    ASSERT_THROW(ulib::process(u8"no-such-binary-ulib-process"), ulib::process_file_not_found_error);
+
+    ulib::process_tracer::stop();
+    ASSERT_FALSE(ulib::process_tracer::is_active());
+
+    ulib::list<ulib::trace_event_type> types;
+    for (auto &ev : ulib::process_tracer::events())
+    {
+        if (ev.pid == proc.pid())
+            types.push_back(ev.type);
+    }
+
+    using t = ulib::trace_event_type;
+    ASSERT_EQ(types.size(), 8u);
+    ASSERT_EQ(types[0], t::spawn);
+    ASSERT_EQ(types[1], t::exec);
+    // the exit is stamped as the pidfd fires, which may come before or after the pipes' eof
+    ASSERT_EQ(std::count(types.begin(), types.end(), t::exit), 1);
+    ASSERT_EQ(types[7], t::reap);
+
+    auto events = ulib::process_tracer::events();
+    ASSERT_EQ(std::count_if(events.begin(), events.end(),
+                            [](const ulib::trace_event &ev) { return ev.type == t::spawn_failed; }),
+              1);
+
+    std::string json = ulib::process_tracer::chrome_json().c_str();
+    ASSERT_EQ(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0), 0u);
+    ASSERT_NE(json.find("\"name\":\"errout ["), std::string::npos);
+    ASSERT_NE(json.find("\"name\":\"first byte stdout\""), std::string::npos);
+    ASSERT_NE(json.find("\"name\":\"eof stderr\""), std::string::npos);
+    ASSERT_NE(json.find("\"name\":\"spawn failed\""), std::string::npos);
+}
+
+TEST(Tracer, RingKeepsNewest)
+{
+    ulib::process_tracer::start(4);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ulib::process proc(u8"return5");
+        proc.wait();
+    }
+
+    ulib::process_tracer::stop();
+
+    auto events = ulib::process_tracer::events();
+    ASSERT_EQ(events.size(), 4u);
+    ASSERT_EQ(events.back().type, ulib::trace_event_type::reap);
+}
+
+TEST(Tracer, ReaperLagIsVisible)
+{
+    ulib::process_tracer::start();
+
+    ulib::process proc(u8"return5");
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    proc.wait();
+
+    ulib::process_tracer::stop();
+
+    auto exit = find_event(proc.pid(), ulib::trace_event_type::exit);
+    auto reap = find_event(proc.pid(), ulib::trace_event_type::reap);
+    ASSERT_TRUE(exit && reap);
+    ASSERT_LE(exit->time_ns, reap->time_ns);
+
+    // without a pidfd the exit can only be stamped when it is reaped
+    if (proc.pidfd() != -1)
+    {
+        ASSERT_GE(reap->time_ns - exit->time_ns, 50000000u);
+    }
+}
+
+TEST(Tracer, DetachedChildIsTraced)
+{
+    ulib::process_tracer::start();
+
+    ulib::process proc(u8"return5");
+    int pid = proc.pid();
+    proc.detach();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (!find_event(pid, ulib::trace_event_type::reap) && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+
+    ulib::process_tracer::stop();
+
+    ASSERT_TRUE(find_event(pid, ulib::trace_event_type::exit));
+    ASSERT_TRUE(find_event(pid, ulib::trace_event_type::reap));
+}
+
+TEST(Tracer, RestartsDoNotGrow)
+{
+    ulib::process_tracer::start(4096);
+    ulib::process_tracer::stop();
+    size_t one = ulib::process_tracer::memory_usage();
+    ASSERT_GT(one, 0u);
+
+    // the same capacity reuses the ring, and only what was recorded since the restart is reported
+    for (int i = 0; i < 100; i++)
+    {
+        ulib::process_tracer::start(4096);
+        ulib::process_tracer::stop();
+    }
+    ASSERT_EQ(ulib::process_tracer::memory_usage(), one);
+
+    ulib::process_tracer::start(4096);
+    ulib::process proc(u8"return5");
+    int pid = proc.pid();
+    proc.wait();
+    ASSERT_TRUE(find_event(pid, ulib::trace_event_type::spawn));
+    ulib::process_tracer::start(4096);
+    ASSERT_FALSE(find_event(pid, ulib::trace_event_type::spawn));
+    ulib::process_tracer::stop();
+
+    // a replaced ring goes once no hook holds it
+    for (int i = 0; i < 100; i++)
+    {
+        ulib::process_tracer::start(1024);
+        ulib::process_tracer::stop();
+        ulib::process_tracer::start(4096);
+        ulib::process_tracer::stop();
+    }
+    ASSERT_LE(ulib::process_tracer::memory_usage(), 2 * one);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <ulib/process_tree.h>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <csignal>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+    size_t open_fds()
+    {
+        size_t count = 0;
+        for (auto &entry : std::filesystem::directory_iterator{"/proc/self/fd"})
+        {
+            (void)entry;
+            count++;
+        }
+
+        return count;
+    }
+} // namespace
+
+TEST(ProcessTree, ContainsSelf)
+{
+    ulib::process_tree tree;
+    tree.refresh();
+
+    auto self = tree.find(getpid());
+    ASSERT_NE(self, nullptr);
+    ASSERT_EQ(self->ppid, getppid());
+    ASSERT_GT(tree.size(), 1u);
+
+    auto siblings = tree.children(getppid());
+    ASSERT_NE(std::find(siblings.begin(), siblings.end(), getpid()), siblings.end());
+}
+
+TEST(ProcessTree, FindsDescendants)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"./sleeper & ./sleeper & wait"});
+    ulib::process_tree tree;
+
+    size_t found = 0;
+    for (int i = 0; i < 200 && found < 2; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        tree.refresh();
+        found = tree.descendants(proc.pid()).size();
+    }
+
+    auto descendants = tree.descendants(proc.pid());
+    ASSERT_EQ(descendants.size(), 2u);
+    for (int pid : descendants)
+        ASSERT_EQ(tree.find(pid)->ppid, proc.pid());
+
+    for (int pid : descendants)
+        kill(pid, SIGKILL);
+    ASSERT_EQ(proc.wait(), 0); // a bare `wait` in sh returns 0 once both are gone
+}
+
+TEST(ProcessTree, RefreshDropsExited)
+{
+    ulib::process_tree tree;
+    ulib::process proc(u8"sleeper");
+
+    tree.refresh();
+    ASSERT_TRUE(tree.contains(proc.pid()));
+    ASSERT_EQ(tree.find(proc.pid())->ppid, getpid());
+
+    proc.terminate();
+    for (int i = 0; i < 200 && tree.find(proc.pid())->state != 'Z'; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        tree.refresh();
+    }
+    ASSERT_EQ(tree.find(proc.pid())->state, 'Z');
+
+    proc.wait();
+    tree.refresh();
+    ASSERT_FALSE(tree.contains(proc.pid()));
+}
+
+TEST(ProcessTree, KeepsBoundedDescriptors)
+{
+    std::vector<ulib::process> procs;
+    for (size_t i = 0; i < ulib::process_tree::max_kept_fds + 32; i++)
+        procs.emplace_back(u8"sleeper");
+
+    size_t before = open_fds();
+
+    ulib::process_tree tree;
+    tree.refresh();
+    tree.refresh();
+
+    // the /proc directory fd, the kept stat fds and nothing per process beyond them
+    ASSERT_LE(open_fds(), before + ulib::process_tree::max_kept_fds + 1);
+    for (auto &proc : procs)
+        ASSERT_TRUE(tree.contains(proc.pid()));
+}
+
+#endif
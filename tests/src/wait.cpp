@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <ulib/process_wait.h>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <vector>
+
+TEST(Wait, AnyReturnsFirstExit)
+{
+    std::vector<ulib::process> procs;
+    procs.emplace_back(u8"sleeper");
+    procs.emplace_back(u8"return5");
+    procs.emplace_back(u8"sleeper");
+
+    auto exited = ulib::wait_any(procs, std::chrono::seconds{5});
+    ASSERT_TRUE(exited.has_value());
+    ASSERT_EQ(exited->index, 1u);
+    ASSERT_EQ(exited->result.exit_code, 5);
+
+    // nothing else exits
+    ASSERT_FALSE(ulib::wait_any(procs, std::chrono::milliseconds{50}).has_value());
+
+    procs[2].terminate();
+    exited = ulib::wait_any(procs, std::chrono::seconds{5});
+    ASSERT_TRUE(exited.has_value());
+    ASSERT_EQ(exited->index, 2u);
+    ASSERT_EQ(exited->result.signal, SIGKILL);
+
+    procs[0].terminate();
+    ASSERT_EQ(ulib::wait_any(procs)->index, 0u);
+    ASSERT_FALSE(ulib::wait_any(procs).has_value());
+}
+
+TEST(Wait, AllReapsEveryProcess)
+{
+    std::vector<ulib::process> procs;
+    for (int i = 0; i < 50; i++)
+        procs.emplace_back(u8"return5");
+
+    procs.emplace_back(u8"sleeper");
+    ASSERT_FALSE(ulib::wait_all(procs, std::chrono::milliseconds{100}));
+
+    procs.back().terminate();
+    ASSERT_TRUE(ulib::wait_all(procs, std::chrono::seconds{5}));
+
+    for (size_t i = 0; i + 1 < procs.size(); i++)
+        ASSERT_EQ(procs[i].result()->exit_code, 5);
+}
+
+TEST(Wait, WorksWithExitWatch)
+{
+    std::vector<ulib::process> procs;
+    procs.emplace_back(u8"return5");
+    procs.emplace_back(u8"sleeper");
+    procs[0].on_exit([](int, int) {});
+
+    auto exited = ulib::wait_any(procs, std::chrono::seconds{5});
+    ASSERT_TRUE(exited.has_value());
+    ASSERT_EQ(exited->index, 0u);
+    ASSERT_FALSE(ulib::wait_any(procs, std::chrono::milliseconds{50}).has_value());
+}
+
+TEST(Wait, WaiterHandsOutEachOnce)
+{
+    std::vector<ulib::process> procs;
+    for (int i = 0; i < 20; i++)
+        procs.emplace_back(u8"return5");
+
+    ulib::process_waiter waiter{procs};
+    ASSERT_EQ(waiter.remaining(), 20u);
+
+    std::vector<bool> seen(procs.size());
+    while (auto exited = waiter.next(std::chrono::seconds{5}))
+    {
+        ASSERT_FALSE(seen[exited->index]);
+        seen[exited->index] = true;
+        ASSERT_EQ(exited->result.exit_code, 5);
+    }
+
+    ASSERT_EQ(waiter.remaining(), 0u);
+    ASSERT_EQ(std::count(seen.begin(), seen.end(), true), 20);
+}
+
+TEST(Wait, WaiterSkipsReapedElsewhere)
+{
+    std::vector<ulib::process> procs;
+    procs.emplace_back(u8"return5");
+    procs.emplace_back(u8"return5");
+    procs.emplace_back(u8"sleeper");
+
+    ulib::process_waiter waiter{procs};
+    ASSERT_EQ(procs[1].wait(), 5);
+
+    auto exited = waiter.next(std::chrono::seconds{5});
+    ASSERT_TRUE(exited.has_value());
+    ASSERT_EQ(exited->index, 0u);
+
+    ASSERT_FALSE(waiter.next(std::chrono::milliseconds{50}).has_value());
+    ASSERT_EQ(waiter.remaining(), 1u);
+
+    procs[2].terminate();
+    ASSERT_TRUE(waiter.wait_all(std::chrono::seconds{5}));
+    ASSERT_EQ(procs[2].result()->signal, SIGKILL);
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <ulib/process.h>
+#include <ulib/process_writer.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST(Writer, WriteAll)
+{
+    ulib::process proc("./retinput", {}, ulib::process::pipe_stdin);
+    proc.in().write_all("42\n");
+    proc.in().close();
+    ASSERT_EQ(proc.wait(), 42);
+}
+
+TEST(Writer, CloseAfterFlush)
+{
+    ulib::process proc("./retinput", {}, ulib::process::pipe_stdin);
+    {
+        ulib::buffered_writer writer{proc.in(), 16};
+        writer.write("1");
+        writer.write("7\n");
+        ASSERT_EQ(writer.buffered(), 3u);
+        writer.close_after_flush();
+        ASSERT_EQ(writer.buffered(), 0u);
+    }
+
+    ASSERT_FALSE(proc.in().is_open());
+    ASSERT_EQ(proc.wait(), 17);
+}
+
+#ifdef __linux__
+TEST(Writer, CoalescesRecords)
+{
+    ulib::process proc("/bin/sh", {u8"-c", u8"wc -lc"}, ulib::process::pipe_stdin | ulib::process::pipe_stdout);
+
+    ulib::process_metrics::enable();
+    auto before = ulib::process_metrics::snapshot();
+
+    size_t lines = 0, bytes = 0;
+    {
+        ulib::buffered_writer writer{proc.in(), 4096};
+        for (int i = 0; i < 20000; i++)
+        {
+            std::string record = "record " + std::to_string(i);
+            ulib::string_view parts[] = {ulib::string_view{record.data(), record.size()}, "\n"};
+            writer.write(parts);
+            lines++;
+            bytes += record.size() + 1;
+        }
+
+        // larger than the buffer, goes out directly behind the buffered bytes
+        std::string big(100000, 'x');
+        big.back() = '\n';
+        writer.write(big.data(), big.size());
+        lines++;
+        bytes += big.size();
+
+        writer.close_after_flush();
+    }
+
+    auto after = ulib::process_metrics::snapshot();
+    ulib::process_metrics::enable(false);
+    if (ulib::process_metrics::available)
+    {
+        ASSERT_LT(after.write_calls - before.write_calls, 100u);
+    }
+
+    auto out = proc.out().read_all();
+    ASSERT_EQ(proc.wait(), 0);
+
+    std::istringstream stream{std::string{out.data(), out.size()}};
+    size_t gotLines = 0, gotBytes = 0;
+    stream >> gotLines >> gotBytes;
+    ASSERT_EQ(gotLines, lines);
+    ASSERT_EQ(gotBytes, bytes);
+}
+
+TEST(Writer, ChildGoneThrows)
+{
+    std::string data(1 << 20, 'x');
+
+    // the child never reads and has exited, writes must throw rather than raise SIGPIPE
+    ulib::process proc(u8"return5", ulib::process::pipe_stdin);
+    ASSERT_EQ(proc.wait(), 5);
+
+    ASSERT_THROW(proc.in().write_all(data.data(), data.size()), ulib::process_internal_error);
+    {
+        ulib::buffered_writer writer{proc.in(), 16};
+        ASSERT_THROW(writer.write(data.data(), data.size()), ulib::process_internal_error);
+        writer.write("dropped"); // the destructor flush fails quietly
+    }
+
+    ulib::spawn_options options;
+    options.stdio_sockets = ulib::socket_kind::stream;
+    ulib::process sock(u8"return5", {}, ulib::process::pipe_stdin, std::nullopt, options);
+    ASSERT_EQ(sock.wait(), 5);
+
+    ASSERT_TRUE(sock.in().is_socket());
+    ASSERT_THROW(sock.in().write_all(data.data(), data.size()), ulib::process_internal_error);
+    {
+        ulib::buffered_writer writer{sock.in(), 16};
+        ASSERT_THROW(writer.write(data.data(), data.size()), ulib::process_internal_error);
+    }
+}
+#endif
@@ -7,8 +7,18 @@
 #include <filesystem>
 #include <optional>
 #include <signal.h>
+#include <utility>
+#include <vector>
 
+#include "../../process_capture.h"
+#include "../../process_cmd.h"
 #include "../../process_exceptions.h"
+#include "../../process_metrics.h"
+#include "process_memfd.h"
+#include "process_options.h"
+#include "process_placement.h"
+#include "process_result.h"
+#include "process_reaper.h"
 
 namespace ulib
 {
@@ -24,36 +34,82 @@ namespace ulib
             pipe_output = 8,
             die_with_parent = 16,
             create_new_console = 32,
+            new_process_group = 64, // setpgid(0, 0) in the child, signals from terminate() go to the whole group
+            new_session = 128,       // setsid() in the child, also a new process group without a controlling tty
+            pty = 256, // stdio on a new pseudo-terminal that becomes the controlling tty of a new session, see
+                       // spawn_options::pty_size; in() and out() are the master side, pipe_stderr keeps stderr apart
+            capture_stdout = 512, // stdout goes straight into an in-memory file, see captured_stdout()
         };
 
         class bpipe
         {
         public:
-            bpipe() { mHandle = 0; }
-            bpipe(int handle) : mHandle(handle) {}
+            bpipe()
+            {
+                mHandle = 0;
+                mStream = process_stream::in;
+                mNonblocking = false;
+                mOwner = 0;
+                mSeenData = false;
+                mSeenEof = false;
+                mSocket = false;
+            }
+            bpipe(int handle, process_stream stream, int owner = 0)
+                : mHandle(handle), mStream(stream), mNonblocking(false), mOwner(owner), mSeenData(false),
+                  mSeenEof(false), mSocket(false)
+            {
+            }
             bpipe(const bpipe &) = delete;
             bpipe(bpipe &&other)
             {
                 mHandle = other.mHandle;
+                mStream = other.mStream;
+                mNonblocking = other.mNonblocking;
+                mOwner = other.mOwner;
+                mSeenData = other.mSeenData;
+                mSeenEof = other.mSeenEof;
+                mSocket = other.mSocket;
                 other.mHandle = 0;
             }
             ~bpipe();
 
             bpipe &operator=(bpipe &&other);
 
-            // inline void *native_handle() { return mHandle; }
+            inline int native_handle() { return mHandle; }
             inline bool is_open() { return mHandle != 0; }
             void close();
 
+            // O_NONBLOCK on our end: plain read()/write() then return -1 with EAGAIN instead of waiting, and
+            // try_read()/try_write() save the readiness poll
+            void set_nonblocking(bool enable = true);
+            inline bool is_nonblocking() { return mNonblocking; }
+
+            // one end of a spawn_options::stdio_sockets socketpair rather than a pipe
+            inline bool is_socket() { return mSocket; }
+
         protected:
+            friend class process;
+
             int mHandle;
+            process_stream mStream; // for process_metrics byte counters
+            bool mNonblocking;
+
+            // for process_tracer first byte and eof events
+            int mOwner;
+            bool mSeenData;
+            bool mSeenEof;
+
+            bool mSocket;
         };
 
         class rpipe : public bpipe
         {
         public:
             rpipe() : bpipe() {}
-            rpipe(int handle) : bpipe(handle) {}
+            rpipe(int handle, process_stream stream = process_stream::out, int owner = 0)
+                : bpipe(handle, stream, owner)
+            {
+            }
             rpipe(rpipe &&other) : bpipe(std::move(other)) {}
             ~rpipe() {}
 
@@ -66,6 +122,18 @@ namespace ulib
             size_t read(void *buf, size_t size);
             ulib::string read_all();
 
+            // never blocks: nullopt when no data is available yet, 0 at eof
+            std::optional<size_t> try_read(void *buf, size_t size);
+
+            // waits for data until deadline, nullopt if the deadline passed first
+            std::optional<size_t> read(void *buf, size_t size, std::chrono::steady_clock::time_point deadline);
+
+            // true once read() would not block (data or eof), waiting at most timeout
+            bool readable(std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+            // reads until eof keeping only the first head_limit and last tail_limit bytes
+            bounded_capture read_bounded(size_t head_limit, size_t tail_limit);
+
             char getchar();
             ulib::string getline();
 
@@ -76,7 +144,7 @@ namespace ulib
         {
         public:
             wpipe() : bpipe() {}
-            wpipe(int handle) : bpipe(handle) {}
+            wpipe(int handle) : bpipe(handle, process_stream::in) {}
             wpipe(wpipe &&other) : bpipe(std::move(other)) {}
             ~wpipe() {}
 
@@ -86,17 +154,46 @@ namespace ulib
                 return *this;
             }
 
+            // a reader that is gone gives -1 with EPIPE, never SIGPIPE, so try_write() and the deadline write throw
             size_t write(const void *buf, size_t size);
             size_t write(ulib::string_view str);
 
+            // loops over partial writes (and EINTR) until every byte is written, throws if the pipe breaks; the
+            // reader being gone is that error too, SIGPIPE is blocked meanwhile
+            void write_all(const void *buf, size_t size);
+            void write_all(ulib::string_view str) { this->write_all(str.data(), str.size()); }
+
+            // never blocks: nullopt when the pipe is full, otherwise the bytes written (possibly fewer than size)
+            std::optional<size_t> try_write(const void *buf, size_t size);
+
+            // writes until everything is written or deadline passes, returns the bytes written
+            size_t write(const void *buf, size_t size, std::chrono::steady_clock::time_point deadline);
+
+            // true once write() would accept at least PIPE_BUF bytes without blocking, waiting at most timeout
+            bool writable(std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
         private:
+            // one write(2), or send(MSG_NOSIGNAL) on a socket; pipes need a detail::sigpipe_guard around it
+            ssize_t write_once(const void *buf, size_t size);
         };
 
         process();
         process(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags = noflags,
-                std::optional<std::filesystem::path> workingDirectory = std::nullopt);
+                std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                const spawn_options &options = {});
+        // Splits line with the operator""_cmd grammar: whitespace separates words, '...' is literal, "..." takes \"
+        // and \\ escapes, and outside quotes a backslash escapes the next character. Lines that used to pass
+        // backslashes through verbatim (a\b) now lose them, quote them as 'a\b' instead. Unterminated quotes or a
+        // trailing backslash throw process_invalid_options_error.
         process(ulib::u8string_view line, uint32 flags = noflags,
-                std::optional<std::filesystem::path> workingDirectory = std::nullopt);
+                std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                const spawn_options &options = {});
+        process(const command_line &cmd, uint32 flags = noflags,
+                std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                const spawn_options &options = {});
+        process(const memfd_executable &exe, const ulib::list<ulib::u8string> &args, uint32 flags = noflags,
+                std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                const spawn_options &options = {});
         process(const process &) = delete;
         process(process &&other);
         ~process();
@@ -104,41 +201,110 @@ namespace ulib
         process &operator=(process &&other);
 
         void run(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags = noflags,
-                 std::optional<std::filesystem::path> workingDirectory = std::nullopt);
+                 std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                 const spawn_options &options = {});
+        // same grammar as process(line)
         void run(ulib::u8string_view line, uint32 flags = noflags,
-                 std::optional<std::filesystem::path> workingDirectory = std::nullopt);
+                 std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                 const spawn_options &options = {});
+        void run(const command_line &cmd, uint32 flags = noflags,
+                 std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                 const spawn_options &options = {});
+        void run(const memfd_executable &exe, const ulib::list<ulib::u8string> &args, uint32 flags = noflags,
+                 std::optional<std::filesystem::path> workingDirectory = std::nullopt,
+                 const spawn_options &options = {});
 
         std::optional<int> wait(std::chrono::milliseconds ms);
         int wait();
 
+        const wait_result &wait_for_result();
+        std::optional<wait_result> check_result();
+        inline const std::optional<wait_result> &result() const { return mResult; }
+
         bool is_running();
         bool is_finished();
-        void detach();
+        void detach(); // the child keeps running and is reaped in the background by process_reaper
         void terminate();
 
+        // SIGTERM to the child (its whole group with new_process_group/new_session/pty), then SIGKILL once the
+        // child has not exited within grace. Group members still alive when the leader exits are killed too.
+        // Reaps the child and returns its exit code like wait().
+        int terminate(std::chrono::milliseconds grace);
+
         std::optional<int> check();
+
+        // Called once with the pid and wait() code when the child exits: on the reaper thread, or in the thread
+        // that reaps the child first. Replaces an earlier callback; dropped when the object is destroyed or moved
+        // from before the exit, kept across detach().
+        void on_exit(process_reaper::callback callback);
+
         inline bool is_bound() { return mHandle != 0; }
         inline int pid() { return mHandle; }
+        inline int pidfd() { return mPidfd; } // -1 when pidfd_open(2) is not available
 
         inline wpipe &in() { return mInPipe; }
         inline rpipe &out() { return mOutPipe; }
         inline rpipe &err() { return mErrPipe; }
+        inline unix_channel &channel() { return mChannel; } // see spawn_options::channel
+
+        // TIOCSWINSZ on the pty, the child gets SIGWINCH
+        void resize_terminal(uint32 rows, uint32 cols);
+
+        // our ends of the pipes created by fd_mapping::input and fd_mapping::output, by child descriptor
+        wpipe &input(int child_fd);
+        rpipe &output(int child_fd);
+
+        // Reads stdout and stderr through one poller until both reach eof, keeping each chunk with its stream and
+        // the time it was read. Needs pipe_stdout and/or pipe_stderr; pipe_output already merges them untagged.
+        stream_log read_merged();
+
+        // Maps what the child has written to stdout so far, read-only and without copying: call it after wait()
+        // for the whole output. Needs the capture_stdout flag; the view outlives the process object.
+        mapped_output captured_stdout();
 
     private:
-        void run(const char *path, char **argv, const char* workingDirectory, uint32 flags);
+        // execFd, when set, is executed instead of path, which then only names the child
+        void run(const char *path, char **argv, const char *workingDirectory, uint32 flags,
+                 const spawn_options &options, int execFd = -1);
+        bool reap(bool block);
+        bool wait_exit(std::chrono::milliseconds timeout);
+        int send_signal(int sig);
         void destroy_pipes();
         void destroy_handles();
         void finish();
         void move_init(process&& other);
+        // Drops the watch that traces the exit as the pidfd fires. True if the exit was traced through it; with
+        // traceNow a pending one is traced right away.
+        bool release_trace_watch(bool traceNow);
+        // for a child handed to the reaper: cb followed by removing the dedicated cgroup, which only works once the
+        // child is gone
+        process_reaper::callback with_cgroup_removal(process_reaper::callback cb);
 
         int mHandle;
+        int mPidfd;
+        uint32 mFlags;
+        process_reaper::watch_id mExitWatch;
+        process_reaper::watch_id mTraceWatch; // only while tracing, see release_trace_watch()
 
         wpipe mInPipe;
         rpipe mOutPipe;
         rpipe mErrPipe;
+        unix_channel mChannel;
+        memory_capture mCapture;
+        std::vector<std::pair<int, wpipe>> mInputs;
+        std::vector<std::pair<int, rpipe>> mOutputs;
+
+        cgroup mCgroup;
+        std::chrono::steady_clock::time_point mStartTime;
+        detail::perf_session mPerf;
+        std::optional<wait_result> mResult;
 
         bool mWaited;
     };
+
+    // PR_SET_CHILD_SUBREAPER: orphaned descendants of our children are re-parented to this process instead of
+    // init, so they stay visible in process_tree and can be waited for. Returns false where unsupported.
+    bool set_child_subreaper(bool enable = true);
 } // namespace ulib
 
 #endif
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_cgroup.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <string>
+#include <ulib/format.h>
+
+namespace ulib
+{
+    namespace detail
+    {
+        std::optional<std::filesystem::path> cgroup2_mount_point()
+        {
+            // mountinfo: "<id> <parent> <dev> <root> <mount point> <options> ... - <fstype> <source> <options>"
+            std::ifstream file{"/proc/self/mountinfo"};
+            std::string line;
+            while (std::getline(file, line))
+            {
+                size_t sep = line.find(" - ");
+                if (sep == std::string::npos || line.compare(sep + 3, 8, "cgroup2 ") != 0)
+                    continue;
+
+                size_t pos = 0;
+                for (int i = 0; i < 4 && pos != std::string::npos; i++)
+                    pos = line.find(' ', pos + 1);
+                if (pos == std::string::npos)
+                    continue;
+
+                size_t end = line.find(' ', pos + 1);
+                return std::filesystem::path{line.substr(pos + 1, end - pos - 1)};
+            }
+
+            return std::nullopt;
+        }
+
+        bool cgroup_write(int dirfd, const char *name, ulib::string_view value)
+        {
+            int fd = ::openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+            if (fd == -1)
+                return false;
+
+            bool ok = ::write(fd, value.data(), value.size()) == ssize_t(value.size());
+            ::close(fd);
+            return ok;
+        }
+
+        std::optional<std::string> cgroup_read(int dirfd, const char *name)
+        {
+            int fd = ::openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                return std::nullopt;
+
+            std::string result;
+            char buf[512];
+            ssize_t rv;
+            while ((rv = ::read(fd, buf, sizeof(buf))) > 0)
+                result.append(buf, size_t(rv));
+
+            ::close(fd);
+            if (rv == -1)
+                return std::nullopt;
+
+            return result;
+        }
+    } // namespace detail
+
+    cgroup::cgroup()
+    {
+        mFd = -1;
+        mProcsFd = -1;
+        mCreated = false;
+        mLimitsApplied = true;
+    }
+
+    cgroup::cgroup(ulib::u8string_view name, const cgroup_limits &limits)
+        : cgroup(self_path().value_or(std::filesystem::path{}), name, limits)
+    {
+    }
+
+    cgroup::cgroup(const std::filesystem::path &parent, ulib::u8string_view name, const cgroup_limits &limits)
+        : cgroup()
+    {
+#ifdef __linux__
+        if (parent.empty())
+            return;
+
+        mPath = parent / std::u8string_view{(const char8_t *)name.data(), name.size()};
+        if (::mkdir(mPath.c_str(), 0755) == 0)
+            mCreated = true;
+        else if (errno != EEXIST)
+            return;
+
+        mFd = ::open(mPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mFd == -1)
+        {
+            this->close();
+            return;
+        }
+
+        mProcsFd = ::openat(mFd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+
+        if (!limits.empty())
+        {
+            // controllers are only available to a child once the parent delegates them, which fails
+            // when the parent itself holds processes; limits then stay unapplied, see limits_applied()
+            int parentFd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (parentFd != -1)
+            {
+                if (limits.cpu_quota_us)
+                    detail::cgroup_write(parentFd, "cgroup.subtree_control", "+cpu");
+                if (limits.memory_max || limits.memory_high)
+                    detail::cgroup_write(parentFd, "cgroup.subtree_control", "+memory");
+                if (limits.pids_max)
+                    detail::cgroup_write(parentFd, "cgroup.subtree_control", "+pids");
+                ::close(parentFd);
+            }
+
+            mLimitsApplied = this->set_limits(limits);
+        }
+#endif
+    }
+
+    cgroup::cgroup(cgroup &&other) { this->move_init(std::move(other)); }
+
+    cgroup::~cgroup() { this->close(); }
+
+    cgroup &cgroup::operator=(cgroup &&other)
+    {
+        this->close();
+        this->move_init(std::move(other));
+        return *this;
+    }
+
+    std::optional<std::filesystem::path> cgroup::self_path()
+    {
+#ifdef __linux__
+        static const std::optional<std::filesystem::path> cached = []() -> std::optional<std::filesystem::path> {
+            auto mount = detail::cgroup2_mount_point();
+            if (!mount)
+                return std::nullopt;
+
+            // the unified hierarchy entry is "0::<path>"
+            std::ifstream file{"/proc/self/cgroup"};
+            std::string line;
+            while (std::getline(file, line))
+            {
+                if (line.rfind("0::", 0) == 0)
+                    return *mount / std::filesystem::path{line.substr(3)}.relative_path();
+            }
+
+            return std::nullopt;
+        }();
+
+        return cached;
+#else
+        return std::nullopt;
+#endif
+    }
+
+    bool cgroup::set_limits(const cgroup_limits &limits)
+    {
+        if (!is_available())
+            return false;
+
+        bool ok = true;
+        if (limits.cpu_quota_us)
+            ok &= detail::cgroup_write(mFd, "cpu.max", ulib::format("{} {}", *limits.cpu_quota_us, limits.cpu_period_us));
+        if (limits.memory_max)
+            ok &= detail::cgroup_write(mFd, "memory.max", ulib::format("{}", *limits.memory_max));
+        if (limits.memory_high)
+            ok &= detail::cgroup_write(mFd, "memory.high", ulib::format("{}", *limits.memory_high));
+        if (limits.pids_max)
+            ok &= detail::cgroup_write(mFd, "pids.max", ulib::format("{}", *limits.pids_max));
+
+        return ok;
+    }
+
+    std::optional<cgroup_stats> cgroup::stats() const
+    {
+        if (!is_available())
+            return std::nullopt;
+
+        auto cpu = detail::cgroup_read(mFd, "cpu.stat");
+        if (!cpu)
+            return std::nullopt;
+
+        cgroup_stats result;
+        struct
+        {
+            const char *key;
+            uint64 *value;
+        } fields[] = {
+            {"usage_usec", &result.usage_usec},         {"user_usec", &result.user_usec},
+            {"system_usec", &result.system_usec},       {"nr_periods", &result.nr_periods},
+            {"nr_throttled", &result.nr_throttled},     {"throttled_usec", &result.throttled_usec},
+        };
+
+        size_t pos = 0;
+        while (pos < cpu->size())
+        {
+            size_t end = cpu->find('\n', pos);
+            if (end == std::string::npos)
+                end = cpu->size();
+
+            size_t space = cpu->find(' ', pos);
+            if (space != std::string::npos && space < end)
+            {
+                for (auto &field : fields)
+                {
+                    if (cpu->compare(pos, space - pos, field.key) == 0)
+                        *field.value = std::strtoull(cpu->c_str() + space + 1, nullptr, 10);
+                }
+            }
+
+            pos = end + 1;
+        }
+
+        if (auto peak = detail::cgroup_read(mFd, "memory.peak"))
+            result.memory_peak = std::strtoull(peak->c_str(), nullptr, 10);
+
+        return result;
+    }
+
+    void cgroup::close()
+    {
+        if (mProcsFd != -1)
+        {
+            ::close(mProcsFd);
+            mProcsFd = -1;
+        }
+
+        if (mFd != -1)
+        {
+            ::close(mFd);
+            mFd = -1;
+        }
+
+        // only succeeds once every process has left; a busy group is left for the caller to clean up
+        if (mCreated)
+        {
+            ::rmdir(mPath.c_str());
+            mCreated = false;
+        }
+    }
+
+    void cgroup::move_init(cgroup &&other)
+    {
+        mPath = std::move(other.mPath);
+        mFd = other.mFd;
+        mProcsFd = other.mProcsFd;
+        mCreated = other.mCreated;
+        mLimitsApplied = other.mLimitsApplied;
+
+        other.mFd = -1;
+        other.mProcsFd = -1;
+        other.mCreated = false;
+    }
+} // namespace ulib
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <filesystem>
+#include <optional>
+
+namespace ulib
+{
+    struct cgroup_limits
+    {
+        std::optional<uint64> cpu_quota_us; // cpu.max, quota per cpu_period_us
+        uint64 cpu_period_us = 100000;
+        std::optional<uint64> memory_max;  // bytes
+        std::optional<uint64> memory_high; // bytes
+        std::optional<uint64> pids_max;
+
+        inline bool empty() const { return !cpu_quota_us && !memory_max && !memory_high && !pids_max; }
+    };
+
+    struct cgroup_stats
+    {
+        uint64 usage_usec = 0;
+        uint64 user_usec = 0;
+        uint64 system_usec = 0;
+        uint64 nr_periods = 0;
+        uint64 nr_throttled = 0;
+        uint64 throttled_usec = 0;
+        std::optional<uint64> memory_peak; // needs memory controller and linux 5.19+
+    };
+
+    // A cgroup v2 directory that children can be placed into. Never throws when cgroups are not usable
+    // (no cgroup2 mount, no delegation, not linux): the object is simply not available and spawns ignore it.
+    // Limits passed to the constructor may fail on their own, see limits_applied().
+    class cgroup
+    {
+    public:
+        cgroup();
+        cgroup(ulib::u8string_view name, const cgroup_limits &limits = {});
+        cgroup(const std::filesystem::path &parent, ulib::u8string_view name, const cgroup_limits &limits = {});
+        cgroup(const cgroup &) = delete;
+        cgroup(cgroup &&other);
+        ~cgroup();
+
+        cgroup &operator=(cgroup &&other);
+
+        // the cgroup this process belongs to, the default parent for new groups
+        static std::optional<std::filesystem::path> self_path();
+
+        inline bool is_available() const { return mFd != -1; }
+
+        // false when the constructor's limits were not all written, typically because the parent holds
+        // processes itself and so cannot hand its controllers down (cgroup v2 no-internal-process rule)
+        inline bool limits_applied() const { return is_available() && mLimitsApplied; }
+        inline const std::filesystem::path &path() const { return mPath; }
+        inline int native_handle() const { return mFd; }
+        inline int procs_handle() const { return mProcsFd; }
+
+        // returns false if any limit could not be applied (e.g. the controller is not enabled)
+        bool set_limits(const cgroup_limits &limits);
+        std::optional<cgroup_stats> stats() const;
+
+        void close();
+
+    private:
+        void move_init(cgroup &&other);
+
+        std::filesystem::path mPath;
+        int mFd;
+        int mProcsFd;
+        bool mCreated;
+        bool mLimitsApplied;
+    };
+} // namespace ulib
+
+#endif
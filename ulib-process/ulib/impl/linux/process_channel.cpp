@@ -0,0 +1,212 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_channel.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+#include <ulib/format.h>
+
+#include "../../process_exceptions.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+        // the kernel limit per message (SCM_MAX_FD)
+        constexpr size_t max_passed_fds = 253;
+
+        void set_cloexec(int fd)
+        {
+            if (::fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+                throw process_internal_error{"fcntl failed"};
+        }
+    } // namespace detail
+
+    size_t send_fds(int socket, const void *data, size_t size, std::span<const int> fds)
+    {
+        if (fds.size() > detail::max_passed_fds)
+            throw process_invalid_options_error{
+                ulib::format("at most {} descriptors can be sent at once", detail::max_passed_fds)};
+
+        if (fds.size() && !size)
+            throw process_invalid_options_error{"descriptors must be sent with at least one byte of data"};
+
+        struct iovec iov = {const_cast<void *>(data), size};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * detail::max_passed_fds)];
+        if (fds.size())
+        {
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+        }
+
+#ifdef MSG_NOSIGNAL
+        int sendFlags = MSG_NOSIGNAL; // a gone child is an error, not SIGPIPE
+#else
+        int sendFlags = 0;
+#endif
+
+        while (true)
+        {
+            ssize_t rv = ::sendmsg(socket, &msg, sendFlags);
+            if (rv == -1 && errno == EINTR)
+                continue;
+
+            if (rv == -1)
+                throw process_internal_error{ulib::format("sendmsg failed: {}", std::strerror(errno))};
+
+            return size_t(rv);
+        }
+    }
+
+    size_t receive_fds(int socket, void *buf, size_t size, ulib::list<int> &fds)
+    {
+        struct iovec iov = {buf, size};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * detail::max_passed_fds)];
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+#ifdef MSG_CMSG_CLOEXEC
+        int recvFlags = MSG_CMSG_CLOEXEC;
+#else
+        int recvFlags = 0;
+#endif
+
+        ssize_t rv;
+        do
+        {
+            rv = ::recvmsg(socket, &msg, recvFlags);
+        } while (rv == -1 && errno == EINTR);
+
+        if (rv == -1)
+            throw process_internal_error{ulib::format("recvmsg failed: {}", std::strerror(errno))};
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++)
+            {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+#ifndef MSG_CMSG_CLOEXEC
+                detail::set_cloexec(fd);
+#endif
+                fds.push_back(fd);
+            }
+        }
+
+        return size_t(rv);
+    }
+
+    unix_channel &unix_channel::operator=(unix_channel &&other)
+    {
+        close();
+
+        mHandle = other.mHandle;
+        other.mHandle = -1;
+
+        return *this;
+    }
+
+    std::pair<unix_channel, unix_channel> unix_channel::pair(socket_kind kind)
+    {
+        int fds[2];
+#ifdef SOCK_CLOEXEC
+        if (::socketpair(AF_UNIX, int(kind) | SOCK_CLOEXEC, 0, fds) == -1)
+            throw process_internal_error{ulib::format("socketpair failed: {}", std::strerror(errno))};
+#else
+        if (::socketpair(AF_UNIX, int(kind), 0, fds) == -1)
+            throw process_internal_error{ulib::format("socketpair failed: {}", std::strerror(errno))};
+
+        detail::set_cloexec(fds[0]);
+        detail::set_cloexec(fds[1]);
+#endif
+
+        return {unix_channel{fds[0]}, unix_channel{fds[1]}};
+    }
+
+    void unix_channel::close()
+    {
+        if (mHandle != -1)
+        {
+            ::close(mHandle);
+            mHandle = -1;
+        }
+    }
+
+    int unix_channel::release()
+    {
+        int fd = mHandle;
+        mHandle = -1;
+        return fd;
+    }
+
+    size_t unix_channel::send(const void *data, size_t size, std::span<const int> fds)
+    {
+        return send_fds(mHandle, data, size, fds);
+    }
+
+    size_t unix_channel::receive(void *buf, size_t size)
+    {
+        ssize_t rv;
+        do
+        {
+            rv = ::recv(mHandle, buf, size, 0);
+        } while (rv == -1 && errno == EINTR);
+
+        if (rv == -1)
+            throw process_internal_error{ulib::format("recv failed: {}", std::strerror(errno))};
+
+        return size_t(rv);
+    }
+
+    size_t unix_channel::receive(void *buf, size_t size, ulib::list<int> &fds)
+    {
+        return receive_fds(mHandle, buf, size, fds);
+    }
+
+    void unix_channel::send_fd(int fd)
+    {
+        char byte = 0;
+        send_fds(mHandle, &byte, 1, {&fd, 1});
+    }
+
+    int unix_channel::receive_fd()
+    {
+        char byte;
+        ulib::list<int> fds;
+        if (!receive_fds(mHandle, &byte, 1, fds))
+            throw process_internal_error{"channel closed before a descriptor arrived"};
+
+        if (fds.size() == 0)
+            throw process_internal_error{"message carried no descriptor"};
+
+        // only one was expected, don't leak the rest
+        for (size_t i = 1; i < fds.size(); i++)
+            ::close(fds[i]);
+
+        return fds[0];
+    }
+} // namespace ulib
+
+#endif
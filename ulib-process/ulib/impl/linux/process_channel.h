@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <span>
+#include <utility>
+
+namespace ulib
+{
+    // AF_UNIX socket types for socketpair transports, values match SOCK_*
+    enum class socket_kind
+    {
+        stream = 1,    // SOCK_STREAM: a byte stream like a pipe, but bidirectional
+        seqpacket = 5, // SOCK_SEQPACKET: message boundaries are kept, each receive returns one send
+    };
+
+    // Sends data over an AF_UNIX socket along with open descriptors (SCM_RIGHTS). The receiver gets duplicates,
+    // so the sender may close its copies right away. Returns the bytes sent; at least one byte of data is
+    // needed to carry descriptors.
+    size_t send_fds(int socket, const void *data, size_t size, std::span<const int> fds = {});
+
+    // Receives data and appends any descriptors that came with it to fds, close-on-exec. Returns 0 at eof.
+    size_t receive_fds(int socket, void *buf, size_t size, ulib::list<int> &fds);
+
+    // Our end of an AF_UNIX socketpair connected to a child, see spawn_options::channel
+    class unix_channel
+    {
+    public:
+        unix_channel() : mHandle(-1) {}
+        explicit unix_channel(int handle) : mHandle(handle) {}
+        unix_channel(const unix_channel &) = delete;
+        unix_channel(unix_channel &&other) : mHandle(other.mHandle) { other.mHandle = -1; }
+        ~unix_channel() { close(); }
+
+        unix_channel &operator=(unix_channel &&other);
+
+        // a connected pair, both ends close-on-exec
+        static std::pair<unix_channel, unix_channel> pair(socket_kind kind = socket_kind::seqpacket);
+
+        inline int native_handle() { return mHandle; }
+        inline bool is_open() { return mHandle != -1; }
+        void close();
+        int release(); // gives up ownership of the descriptor
+
+        size_t send(const void *data, size_t size, std::span<const int> fds = {});
+        size_t send(ulib::string_view str, std::span<const int> fds = {}) { return send(str.data(), str.size(), fds); }
+        size_t receive(void *buf, size_t size);
+        size_t receive(void *buf, size_t size, ulib::list<int> &fds);
+
+        void send_fd(int fd);
+        int receive_fd(); // throws if the message carried no descriptor
+
+    private:
+        int mHandle;
+    };
+} // namespace ulib
+
+#endif
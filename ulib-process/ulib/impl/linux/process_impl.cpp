@@ -5,13 +5,32 @@
 
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <termios.h>
 #ifdef __linux__
 #include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <sched.h>
 #endif
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <fcntl.h>
 #include <ulib/format.h>
 
 #include "../../process_exceptions.h"
+#include "../metrics_hooks.h"
+#include "../trace_hooks.h"
+#include "process_sigpipe.h"
 
 extern char **environ;
 
@@ -21,45 +40,30 @@ namespace ulib
     {
         void MakeExecveArgs(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args) {}
 
-        ulib::list<ulib::u8string> cmdline_to_args(ulib::u8string_view line)
+        struct cmd_args_sink
         {
-            bool inQuotes = false;
-            ulib::u8string curr = line;
-            for (auto &ch : curr)
-            {
-                if (inQuotes)
-                {
-                    if (ch == '\"')
-                    {
-                        inQuotes = false;
-                        ch = 0;
-                    }
-                }
-                else
-                {
-                    if (ch == '\"')
-                    {
-                        inQuotes = true;
-                        ch = 0;
-                    }
-                    else if (ch == ' ')
-                    {
-                        ch = '\0';
-                    }
-                }
-            }
-
             using ChT = typename ulib::u8string_view::value_type;
 
-            ulib::list<ulib::u8string> result;
-            const char *delim = "\0";
-            auto spl = curr.split(ulib::u8string_view{(ChT *)delim, (ChT *)delim + 1});
-            for (auto word : spl)
+            ulib::list<ulib::u8string> words;
+            std::string word;
+
+            void begin() { word.clear(); }
+            void put(char ch) { word.push_back(ch); }
+            void end()
             {
-                result.push_back(word);
+                auto data = (const ChT *)word.data();
+                words.push_back(ulib::u8string_view{data, data + word.size()});
             }
+        };
+
+        // same grammar as operator""_cmd, see detail::cmd_scan
+        ulib::list<ulib::u8string> cmdline_to_args(ulib::u8string_view line)
+        {
+            cmd_args_sink sink;
+            if (const char *error = cmd_scan(line.data(), line.size(), sink))
+                throw process_invalid_options_error{error};
 
-            return result;
+            return std::move(sink.words);
         }
 
         ulib::u8string u8path_to_artifact_name(ulib::u8string_view path)
@@ -95,25 +99,6 @@ namespace ulib
             }
         }
 
-        void sdup2(int fd1, int fd2)
-        {
-            if (fd1 == -1)
-            {
-                throw process_internal_error{"fd1 in dup2 is invalid"};
-            }
-
-            if (fd2 == -1)
-            {
-                throw process_internal_error{"fd1 in dup2 is invalid"};
-            }
-
-            int rv = ::dup2(fd1, fd2);
-            if (rv == -1)
-            {
-                throw process_internal_error{"failed dup2"};
-            }
-        }
-
         struct pipe_wrapper
         {
             pipe_wrapper()
@@ -137,10 +122,52 @@ namespace ulib
 
             void openfds()
             {
+                // close-on-exec so concurrent spawns from other threads don't inherit our ends
+#ifdef __linux__
+                if (::pipe2(fd, O_CLOEXEC) == -1)
+                {
+                    throw process_internal_error{"failed create pipe"};
+                }
+#else
                 if (::pipe(fd) == -1)
                 {
                     throw process_internal_error{"failed create pipe"};
                 }
+
+                if (::fcntl(fd[0], F_SETFD, FD_CLOEXEC) == -1 || ::fcntl(fd[1], F_SETFD, FD_CLOEXEC) == -1)
+                {
+                    throw process_internal_error{"fcntl failed"};
+                }
+#endif
+            }
+
+            void opensockets(socket_kind kind)
+            {
+                // fd[0] and fd[1] keep their pipe roles, the sockets just work both ways
+#ifdef SOCK_CLOEXEC
+                if (::socketpair(AF_UNIX, int(kind) | SOCK_CLOEXEC, 0, fd) == -1)
+                {
+                    throw process_internal_error{"failed create socketpair"};
+                }
+#else
+                if (::socketpair(AF_UNIX, int(kind), 0, fd) == -1)
+                {
+                    throw process_internal_error{"failed create socketpair"};
+                }
+
+                if (::fcntl(fd[0], F_SETFD, FD_CLOEXEC) == -1 || ::fcntl(fd[1], F_SETFD, FD_CLOEXEC) == -1)
+                {
+                    throw process_internal_error{"fcntl failed"};
+                }
+#endif
+            }
+
+            void open(const std::optional<socket_kind> &sockets)
+            {
+                if (sockets)
+                    opensockets(*sockets);
+                else
+                    openfds();
             }
 
             void closefd(int idx)
@@ -172,309 +199,1121 @@ namespace ulib
 
             int fd[2];
         };
-    } // namespace detail
 
-    process::bpipe::~bpipe() { close(); }
+        enum child_error_type
+        {
+            child_error_exec = 0,
+            child_error_chdir = 1,
+            child_error_affinity = 2,
+            child_error_mempolicy = 3,
+            child_error_rlimit = 4,
+            child_error_scheduler = 5,
+            child_error_nice = 6,
+            child_error_ioprio = 7,
+            child_error_setsid = 8,
+            child_error_setpgid = 9,
+            child_error_tty = 10,
+            child_error_cgroup = 11,
+            child_error_setup = -1,
+        };
 
-    process::bpipe &process::bpipe::operator=(bpipe &&other)
-    {
-        close();
+        struct child_error_data
+        {
+            int type, code;
+        };
 
-        mHandle = other.mHandle;
-        other.mHandle = 0;
+        // while metrics are enabled the child writes this to the sink right before execve, ahead of any exec error
+        constexpr int child_timing_marker = -2;
 
-        return *this;
-    }
+        struct child_timing
+        {
+            int type; // child_timing_marker
+            int reserved;
+            uint64 setupStart;
+            uint64 execStart;
+        };
 
-    void process::bpipe::close()
-    {
-        if (mHandle)
+        const char *child_error_name(int type)
         {
-            ::close(mHandle);
-            mHandle = 0;
+            switch (type)
+            {
+            case child_error_exec:
+                return "exec";
+            case child_error_chdir:
+                return "chdir";
+            case child_error_affinity:
+                return "sched_setaffinity";
+            case child_error_mempolicy:
+                return "set_mempolicy";
+            case child_error_rlimit:
+                return "setrlimit";
+            case child_error_scheduler:
+                return "sched_setscheduler";
+            case child_error_nice:
+                return "setpriority";
+            case child_error_ioprio:
+                return "ioprio_set";
+            case child_error_setsid:
+                return "setsid";
+            case child_error_setpgid:
+                return "setpgid";
+            case child_error_tty:
+                return "TIOCSCTTY";
+            case child_error_cgroup:
+                return "cgroup.procs";
+            case child_error_setup:
+                return "setup";
+            }
+
+            return "unknown";
         }
-    }
 
-    size_t process::rpipe::read(void *buf, size_t size) { return ::read(mHandle, buf, size); }
-    ulib::string process::rpipe::read_all()
-    {
-        ulib::string result;
-        char reading_buf[1];
-        while (::read(mHandle, reading_buf, 1) > 0)
+        // cpu and memory placement, converted from spawn_options before fork
+        struct child_placement
         {
-            result.append(ulib::string_view{reading_buf, 1});
-        }
+#ifdef __linux__
+            static constexpr size_t max_numa_nodes = 1024;
 
-        return result;
-    }
+            bool hasAffinity = false;
+            cpu_set_t affinity;
 
-    char process::rpipe::getchar()
-    {
-        char ch;
-        this->read(&ch, 1);
-        return ch;
-    }
+            int mempolicy = -1;
+            unsigned long nodemask[max_numa_nodes / (8 * sizeof(unsigned long))] = {};
+#endif
+        };
 
-    ulib::string process::rpipe::getline()
-    {
-        ulib::string str;
-        while (true)
+        void prepare_options(const spawn_options &options, child_placement &placement)
         {
-            char ch = getchar();
-            if (ch == '\n')
-                break;
-
-            str.push_back(ch);
-        }
-
-        return str;
-    }
+#ifdef __linux__
+            if (options.cpus.size())
+            {
+                CPU_ZERO(&placement.affinity);
+                for (int cpu : options.cpus)
+                {
+                    if (cpu < 0 || cpu >= CPU_SETSIZE)
+                        throw process_invalid_options_error{ulib::format("cpu index {} is out of range", cpu)};
 
-    size_t process::wpipe::write(const void *buf, size_t size) { return ::write(mHandle, buf, size); }
-    size_t process::wpipe::write(ulib::string_view str) { return ::write(mHandle, str.data(), str.size()); }
+                    CPU_SET(cpu, &placement.affinity);
+                }
 
-    process::process()
-    {
-        mHandle = 0;
-        mWaited = false;
-    }
-    process::process(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags,
-                     std::optional<std::filesystem::path> workingDirectory)
-    {
-        mHandle = 0;
-        mWaited = false;
-        this->run(path, args, flags, workingDirectory);
-    }
-    process::process(ulib::u8string_view line, uint32 flags, std::optional<std::filesystem::path> workingDirectory)
-    {
-        mHandle = 0;
-        mWaited = false;
-        this->run(line, flags, workingDirectory);
-    }
+                placement.hasAffinity = true;
+            }
 
-    process::process(process &&other) { this->move_init(std::move(other)); }
+            if (options.memory_policy)
+            {
+                constexpr size_t bits = 8 * sizeof(unsigned long);
+                for (int node : options.memory_policy->nodes)
+                {
+                    if (node < 0 || size_t(node) >= child_placement::max_numa_nodes)
+                        throw process_invalid_options_error{ulib::format("numa node {} is out of range", node)};
 
-    process::~process() { this->finish(); }
+                    placement.nodemask[node / bits] |= 1ul << (node % bits);
+                }
 
-    process &process::operator=(process &&other)
-    {
-        this->finish();
-        this->move_init(std::move(other));
-        return *this;
-    }
+                placement.mempolicy = int(options.memory_policy->policy);
+            }
+#else
+            if (options.cpus.size() || options.memory_policy)
+                throw process_invalid_options_error{"cpu affinity and numa policy are only supported on linux"};
 
-    void process::run(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags,
-                      std::optional<std::filesystem::path> workingDirectory)
-    {
-        ulib::u8string callStr{path.u8string()};
-        ulib::u8string firstArg = detail::u8path_to_artifact_name(callStr);
-        firstArg.MarkZeroEnd();
+            if (options.scheduler || options.io)
+                throw process_invalid_options_error{"scheduler and io priority are only supported on linux"};
+#endif
+            if (options.nice && (*options.nice < -20 || *options.nice > 19))
+                throw process_invalid_options_error{"nice value must be in [-20, 19]"};
 
-        ulib::list<ulib::u8string> zargs = args;
-        for (auto &zarg : zargs)
-            zarg.MarkZeroEnd();
+            if (options.io && (options.io->level < 0 || options.io->level > 7))
+                throw process_invalid_options_error{"io priority level must be in [0, 7]"};
+        }
 
-        ulib::list<const char *> argvList;
-        argvList.push_back((char *)firstArg.data());
-        for (auto &arg : zargs)
-            argvList.push_back((char *)arg.data());
-        argvList.push_back(NULL);
+        // one descriptor to install in the child
+        struct fd_redirect
+        {
+            int from;
+            int to;
+            bool owned; // one of our descriptors, the child closes it once lifted; false for inherited ones
+        };
 
-        if (workingDirectory)
+        // Everything the child needs between fork and exec. The child must not allocate or throw: with clone3
+        // the allocator state of other threads is not reset the way fork() does.
+        struct child_context
         {
-            this->run((const char *)callStr.c_str(), (char **)argvList.data(),
-                      (const char *)workingDirectory->u8string().c_str(), flags);
-        }
-        else
+            const char *path;
+            char **argv;
+            const char *workingDirectory;
+            uint32 flags;
+
+            // stdio, channel and fd_mapping targets; sources are moved to fdFloor and above before any dup2
+            fd_redirect *redirects;
+            size_t redirectCount;
+            int fdFloor; // one past the highest target
+            int execFd;  // a memfd_executable to run instead of path, or -1
+
+            int sinkFd;
+            int goFd; // when set, exec only after the parent closes goWriteFd
+            int goWriteFd;
+            int parentPid;
+            int cgroupProcsFd; // -1 when already placed by clone3
+            bool cgroupRequired; // the group carries spawn_options::limits, failing to join it fails the spawn
+            const child_placement *placement;
+            const spawn_options *options; // only plain data is read from here
+        };
+
+        [[noreturn]] void child_fail(const child_context &ctx, int type, int code)
         {
-            this->run((const char *)callStr.c_str(), (char **)argvList.data(), nullptr, flags);
+            child_error_data ed{type, code};
+            ssize_t rv = ::write(ctx.sinkFd, &ed, sizeof(ed));
+            (void)rv;
+            ::_exit(EXIT_FAILURE);
         }
-    }
-
-    void process::run(ulib::u8string_view line, uint32 flags, std::optional<std::filesystem::path> workingDirectory)
-    {
-        auto args = detail::cmdline_to_args(line);
-        if (args.size() == 0)
-            throw process_internal_error{"invalid command line"};
-
-        ulib::u8string callStr = args.front();
-        ulib::u8string firstArg = detail::u8path_to_artifact_name(callStr);
-        args.front() = firstArg;
-
-        for (auto &arg : args)
-            arg.MarkZeroEnd();
 
-        callStr.MarkZeroEnd();
+        // moves fd to fdFloor or above unless it already is, the copy is close-on-exec
+        int child_lift(child_context &ctx, int fd)
+        {
+            if (fd == -1 || fd >= ctx.fdFloor)
+                return fd;
 
-        ulib::list<const char *> argvList;
-        // argvList.push_back((char *)firstArg.data());
-        for (auto &arg : args)
-            argvList.push_back((char *)arg.data());
-        argvList.push_back(NULL);
+            int lifted = ::fcntl(fd, F_DUPFD_CLOEXEC, ctx.fdFloor);
+            if (lifted == -1)
+                child_fail(ctx, child_error_setup, errno);
 
-        if (workingDirectory)
-        {
-            this->run((const char *)callStr.c_str(), (char **)argvList.data(),
-                      (const char *)workingDirectory->u8string().c_str(), flags);
-        }
-        else
-        {
-            this->run((const char *)callStr.c_str(), (char **)argvList.data(), nullptr, flags);
+            return lifted;
         }
-    }
 
-    void check_flags(uint32 flags)
-    {
-        if (flags & process::pipe_output)
+        // child_lift for our own descriptors: the original is closed, a stray copy of the go pipe's write end
+        // would keep the read below from ever seeing eof
+        int child_lift_owned(child_context &ctx, int fd)
         {
-            if (flags & process::pipe_stdout)
-                throw process_invalid_flags_error{"pipe_stdout flag is incompatible with pipe_output flag"};
+            int lifted = child_lift(ctx, fd);
+            if (lifted != fd)
+                ::close(fd);
 
-            if (flags & process::pipe_stderr)
-                throw process_invalid_flags_error{"pipe_stderr flag is incompatible with pipe_output flag"};
+            return lifted;
         }
-    }
 
-    void process::run(const char *path, char **argv, const char *workingDirectory, uint32 flags)
-    {
-        struct errdata
+        void child_redirect(child_context &ctx)
         {
-            int type, code;
-        };
+            // The sink and go pipe must survive the dup2 calls below, and so must every source: a target may be
+            // another mapping's source (3 -> 4 and 4 -> 3). With all of them above the highest target no dup2
+            // can clobber one, whatever the order. The lifted copies are close-on-exec and vanish on exec.
+            ctx.sinkFd = child_lift_owned(ctx, ctx.sinkFd);
+            ctx.goFd = child_lift_owned(ctx, ctx.goFd);
+            ctx.goWriteFd = child_lift_owned(ctx, ctx.goWriteFd);
+            ctx.execFd = child_lift_owned(ctx, ctx.execFd);
+
+            for (size_t i = 0; i < ctx.redirectCount; i++)
+            {
+                int original = ctx.redirects[i].from;
+                int lifted = child_lift(ctx, original);
 
-        detail::pipe_wrapper p_sink, p_stdin, p_stdout, p_stderr;
+                // one source may feed several targets (pipe_output, the pty slave), later entries share the copy
+                for (size_t j = i + 1; j < ctx.redirectCount; j++)
+                {
+                    if (ctx.redirects[j].from == original)
+                        ctx.redirects[j].from = lifted;
+                }
 
-        check_flags(flags);
+                if (ctx.redirects[i].owned && lifted != original)
+                    ::close(original);
 
-        if (flags & pipe_stdin)
-        {
-            p_stdin.openfds();
-        }
+                ctx.redirects[i].from = lifted;
+            }
 
-        if (flags & pipe_output)
-        {
-            p_stdout.openfds();
+            // dup2 clears close-on-exec on the target only
+            for (size_t i = 0; i < ctx.redirectCount; i++)
+            {
+                if (::dup2(ctx.redirects[i].from, ctx.redirects[i].to) == -1)
+                    child_fail(ctx, child_error_setup, errno);
+            }
         }
-        else
+
+        [[noreturn]] void exec_child(child_context &ctx)
         {
-            if (flags & pipe_stdout)
+            ULIB_PROCESS_METRICS_TIMESTAMP(setupStart);
+
+            if (ctx.cgroupProcsFd != -1)
             {
-                p_stdout.openfds();
+                // no clone3: migrate ourselves before exec, for a shared group failure only means no accounting
+                if (::write(ctx.cgroupProcsFd, "0", 1) == -1 && ctx.cgroupRequired)
+                    child_fail(ctx, child_error_cgroup, errno);
             }
 
-            if (flags & pipe_stderr)
+            if (ctx.flags & (process::new_session | process::pty))
             {
-                p_stderr.openfds();
+                if (::setsid() == -1)
+                    child_fail(ctx, child_error_setsid, errno);
+            }
+            else if (ctx.flags & process::new_process_group)
+            {
+                if (::setpgid(0, 0) == -1)
+                    child_fail(ctx, child_error_setpgid, errno);
             }
-        }
 
-        p_sink.openfds();
+#ifdef __linux__
+            if (ctx.flags & process::die_with_parent)
+            {
+                if (::prctl(PR_SET_PDEATHSIG, SIGKILL) == -1)
+                    child_fail(ctx, child_error_setup, errno);
 
-        if (::fcntl(p_sink.fd[1], F_SETFD, FD_CLOEXEC) == -1)
-        {
-            throw process_internal_error{"fcntl failed"};
-        }
+                if (::getppid() != ctx.parentPid)
+                    child_fail(ctx, child_error_setup, ESRCH);
+            }
 
-        int pid_before_fork = getpid();
-        int pid = fork();
-        if (pid == 0)
-        {
-            try
+            if (ctx.placement->hasAffinity)
             {
-#ifdef __linux__
-                if (flags & die_with_parent)
-                {
-                    // setsid();
+                if (::sched_setaffinity(0, sizeof(cpu_set_t), &ctx.placement->affinity) == -1)
+                    child_fail(ctx, child_error_affinity, errno);
+            }
 
-                    int r = prctl(PR_SET_PDEATHSIG, SIGKILL);
-                    if (r == -1)
-                    {
-                        throw process_internal_error{"prctl failed"};
-                    }
+            if (ctx.placement->mempolicy != -1)
+            {
+                // maxnode counts one past the last bit for historical reasons
+                long rv = ::syscall(__NR_set_mempolicy, ctx.placement->mempolicy, ctx.placement->nodemask,
+                                    child_placement::max_numa_nodes + 1);
+                if (rv == -1 && errno != ENOSYS)
+                    child_fail(ctx, child_error_mempolicy, errno);
+            }
+#endif
+            for (auto &limit : ctx.options->rlimits)
+            {
+                struct rlimit rl = {limit.soft, limit.hard};
+                if (::setrlimit(limit.resource, &rl) == -1)
+                    child_fail(ctx, child_error_rlimit, errno);
+            }
 
-                    if (getppid() != pid_before_fork)
-                    {
-                        throw process_internal_error{"getppid() != pid_before_fork"};
-                    }
-                }
+#ifdef __linux__
+            if (ctx.options->scheduler)
+            {
+                struct sched_param param = {};
+                if (::sched_setscheduler(0, int(*ctx.options->scheduler), &param) == -1)
+                    child_fail(ctx, child_error_scheduler, errno);
+            }
 #endif
-                if (flags & pipe_stdin)
-                {
-                    int fn = fileno(stdin);
-                    detail::closefd(fn);
-                    detail::sdup2(p_stdin.fd[0], fn);
-                }
 
-                if (flags & pipe_output)
-                {
-                    int fn_out = fileno(stdout);
-                    int fn_err = fileno(stderr);
+            if (ctx.options->nice)
+            {
+                if (::setpriority(PRIO_PROCESS, 0, *ctx.options->nice) == -1)
+                    child_fail(ctx, child_error_nice, errno);
+            }
 
-                    detail::closefd(fn_out);
-                    detail::sdup2(p_stdout.fd[1], fn_out);
+#ifdef __linux__
+            if (ctx.options->io)
+            {
+                constexpr int ioprio_who_process = 1;
+                constexpr int ioprio_class_shift = 13;
 
-                    detail::closefd(fn_err);
-                    detail::sdup2(p_stdout.fd[1], fn_err);
-                }
-                else
-                {
-                    if (flags & pipe_stdout)
-                    {
-                        int fn = fileno(stdout);
-                        detail::closefd(fn);
-                        detail::sdup2(p_stdout.fd[1], fn);
-                    }
+                int prio = (int(ctx.options->io->cls) << ioprio_class_shift) | ctx.options->io->level;
+                if (::syscall(__NR_ioprio_set, ioprio_who_process, 0, prio) == -1)
+                    child_fail(ctx, child_error_ioprio, errno);
+            }
+#endif
+            child_redirect(ctx);
+
+            if (ctx.flags & process::pty)
+            {
+                // the first terminal a session leader opens would do too, but it was opened before setsid()
+                if (::ioctl(STDIN_FILENO, TIOCSCTTY, 0) == -1)
+                    child_fail(ctx, child_error_tty, errno);
+            }
+
+            if (ctx.workingDirectory)
+            {
+                if (::chdir(ctx.workingDirectory) == -1)
+                    child_fail(ctx, child_error_chdir, errno);
+            }
+
+            if (ctx.goFd != -1)
+            {
+                ::close(ctx.goWriteFd);
+
+                char ch;
+                while (::read(ctx.goFd, &ch, 1) == -1 && errno == EINTR)
+                {
+                }
+            }
+
+#ifndef ULIB_PROCESS_NO_METRICS
+            if (setupStart != 0)
+            {
+                child_timing timing{child_timing_marker, 0, setupStart, metrics_clock()};
+                ssize_t rv = ::write(ctx.sinkFd, &timing, sizeof(timing));
+                (void)rv;
+            }
+#endif
+
+            if (ctx.execFd != -1)
+            {
+#ifdef __linux__
+                ::syscall(__NR_execveat, ctx.execFd, "", ctx.argv, environ, AT_EMPTY_PATH);
+                if (errno == ENOSYS)
+                    ::fexecve(ctx.execFd, ctx.argv, environ);
+#endif
+                child_fail(ctx, child_error_exec, errno);
+            }
+
+            ::execve(ctx.path, ctx.argv, environ);
+            ::execvp(ctx.path, ctx.argv);
+
+            child_fail(ctx, child_error_exec, errno);
+        }
+
+#ifdef __linux__
+        struct clone3_args
+        {
+            uint64 flags;
+            uint64 pidfd;
+            uint64 child_tid;
+            uint64 parent_tid;
+            uint64 exit_signal;
+            uint64 stack;
+            uint64 stack_size;
+            uint64 tls;
+            uint64 set_tid;
+            uint64 set_tid_size;
+            uint64 cgroup;
+        };
+
+        constexpr uint64 clone_into_cgroup = 0x200000000ULL;
+#endif
+
+        // fork(), or clone3(CLONE_INTO_CGROUP) when a cgroup is given so the child never runs outside of it
+        int spawn(int cgroupFd, bool &placed)
+        {
+#if defined(__linux__) && defined(__NR_clone3)
+            if (cgroupFd != -1)
+            {
+                clone3_args args{};
+                args.flags = clone_into_cgroup;
+                args.exit_signal = SIGCHLD;
+                args.cgroup = uint64(cgroupFd);
+
+                long rv = ::syscall(__NR_clone3, &args, sizeof(args));
+                if (rv != -1)
+                {
+                    placed = true;
+                    return int(rv);
+                }
+
+                // ENOSYS/E2BIG on old kernels, EACCES without delegation: fall back to fork
+            }
+#endif
+            placed = false;
+            return ::fork();
+        }
+
+        // a pollable handle that stays bound to the child until it is reaped, -1 before linux 5.3
+        int open_pidfd(int pid)
+        {
+#if defined(__linux__) && defined(__NR_pidfd_open)
+            return int(::syscall(__NR_pidfd_open, pid, 0));
+#else
+            return -1;
+#endif
+        }
+
+        // waits for events on fd until deadline (forever when nullopt); false once the deadline passed
+        bool poll_fd(int fd, short events, std::optional<std::chrono::steady_clock::time_point> deadline)
+        {
+            while (true)
+            {
+                int timeout = -1;
+                if (deadline)
+                {
+                    auto now = std::chrono::steady_clock::now();
+                    timeout = now >= *deadline
+                                  ? 0
+                                  : int(std::chrono::ceil<std::chrono::milliseconds>(*deadline - now).count());
+                }
+
+                struct pollfd pfd = {fd, events, 0};
+                int rv = ::poll(&pfd, 1, timeout);
+                if (rv == -1 && errno == EINTR)
+                    continue;
+
+                if (rv == -1)
+                    throw process_internal_error{ulib::format("poll failed: {}", std::strerror(errno))};
+
+                return rv != 0;
+            }
+        }
+
+        void set_window_size(int fd, const terminal_size &size)
+        {
+            struct winsize ws = {};
+            ws.ws_row = (unsigned short)size.rows;
+            ws.ws_col = (unsigned short)size.cols;
+            if (::ioctl(fd, TIOCSWINSZ, &ws) == -1)
+                throw process_internal_error{ulib::format("TIOCSWINSZ failed: {}", std::strerror(errno))};
+        }
+
+        // master in fd[0], slave in fd[1], both close-on-exec
+        void open_pty(pipe_wrapper &pty, const spawn_options &options)
+        {
+            pty.fd[0] = ::posix_openpt(O_RDWR | O_NOCTTY);
+            if (pty.fd[0] == -1)
+                throw process_internal_error{ulib::format("posix_openpt failed: {}", std::strerror(errno))};
+
+            if (::fcntl(pty.fd[0], F_SETFD, FD_CLOEXEC) == -1 || ::grantpt(pty.fd[0]) == -1 ||
+                ::unlockpt(pty.fd[0]) == -1)
+                throw process_internal_error{ulib::format("failed to set up pty: {}", std::strerror(errno))};
+
+            char name[128];
+#ifdef __linux__
+            if (::ptsname_r(pty.fd[0], name, sizeof(name)) != 0)
+                throw process_internal_error{"ptsname_r failed"};
+#else
+            // ptsname is not thread safe, serialize the copy
+            static std::mutex mutex;
+            {
+                std::lock_guard lock{mutex};
+                const char *pts = ::ptsname(pty.fd[0]);
+                if (!pts || std::strlen(pts) >= sizeof(name))
+                    throw process_internal_error{"ptsname failed"};
+
+                std::strcpy(name, pts);
+            }
+#endif
+
+            pty.fd[1] = ::open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+            if (pty.fd[1] == -1)
+                throw process_internal_error{ulib::format("failed to open {}: {}", name, std::strerror(errno))};
+
+            if (!options.pty_echo)
+            {
+                struct termios tio;
+                if (::tcgetattr(pty.fd[1], &tio) == -1)
+                    throw process_internal_error{ulib::format("tcgetattr failed: {}", std::strerror(errno))};
+
+                tio.c_lflag &= ~tcflag_t(ECHO | ECHONL);
+                if (::tcsetattr(pty.fd[1], TCSANOW, &tio) == -1)
+                    throw process_internal_error{ulib::format("tcsetattr failed: {}", std::strerror(errno))};
+            }
+
+            set_window_size(pty.fd[0], options.pty_size);
+        }
+    } // namespace detail
+
+    process::bpipe::~bpipe() { close(); }
+
+    process::bpipe &process::bpipe::operator=(bpipe &&other)
+    {
+        close();
+
+        mHandle = other.mHandle;
+        mStream = other.mStream;
+        mNonblocking = other.mNonblocking;
+        mOwner = other.mOwner;
+        mSeenData = other.mSeenData;
+        mSeenEof = other.mSeenEof;
+        mSocket = other.mSocket;
+        other.mHandle = 0;
+
+        return *this;
+    }
+
+    void process::bpipe::close()
+    {
+        if (mHandle)
+        {
+            ::close(mHandle);
+            mHandle = 0;
+        }
+    }
+
+    void process::bpipe::set_nonblocking(bool enable)
+    {
+        int flags = ::fcntl(mHandle, F_GETFL);
+        if (flags == -1 || ::fcntl(mHandle, F_SETFL, enable ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == -1)
+            throw process_internal_error{ulib::format("failed to change O_NONBLOCK: {}", std::strerror(errno))};
+
+        mNonblocking = enable;
+    }
+
+    size_t process::rpipe::read(void *buf, size_t size)
+    {
+        ssize_t rv = ::read(mHandle, buf, size);
+        ULIB_PROCESS_METRICS_COUNT(read_calls, 1);
+        ULIB_PROCESS_METRICS_BYTES(mStream, rv > 0 ? uint64(rv) : 0);
+
+        if (rv > 0 && !mSeenData)
+        {
+            mSeenData = true;
+            detail::trace(trace_event_type::first_byte, mOwner, mStream);
+        }
+        else if (rv == 0 && size && !mSeenEof)
+        {
+            mSeenEof = true;
+            detail::trace(trace_event_type::eof, mOwner, mStream);
+        }
+
+        return rv;
+    }
+
+    ulib::string process::rpipe::read_all()
+    {
+        ulib::string result;
+        char reading_buf[1];
+        while (this->read(reading_buf, 1) == 1)
+        {
+            result.append(ulib::string_view{reading_buf, 1});
+        }
+
+        return result;
+    }
+
+    bounded_capture process::rpipe::read_bounded(size_t head_limit, size_t tail_limit)
+    {
+        bounded_capture capture{head_limit, tail_limit};
+
+        char buf[16 * 1024];
+        while (true)
+        {
+            ssize_t rv = ssize_t(this->read(buf, sizeof(buf)));
+            if (rv == -1 && errno == EINTR)
+                continue;
+
+            if (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                detail::poll_fd(mHandle, POLLIN, std::nullopt);
+                continue;
+            }
+
+            if (rv <= 0)
+                break;
+
+            capture.append(buf, size_t(rv));
+        }
+
+        return capture;
+    }
+
+    std::optional<size_t> process::rpipe::try_read(void *buf, size_t size)
+    {
+        if (!mNonblocking && !this->readable())
+            return std::nullopt;
+
+        ssize_t rv = ssize_t(this->read(buf, size));
+        if (rv == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return std::nullopt;
+
+            if (errno == EIO)
+                return 0; // a pty master once the child side is closed
+
+            throw process_internal_error{ulib::format("read failed: {}", std::strerror(errno))};
+        }
+
+        return size_t(rv);
+    }
+
+    std::optional<size_t> process::rpipe::read(void *buf, size_t size, std::chrono::steady_clock::time_point deadline)
+    {
+        while (true)
+        {
+            if (auto rv = this->try_read(buf, size))
+                return rv;
+
+            if (!detail::poll_fd(mHandle, POLLIN, deadline))
+                return std::nullopt;
+        }
+    }
+
+    bool process::rpipe::readable(std::chrono::milliseconds timeout)
+    {
+        return detail::poll_fd(mHandle, POLLIN, std::chrono::steady_clock::now() + timeout);
+    }
+
+    char process::rpipe::getchar()
+    {
+        char ch;
+        this->read(&ch, 1);
+        return ch;
+    }
+
+    ulib::string process::rpipe::getline()
+    {
+        ulib::string str;
+        while (true)
+        {
+            char ch = getchar();
+            if (ch == '\n')
+                break;
+
+            str.push_back(ch);
+        }
+
+        return str;
+    }
+
+    ssize_t process::wpipe::write_once(const void *buf, size_t size)
+    {
+        ssize_t rv = mSocket ? ::send(mHandle, buf, size, MSG_NOSIGNAL) : ::write(mHandle, buf, size);
+        ULIB_PROCESS_METRICS_COUNT(write_calls, 1);
+        ULIB_PROCESS_METRICS_BYTES(mStream, rv > 0 ? uint64(rv) : 0);
+        return rv;
+    }
+
+    size_t process::wpipe::write(const void *buf, size_t size)
+    {
+        detail::sigpipe_guard guard{!mSocket};
+        return this->write_once(buf, size);
+    }
+
+    size_t process::wpipe::write(ulib::string_view str) { return this->write(str.data(), str.size()); }
+
+    void process::wpipe::write_all(const void *buf, size_t size)
+    {
+        detail::sigpipe_guard guard{!mSocket};
+
+        const char *bytes = static_cast<const char *>(buf);
+        while (size)
+        {
+            ssize_t rv = this->write_once(bytes, size);
+            if (rv == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    detail::poll_fd(mHandle, POLLOUT, std::nullopt);
+                    continue;
+                }
+
+                throw process_internal_error{ulib::format("write failed: {}", std::strerror(errno))};
+            }
+
+            bytes += rv;
+            size -= size_t(rv);
+        }
+    }
+
+    std::optional<size_t> process::wpipe::try_write(const void *buf, size_t size)
+    {
+        if (!mNonblocking)
+        {
+            // a writable pipe has room for PIPE_BUF bytes, more could block
+            if (!this->writable())
+                return std::nullopt;
+
+            size = std::min<size_t>(size, PIPE_BUF);
+        }
+
+        ssize_t rv = ssize_t(this->write(buf, size));
+        if (rv == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return std::nullopt;
+
+            throw process_internal_error{ulib::format("write failed: {}", std::strerror(errno))};
+        }
+
+        return size_t(rv);
+    }
+
+    size_t process::wpipe::write(const void *buf, size_t size, std::chrono::steady_clock::time_point deadline)
+    {
+        const char *bytes = static_cast<const char *>(buf);
+        size_t written = 0;
+
+        while (written < size)
+        {
+            if (auto rv = this->try_write(bytes + written, size - written))
+            {
+                written += *rv;
+                continue;
+            }
+
+            if (!detail::poll_fd(mHandle, POLLOUT, deadline))
+                break;
+        }
+
+        return written;
+    }
+
+    bool process::wpipe::writable(std::chrono::milliseconds timeout)
+    {
+        return detail::poll_fd(mHandle, POLLOUT, std::chrono::steady_clock::now() + timeout);
+    }
+
+    process::process()
+    {
+        mHandle = 0;
+        mPidfd = -1;
+        mFlags = noflags;
+        mExitWatch = 0;
+        mTraceWatch = 0;
+        mWaited = false;
+    }
+    process::process(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags,
+                     std::optional<std::filesystem::path> workingDirectory, const spawn_options &options)
+    {
+        mHandle = 0;
+        mPidfd = -1;
+        mFlags = noflags;
+        mExitWatch = 0;
+        mTraceWatch = 0;
+        mWaited = false;
+        this->run(path, args, flags, workingDirectory, options);
+    }
+    process::process(ulib::u8string_view line, uint32 flags, std::optional<std::filesystem::path> workingDirectory,
+                     const spawn_options &options)
+    {
+        mHandle = 0;
+        mPidfd = -1;
+        mFlags = noflags;
+        mExitWatch = 0;
+        mTraceWatch = 0;
+        mWaited = false;
+        this->run(line, flags, workingDirectory, options);
+    }
+
+    process::process(const command_line &cmd, uint32 flags, std::optional<std::filesystem::path> workingDirectory,
+                     const spawn_options &options)
+    {
+        mHandle = 0;
+        mPidfd = -1;
+        mFlags = noflags;
+        mExitWatch = 0;
+        mTraceWatch = 0;
+        mWaited = false;
+        this->run(cmd, flags, workingDirectory, options);
+    }
+
+    process::process(const memfd_executable &exe, const ulib::list<ulib::u8string> &args, uint32 flags,
+                     std::optional<std::filesystem::path> workingDirectory, const spawn_options &options)
+    {
+        mHandle = 0;
+        mPidfd = -1;
+        mFlags = noflags;
+        mExitWatch = 0;
+        mTraceWatch = 0;
+        mWaited = false;
+        this->run(exe, args, flags, workingDirectory, options);
+    }
+
+    process::process(process &&other) { this->move_init(std::move(other)); }
+
+    process::~process() { this->finish(); }
+
+    process &process::operator=(process &&other)
+    {
+        this->finish();
+        this->move_init(std::move(other));
+        return *this;
+    }
+
+    void process::run(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags,
+                      std::optional<std::filesystem::path> workingDirectory, const spawn_options &options)
+    {
+        ulib::u8string callStr{path.u8string()};
+        ulib::u8string firstArg = detail::u8path_to_artifact_name(callStr);
+        firstArg.MarkZeroEnd();
+
+        ulib::list<ulib::u8string> zargs = args;
+        for (auto &zarg : zargs)
+            zarg.MarkZeroEnd();
+
+        ulib::list<const char *> argvList;
+        argvList.push_back((char *)firstArg.data());
+        for (auto &arg : zargs)
+            argvList.push_back((char *)arg.data());
+        argvList.push_back(NULL);
+
+        if (workingDirectory)
+        {
+            this->run((const char *)callStr.c_str(), (char **)argvList.data(),
+                      (const char *)workingDirectory->u8string().c_str(), flags, options);
+        }
+        else
+        {
+            this->run((const char *)callStr.c_str(), (char **)argvList.data(), nullptr, flags, options);
+        }
+    }
+
+    void process::run(ulib::u8string_view line, uint32 flags, std::optional<std::filesystem::path> workingDirectory,
+                      const spawn_options &options)
+    {
+        auto args = detail::cmdline_to_args(line);
+        if (args.size() == 0)
+            throw process_internal_error{"invalid command line"};
+
+        ulib::u8string callStr = args.front();
+        ulib::u8string firstArg = detail::u8path_to_artifact_name(callStr);
+        args.front() = firstArg;
+
+        for (auto &arg : args)
+            arg.MarkZeroEnd();
+
+        callStr.MarkZeroEnd();
+
+        ulib::list<const char *> argvList;
+        // argvList.push_back((char *)firstArg.data());
+        for (auto &arg : args)
+            argvList.push_back((char *)arg.data());
+        argvList.push_back(NULL);
+
+        if (workingDirectory)
+        {
+            this->run((const char *)callStr.c_str(), (char **)argvList.data(),
+                      (const char *)workingDirectory->u8string().c_str(), flags, options);
+        }
+        else
+        {
+            this->run((const char *)callStr.c_str(), (char **)argvList.data(), nullptr, flags, options);
+        }
+    }
+
+    void process::run(const command_line &cmd, uint32 flags, std::optional<std::filesystem::path> workingDirectory,
+                      const spawn_options &options)
+    {
+        // the tables are static and already NUL terminated, nothing to parse or copy
+        if (workingDirectory)
+        {
+            this->run(cmd.path, const_cast<char **>(cmd.argv), (const char *)workingDirectory->u8string().c_str(), flags,
+                      options);
+        }
+        else
+        {
+            this->run(cmd.path, const_cast<char **>(cmd.argv), nullptr, flags, options);
+        }
+    }
+
+    void process::run(const memfd_executable &exe, const ulib::list<ulib::u8string> &args, uint32 flags,
+                      std::optional<std::filesystem::path> workingDirectory, const spawn_options &options)
+    {
+        if (!exe.is_open())
+            throw process_invalid_options_error{"memfd executable is not open"};
+
+        ulib::list<ulib::u8string> zargs = args;
+        for (auto &zarg : zargs)
+            zarg.MarkZeroEnd();
+
+        ulib::list<const char *> argvList;
+        argvList.push_back(exe.name().c_str());
+        for (auto &arg : zargs)
+            argvList.push_back((char *)arg.data());
+        argvList.push_back(NULL);
+
+        if (workingDirectory)
+        {
+            this->run(exe.name().c_str(), (char **)argvList.data(), (const char *)workingDirectory->u8string().c_str(),
+                      flags, options, exe.native_handle());
+        }
+        else
+        {
+            this->run(exe.name().c_str(), (char **)argvList.data(), nullptr, flags, options, exe.native_handle());
+        }
+    }
+
+    void check_flags(uint32 flags)
+    {
+        if (flags & process::pty)
+        {
+            if (flags & (process::pipe_stdin | process::pipe_stdout | process::pipe_output))
+                throw process_invalid_flags_error{
+                    "pty flag is incompatible with pipe_stdin, pipe_stdout and pipe_output flags"};
+        }
+
+        if (flags & process::capture_stdout)
+        {
+            if (flags & (process::pipe_stdout | process::pipe_output | process::pty))
+                throw process_invalid_flags_error{
+                    "capture_stdout flag is incompatible with pipe_stdout, pipe_output and pty flags"};
+        }
+
+        if (flags & process::pipe_output)
+        {
+            if (flags & process::pipe_stdout)
+                throw process_invalid_flags_error{"pipe_stdout flag is incompatible with pipe_output flag"};
+
+            if (flags & process::pipe_stderr)
+                throw process_invalid_flags_error{"pipe_stderr flag is incompatible with pipe_output flag"};
+        }
+    }
+
+    void process::run(const char *path, char **argv, const char *workingDirectory, uint32 flags,
+                      const spawn_options &options, int execFd)
+    {
+        ULIB_PROCESS_METRICS_TIMESTAMP(runStart);
+        detail::trace_scope tracing;
+        uint64 traceStart = tracing ? detail::trace_clock() : 0;
+
+        detail::pipe_wrapper p_sink, p_go, p_stdin, p_stdout, p_stderr, p_channel, p_pty;
+
+        check_flags(flags);
+
+        if (options.channel && options.channel_fd <= STDERR_FILENO)
+            throw process_invalid_options_error{"channel_fd must not replace stdin, stdout or stderr"};
+
+        if (flags & pipe_stdin)
+        {
+            p_stdin.open(options.stdio_sockets);
+        }
+
+        if (flags & pipe_output)
+        {
+            p_stdout.open(options.stdio_sockets);
+        }
+        else
+        {
+            if (flags & pipe_stdout)
+            {
+                p_stdout.open(options.stdio_sockets);
+            }
+
+            if (flags & pipe_stderr)
+            {
+                p_stderr.open(options.stdio_sockets);
+            }
+        }
+
+        if (options.channel)
+        {
+            p_channel.opensockets(*options.channel);
+        }
+
+        if (flags & pty)
+        {
+            detail::open_pty(p_pty, options);
+        }
+
+        memory_capture capture;
+        if (flags & capture_stdout)
+        {
+            capture = memory_capture::create();
+        }
+
+        // the child installs these in order, see detail::child_redirect
+        std::vector<detail::fd_redirect> redirects;
+        if (p_pty.fd[1] != -1)
+        {
+            redirects.push_back({p_pty.fd[1], STDIN_FILENO, true});
+            redirects.push_back({p_pty.fd[1], STDOUT_FILENO, true});
+            if (!(flags & pipe_stderr))
+                redirects.push_back({p_pty.fd[1], STDERR_FILENO, true});
+        }
+        if (p_stdin.fd[0] != -1)
+            redirects.push_back({p_stdin.fd[0], STDIN_FILENO, true});
+        if (p_stdout.fd[1] != -1)
+            redirects.push_back({p_stdout.fd[1], STDOUT_FILENO, true});
+        if (capture.is_open())
+            redirects.push_back({capture.native_handle(), STDOUT_FILENO, true});
+        if (flags & pipe_output)
+            redirects.push_back({p_stdout.fd[1], STDERR_FILENO, true});
+        if (p_stderr.fd[1] != -1)
+            redirects.push_back({p_stderr.fd[1], STDERR_FILENO, true});
+        if (p_channel.fd[1] != -1)
+            redirects.push_back({p_channel.fd[1], options.channel_fd, true});
+
+        std::vector<detail::pipe_wrapper> p_maps(options.fds.size());
+        for (size_t i = 0; i < options.fds.size(); i++)
+        {
+            const fd_mapping &mapping = options.fds[i];
+            if (mapping.child_fd < 0)
+                throw process_invalid_options_error{ulib::format("invalid child descriptor {}", mapping.child_fd)};
+
+            for (auto &redirect : redirects)
+            {
+                if (redirect.to == mapping.child_fd)
+                    throw process_invalid_options_error{
+                        ulib::format("child descriptor {} is mapped twice", mapping.child_fd)};
+            }
+
+            switch (mapping.type)
+            {
+            case fd_mapping::inherit:
+                if (mapping.parent_fd < 0 || ::fcntl(mapping.parent_fd, F_GETFD) == -1)
+                    throw process_invalid_options_error{
+                        ulib::format("parent descriptor {} is not open", mapping.parent_fd)};
+
+                redirects.push_back({mapping.parent_fd, mapping.child_fd, false});
+                break;
 
-                    if (flags & pipe_stderr)
-                    {
-                        int fn = fileno(stderr);
-                        detail::closefd(fn);
-                        detail::sdup2(p_stderr.fd[1], fn);
-                    }
-                }
+            case fd_mapping::child_input:
+                p_maps[i].openfds();
+                redirects.push_back({p_maps[i].fd[0], mapping.child_fd, true});
+                break;
 
-                p_sink.closefd(0);
+            case fd_mapping::child_output:
+                p_maps[i].openfds();
+                redirects.push_back({p_maps[i].fd[1], mapping.child_fd, true});
+                break;
+            }
+        }
 
-                if (workingDirectory)
-                {
-                    if (chdir(workingDirectory) == -1)
-                    {
-                        throw errdata{1, errno};
-                    }
-                }
+        int fdFloor = STDERR_FILENO + 1;
+        for (auto &redirect : redirects)
+            fdFloor = std::max(fdFloor, redirect.to + 1);
 
-                // child
-                // char *argv[] = {(char *)firstArg.c_str(), NULL};
-                // char *envp[] = {(char *)"some", NULL};
+        p_sink.openfds();
 
-                execve(path, argv, environ);
-                execvp(path, argv);
+        if (options.profile)
+        {
+            p_go.openfds();
+        }
 
-                throw errdata{0, errno};
-            }
-            catch (const errdata &ed)
-            {
-                ::write(p_sink.fd[1], &ed, sizeof(errdata));
-                p_sink.closefd(1);
-                ::_exit(EXIT_FAILURE);
-            }
-            catch (const std::exception &ex)
+        detail::child_placement placement;
+        detail::prepare_options(options, placement);
+
+        cgroup dedicated;
+        if (options.limits)
+        {
+            static std::atomic<uint64> counter{0};
+            ulib::string name = ulib::format("ulib-process-{}-{}", ::getpid(), counter++);
+            ulib::u8string_view u8name{(const char8_t *)name.data(), (const char8_t *)name.data() + name.size()};
+
+            if (options.cgroup_parent.empty())
+                dedicated = cgroup{u8name, *options.limits};
+            else
+                dedicated = cgroup{options.cgroup_parent, u8name, *options.limits};
+
+            // never run a child the caller asked to constrain without its limits
+            if (!dedicated.limits_applied())
             {
-                perror(ex.what());
-                errdata ed{-1, errno};
-                ::write(p_sink.fd[1], &ed, sizeof(errdata));
-                p_sink.closefd(1);
-                ::_exit(EXIT_FAILURE);
+                auto parent = options.cgroup_parent.empty() ? cgroup::self_path().value_or(std::filesystem::path{})
+                                                            : options.cgroup_parent;
+                throw process_invalid_options_error{
+                    ulib::format("cgroup limits cannot be applied under '{}': no cgroup v2 there, or its controllers "
+                                 "are not delegated; set spawn_options::cgroup_parent to a delegated cgroup",
+                                 parent.string())};
             }
-            catch (...)
-            {
-                perror("something unexpected was catched");
+        }
 
-                errdata ed{-2, errno};
-                ::write(p_sink.fd[1], &ed, sizeof(errdata));
-                p_sink.closefd(1);
-                ::_exit(EXIT_FAILURE);
-            }
+        cgroup *group = dedicated.is_available() ? &dedicated : options.group;
+        if (group && !group->is_available())
+            group = nullptr;
+
+        detail::child_context ctx;
+        ctx.path = path;
+        ctx.argv = argv;
+        ctx.workingDirectory = workingDirectory;
+        ctx.flags = flags;
+        ctx.redirects = redirects.data();
+        ctx.redirectCount = redirects.size();
+        ctx.fdFloor = fdFloor;
+        ctx.execFd = execFd;
+        ctx.sinkFd = p_sink.fd[1];
+        ctx.goFd = p_go.fd[0];
+        ctx.goWriteFd = p_go.fd[1];
+        ctx.parentPid = ::getpid();
+        ctx.cgroupProcsFd = group ? group->procs_handle() : -1;
+        ctx.cgroupRequired = group == &dedicated;
+        ctx.placement = &placement;
+        ctx.options = &options;
+
+        ULIB_PROCESS_METRICS_TIMESTAMP(forkStart);
+        mStartTime = std::chrono::steady_clock::now();
+
+        bool placed = false;
+        int pid = detail::spawn(group ? group->native_handle() : -1, placed);
+        if (pid == 0)
+        {
+            if (placed)
+                ctx.cgroupProcsFd = -1;
+
+            detail::exec_child(ctx);
         }
         else if (pid == -1)
         {
@@ -483,23 +1322,108 @@ namespace ulib
         }
         else
         {
+            ULIB_PROCESS_METRICS_TIMESTAMP(forkEnd);
+            ULIB_PROCESS_METRICS_PHASE(pipes, runStart, forkStart);
+            ULIB_PROCESS_METRICS_PHASE(fork, forkStart, forkEnd);
+
+            if (options.profile)
+            {
+                // counters must exist before exec, the child waits for the go pipe to close
+                mPerf.open(pid);
+                p_go.closefd(1);
+            }
+            else
+            {
+                mPerf.close();
+            }
+
             {
                 p_sink.closefd(1);
 
-                errdata ed;
-                int rv = ::read(p_sink.fd[0], &ed, sizeof(errdata));
-                if (rv == 0)
+                // the child writes at most its timings and one error record, then exits or execs
+                char report[sizeof(detail::child_timing) + sizeof(detail::child_error_data)];
+                size_t size = 0;
+                bool readFailed = false;
+                while (size < sizeof(report))
+                {
+                    ssize_t rv = ::read(p_sink.fd[0], report + size, sizeof(report) - size);
+                    if (rv == 0)
+                        break;
+
+                    if (rv == -1)
+                    {
+                        if (errno == EINTR)
+                            continue;
+
+                        readFailed = true;
+                        break;
+                    }
+
+                    size += size_t(rv);
+                }
+
+                ULIB_PROCESS_METRICS_TIMESTAMP(handshakeEnd);
+                ULIB_PROCESS_METRICS_PHASE(handshake, forkEnd, handshakeEnd);
+
+                const char *record = report;
+#ifndef ULIB_PROCESS_NO_METRICS
+                detail::child_timing timing;
+                if (size >= sizeof(timing))
+                {
+                    std::memcpy(&timing, report, sizeof(timing));
+                    if (timing.type == detail::child_timing_marker)
+                    {
+                        ULIB_PROCESS_METRICS_PHASE(child_setup, timing.setupStart, timing.execStart);
+                        ULIB_PROCESS_METRICS_PHASE(exec, timing.execStart, handshakeEnd);
+                        record += sizeof(timing);
+                        size -= sizeof(timing);
+                    }
+                }
+#endif
+
+                // after the timing record is gone, only an error record means the exec failed
+                if (tracing)
+                {
+                    detail::trace_record(tracing.ring(), trace_event_type::spawn, pid, traceStart,
+                                         process_stream::out, argv[0]);
+                    detail::trace_record(tracing.ring(),
+                                         size == 0 && !readFailed ? trace_event_type::exec
+                                                                  : trace_event_type::spawn_failed,
+                                         pid, detail::trace_clock());
+                }
+
+                if (size != 0 || readFailed)
+                {
+                    // the child is gone (or never exec'd), don't leave a zombie behind
+                    ::waitpid(pid, nullptr, 0);
+                    mPerf.close();
+                    ULIB_PROCESS_METRICS_COUNT(spawn_failures, 1);
+                }
+
+                if (readFailed)
+                {
+                    throw process_internal_error{"read sink pipe failed"};
+                }
+                else if (size == 0)
                 {
                     // no error
                 }
-                else if (rv == sizeof(errdata))
+                else if (size == sizeof(detail::child_error_data))
                 {
-                    if (ed.type == 0 && ed.code == ENOENT)
+                    detail::child_error_data ed;
+                    std::memcpy(&ed, record, sizeof(ed));
+
+                    if (ed.type == detail::child_error_exec)
+                    {
+                        ULIB_PROCESS_METRICS_COUNT(exec_failures, 1);
+                    }
+
+                    if (ed.type == detail::child_error_exec && ed.code == ENOENT)
                     {
                         // execv
                         throw process_file_not_found_error{std::strerror(ed.code)};
                     }
-                    else if (ed.type == 1 && ed.code == ENOENT)
+                    else if (ed.type == detail::child_error_chdir && ed.code == ENOENT)
                     {
                         // chdir
                         throw process_invalid_working_directory_error{std::strerror(ed.code)};
@@ -507,13 +1431,10 @@ namespace ulib
                     else
                     {
                         throw process_internal_error{
-                            ulib::format("({}) errno [{}]: {}", ed.type, ed.code, std::strerror(ed.code))};
+                            ulib::format("({}) errno [{}]: {}", detail::child_error_name(ed.type), ed.code,
+                                         std::strerror(ed.code))};
                     }
                 }
-                else if (rv == -1)
-                {
-                    throw process_internal_error{"read sink pipe failed"};
-                }
                 else
                 {
                     throw process_internal_error{"read sink pipe is invalid"};
@@ -527,81 +1448,417 @@ namespace ulib
 
             if (flags & pipe_output)
             {
-                mOutPipe = std::move(rpipe{p_stdout.detachfd(0)});
+                mOutPipe = std::move(rpipe{p_stdout.detachfd(0), process_stream::out, pid});
             }
             else
             {
                 if (flags & pipe_stdout)
                 {
-                    mOutPipe = std::move(rpipe{p_stdout.detachfd(0)});
+                    mOutPipe = std::move(rpipe{p_stdout.detachfd(0), process_stream::out, pid});
                 }
 
                 if (flags & pipe_stderr)
                 {
-                    mErrPipe = std::move(rpipe{p_stderr.detachfd(0)});
+                    mErrPipe = std::move(rpipe{p_stderr.detachfd(0), process_stream::err, pid});
                 }
             }
 
+            if (options.stdio_sockets)
+            {
+                mInPipe.mSocket = mInPipe.is_open();
+                mOutPipe.mSocket = mOutPipe.is_open();
+                mErrPipe.mSocket = mErrPipe.is_open();
+            }
+
+            if (flags & pty)
+            {
+                // reads and writes share the master, in() gets its own descriptor so both can be closed apart
+                int master = ::fcntl(p_pty.fd[0], F_DUPFD_CLOEXEC, 0);
+                if (master == -1)
+                    throw process_internal_error{"failed to duplicate pty master"};
+
+                mInPipe = std::move(wpipe{master});
+                mOutPipe = std::move(rpipe{p_pty.detachfd(0), process_stream::out, pid});
+            }
+
+            if (options.channel)
+            {
+                mChannel = unix_channel{p_channel.detachfd(0)};
+            }
+
+            mCapture = std::move(capture);
+
+            mInputs.clear();
+            mOutputs.clear();
+            for (size_t i = 0; i < options.fds.size(); i++)
+            {
+                const fd_mapping &mapping = options.fds[i];
+                if (mapping.type == fd_mapping::child_input)
+                    mInputs.emplace_back(mapping.child_fd, wpipe{p_maps[i].detachfd(1)});
+                else if (mapping.type == fd_mapping::child_output)
+                    mOutputs.emplace_back(mapping.child_fd,
+                                          rpipe{p_maps[i].detachfd(0), process_stream::out, pid});
+            }
+
+            if (mPidfd != -1)
+                ::close(mPidfd);
+
+            mCgroup = std::move(dedicated);
+            mResult.reset();
             mHandle = pid;
+            mPidfd = detail::open_pidfd(pid);
+            mFlags = flags;
+            mWaited = false;
+
+            this->release_trace_watch(false);
+            if (tracing && mPidfd != -1)
+            {
+                // the reaper thread sees the pidfd fire when the child exits, which may be long before we reap it
+                mTraceWatch = process_reaper::instance().watch(
+                    pid, mPidfd, [](int pid, int) { detail::trace(trace_event_type::exit, pid); });
+            }
+
+            ULIB_PROCESS_METRICS_COUNT(spawns, 1);
+            ULIB_PROCESS_METRICS_TIMESTAMP(runEnd);
+            ULIB_PROCESS_METRICS_PHASE(total, runStart, runEnd);
         }
     }
 
-    std::optional<int> process::wait(std::chrono::milliseconds ms) {}
-
-    int process::wait()
+    std::optional<int> process::wait(std::chrono::milliseconds ms)
     {
-        int wstatus;
-        int result = waitpid(mHandle, &wstatus, 0);
-        if (result == -1)
+        auto deadline = std::chrono::steady_clock::now() + ms;
+        auto delay = std::chrono::microseconds{100};
+
+        while (!this->reap(false))
         {
-            throw ulib::RuntimeError{"waitpid failed"};
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                return std::nullopt;
+
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(delay, deadline - now));
+            delay = std::min(delay * 2, std::chrono::microseconds{10000});
         }
 
-        mWaited = true;
-        return WEXITSTATUS(wstatus);
+        return mResult->code();
     }
 
-    bool process::is_running()
+    int process::wait() { return this->wait_for_result().code(); }
+
+    const wait_result &process::wait_for_result()
     {
-        int wstatus;
-        int result = waitpid(mHandle, &wstatus, WNOHANG);
-        if (result == -1)
+        this->reap(true);
+        return *mResult;
+    }
+
+    std::optional<wait_result> process::check_result()
+    {
+        if (!this->reap(false))
+            return std::nullopt;
+
+        return mResult;
+    }
+
+    bool process::is_running() { return !this->reap(false); }
+    bool process::is_finished() { return !is_running(); }
+    void process::detach()
+    {
+        if (this->is_bound() && !mResult)
         {
-            throw ulib::RuntimeError{"waitpid failed"};
+            // an exit watch becomes the reaper's job, its callback still runs
+            auto &reaper = process_reaper::instance();
+            bool traceExit = !this->release_trace_watch(false);
+            if (mCgroup.is_available())
+            {
+                process_reaper::callback cb = mExitWatch ? reaper.unwatch(mExitWatch) : process_reaper::callback{};
+                reaper.adopt(mHandle, mPidfd, this->with_cgroup_removal(std::move(cb)), traceExit);
+                mPidfd = -1;
+            }
+            else if (!mExitWatch || !reaper.detach(mExitWatch, traceExit))
+            {
+                reaper.adopt(mHandle, mPidfd, {}, traceExit);
+                mPidfd = -1;
+            }
+
+            mExitWatch = 0;
         }
-        else if (result == 0)
+
+        destroy_handles();
+    }
+
+    bool process::release_trace_watch(bool traceNow)
+    {
+        if (!mTraceWatch)
+            return false;
+
+        auto pending = process_reaper::instance().unwatch(mTraceWatch);
+        mTraceWatch = 0;
+
+        if (!pending)
+            return true;
+
+        if (traceNow)
         {
+            pending(mHandle, 0);
             return true;
         }
-        else
+
+        return false;
+    }
+
+    process_reaper::callback process::with_cgroup_removal(process_reaper::callback cb)
+    {
+        if (!mCgroup.is_available())
+            return cb;
+
+        // std::function needs a copyable callable
+        auto group = std::make_shared<cgroup>(std::move(mCgroup));
+        return [cb = std::move(cb), group](int pid, int code) {
+            if (cb)
+                cb(pid, code);
+
+            group->close();
+        };
+    }
+
+    void process::on_exit(process_reaper::callback callback)
+    {
+        auto &reaper = process_reaper::instance();
+        if (mExitWatch)
         {
-            return false;
+            reaper.unwatch(mExitWatch);
+            mExitWatch = 0;
         }
+
+        if (mResult)
+        {
+            callback(mHandle, mResult->code());
+            return;
+        }
+
+        if (!this->is_bound())
+            throw process_internal_error{"on_exit on a process that is not running"};
+
+        mExitWatch = reaper.watch(mHandle, mPidfd, std::move(callback));
     }
-    bool process::is_finished() { return !is_running(); }
-    void process::detach() { destroy_handles(); } // already detached
     void process::terminate()
     {
-        if (::kill(mHandle, SIGKILL) == -1)
+        if (this->send_signal(SIGKILL) == -1)
             throw process_internal_error{std::strerror(errno)};
     }
 
+    int process::terminate(std::chrono::milliseconds grace)
+    {
+        if (!mResult)
+        {
+            if (this->send_signal(SIGTERM) == -1 && errno != ESRCH)
+                throw process_internal_error{std::strerror(errno)};
+
+            // the child is not reaped before this point, so its pid (and group id) cannot be reused yet
+            bool exited = this->wait_exit(grace);
+            if (!exited || (mFlags & (new_process_group | new_session | pty)))
+                this->send_signal(SIGKILL);
+        }
+
+        return this->wait();
+    }
+
+    int process::send_signal(int sig)
+    {
+        bool group = mFlags & (new_process_group | new_session | pty);
+        return ::kill(group ? -mHandle : mHandle, sig);
+    }
+
+    bool process::wait_exit(std::chrono::milliseconds timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+#ifdef __linux__
+        while (mPidfd != -1)
+        {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            struct pollfd pfd = {mPidfd, POLLIN, 0};
+
+            int rv = ::poll(&pfd, 1, int(std::max<int64_t>(0, left.count())));
+            if (rv > 0)
+                return true;
+            if (rv == 0)
+                return false;
+            if (errno != EINTR)
+                break;
+        }
+#endif
+
+        // no pidfd: poll without reaping, the group may still need a SIGKILL
+        auto delay = std::chrono::microseconds{100};
+        while (true)
+        {
+            siginfo_t info = {};
+            int rv = ::waitid(P_PID, id_t(mHandle), &info, WEXITED | WNOHANG | WNOWAIT);
+            if (rv == 0 && info.si_pid != 0)
+                return true;
+            if (rv == -1 && errno != EINTR)
+                return true; // not our child anymore
+
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                return false;
+
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(delay, deadline - now));
+            delay = std::min(delay * 2, std::chrono::microseconds{10000});
+        }
+    }
+
     std::optional<int> process::check()
     {
+        if (!this->reap(false))
+            return std::nullopt;
+
+        return mResult->code();
+    }
+
+    stream_log process::read_merged()
+    {
+        stream_log log;
+
+        rpipe *pipes[2] = {&mOutPipe, &mErrPipe};
+        process_stream streams[2] = {process_stream::out, process_stream::err};
+        bool open[2] = {mOutPipe.is_open(), mErrPipe.is_open()};
+
+        char buf[16 * 1024];
+        while (open[0] || open[1])
+        {
+            struct pollfd fds[2];
+            size_t index[2];
+            nfds_t count = 0;
+            for (size_t i = 0; i < 2; i++)
+            {
+                if (!open[i])
+                    continue;
+
+                fds[count] = {pipes[i]->mHandle, POLLIN, 0};
+                index[count++] = i;
+            }
+
+            if (::poll(fds, count, -1) == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                throw process_internal_error{ulib::format("poll failed: {}", std::strerror(errno))};
+            }
+
+            // one read per ready pipe keeps the interleaving close to the order the child wrote in
+            for (nfds_t j = 0; j < count; j++)
+            {
+                if (!fds[j].revents)
+                    continue;
+
+                size_t i = index[j];
+                ssize_t rv = ssize_t(pipes[i]->read(buf, sizeof(buf)));
+                auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+                if (rv == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                    continue;
+
+                if (rv <= 0)
+                {
+                    open[i] = false;
+                    continue;
+                }
+
+                log.append(streams[i], uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), buf,
+                           size_t(rv));
+            }
+        }
+
+        return log;
+    }
+
+    bool process::reap(bool block)
+    {
+        if (mResult)
+            return true;
+
         int wstatus;
-        int result = waitpid(mHandle, &wstatus, WNOHANG);
+        struct rusage usage;
+        int result;
+        do
+        {
+            result = ::wait4(mHandle, &wstatus, block ? 0 : WNOHANG, &usage);
+        } while (result == -1 && errno == EINTR);
+
         if (result == -1)
         {
             throw ulib::RuntimeError{"waitpid failed"};
         }
         else if (result == 0)
         {
-            return std::nullopt;
+            return false;
         }
-        else
+
+        if (!this->release_trace_watch(true))
+            detail::trace(trace_event_type::exit, mHandle);
+
+        wait_result res;
+        res.end_time = std::chrono::steady_clock::now();
+        res.start_time = mStartTime;
+
+        if (WIFEXITED(wstatus))
+        {
+            res.exit_code = WEXITSTATUS(wstatus);
+        }
+        else if (WIFSIGNALED(wstatus))
+        {
+            res.signal = WTERMSIG(wstatus);
+#ifdef WCOREDUMP
+            res.core_dumped = WCOREDUMP(wstatus);
+#endif
+        }
+
+        res.user_time = std::chrono::seconds{usage.ru_utime.tv_sec} + std::chrono::microseconds{usage.ru_utime.tv_usec};
+        res.system_time =
+            std::chrono::seconds{usage.ru_stime.tv_sec} + std::chrono::microseconds{usage.ru_stime.tv_usec};
+#ifdef __APPLE__
+        res.max_rss_bytes = uint64(usage.ru_maxrss);
+#else
+        res.max_rss_bytes = uint64(usage.ru_maxrss) * 1024;
+#endif
+        res.minor_faults = uint64(usage.ru_minflt);
+        res.major_faults = uint64(usage.ru_majflt);
+        res.voluntary_switches = uint64(usage.ru_nvcsw);
+        res.involuntary_switches = uint64(usage.ru_nivcsw);
+
+        if (mCgroup.is_available())
+        {
+            res.cgroup = mCgroup.stats();
+            mCgroup.close();
+        }
+
+        if (mPerf.is_open())
+            res.perf = mPerf.read();
+
+        mResult = std::move(res);
+        mWaited = true;
+
+        if (mPidfd != -1)
+        {
+            ::close(mPidfd);
+            mPidfd = -1;
+        }
+
+        detail::trace(trace_event_type::reap, mHandle);
+
+        if (mExitWatch)
         {
-            return WEXITSTATUS(wstatus);
+            // the reaper thread did not get to it first
+            auto callback = process_reaper::instance().unwatch(mExitWatch);
+            mExitWatch = 0;
+
+            if (callback)
+                callback(mHandle, mResult->code());
         }
+
+        return true;
     }
 
     void process::destroy_pipes()
@@ -609,11 +1866,57 @@ namespace ulib
         mInPipe.close();
         mOutPipe.close();
         mErrPipe.close();
+        mChannel.close();
+        mCapture.close();
+        mInputs.clear();
+        mOutputs.clear();
+    }
+
+    void process::resize_terminal(uint32 rows, uint32 cols)
+    {
+        if (!(mFlags & pty) || !mOutPipe.is_open())
+            throw process_invalid_flags_error{"process has no pty"};
+
+        detail::set_window_size(mOutPipe.native_handle(), terminal_size{rows, cols});
+    }
+
+    mapped_output process::captured_stdout()
+    {
+        if (!(mFlags & capture_stdout) || !mCapture.is_open())
+            throw process_invalid_flags_error{"process was not started with capture_stdout"};
+
+        return mCapture.map();
+    }
+
+    process::wpipe &process::input(int child_fd)
+    {
+        for (auto &[fd, pipe] : mInputs)
+            if (fd == child_fd)
+                return pipe;
+
+        throw process_invalid_options_error{ulib::format("child descriptor {} is not an fd_mapping::input", child_fd)};
+    }
+
+    process::rpipe &process::output(int child_fd)
+    {
+        for (auto &[fd, pipe] : mOutputs)
+            if (fd == child_fd)
+                return pipe;
+
+        throw process_invalid_options_error{
+            ulib::format("child descriptor {} is not an fd_mapping::output", child_fd)};
     }
 
     void process::destroy_handles()
     {
         mHandle = 0;
+
+        if (mPidfd != -1)
+        {
+            ::close(mPidfd);
+            mPidfd = -1;
+        }
+
         destroy_pipes();
     }
 
@@ -621,9 +1924,22 @@ namespace ulib
     {
         try
         {
-            if (this->is_bound())
-                if (!mWaited)
-                    this->terminate();
+            if (this->is_bound() && !mWaited)
+            {
+                this->terminate();
+
+                // nobody is left to wait for it
+                auto &reaper = process_reaper::instance();
+                if (mExitWatch)
+                {
+                    reaper.unwatch(mExitWatch);
+                    mExitWatch = 0;
+                }
+
+                bool traceExit = !this->release_trace_watch(false);
+                reaper.adopt(mHandle, mPidfd, this->with_cgroup_removal({}), traceExit);
+                mPidfd = -1;
+            }
 
             destroy_handles();
         }
@@ -638,13 +1954,38 @@ namespace ulib
         mHandle = other.mHandle;
         other.mHandle = 0;
 
+        mPidfd = other.mPidfd;
+        other.mPidfd = -1;
+        mFlags = other.mFlags;
+        mExitWatch = other.mExitWatch;
+        other.mExitWatch = 0;
+        mTraceWatch = other.mTraceWatch;
+        other.mTraceWatch = 0;
+
         mInPipe = std::move(other.mInPipe);
         mOutPipe = std::move(other.mOutPipe);
         mErrPipe = std::move(other.mErrPipe);
+        mChannel = std::move(other.mChannel);
+        mCapture = std::move(other.mCapture);
+        mInputs = std::move(other.mInputs);
+        mOutputs = std::move(other.mOutputs);
+
+        mCgroup = std::move(other.mCgroup);
+        mStartTime = other.mStartTime;
+        mPerf = std::move(other.mPerf);
+        mResult = std::move(other.mResult);
 
         mWaited = other.mWaited;
     }
 
+    bool set_child_subreaper(bool enable)
+    {
+#ifdef __linux__
+        return ::prctl(PR_SET_CHILD_SUBREAPER, enable ? 1 : 0, 0, 0, 0) == 0;
+#else
+        return false;
+#endif
+    }
 } // namespace ulib
 
 #endif
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_memfd.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <ulib/format.h>
+
+#include "../../process_exceptions.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+#ifdef __linux__
+        // since linux 6.3, needed where the vm.memfd_noexec sysctl makes memfds noexec by default
+        constexpr unsigned int memfd_exec = 0x0010U;
+
+        constexpr int memfd_exec_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+        int memfd_create_executable(const char *name)
+        {
+            int fd = int(::syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING | memfd_exec));
+            if (fd == -1 && errno == EINVAL)
+                fd = int(::syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+
+            if (fd == -1)
+                throw process_internal_error{ulib::format("memfd_create failed: {}", std::strerror(errno))};
+
+            return fd;
+        }
+#endif
+    } // namespace detail
+
+    memfd_executable::memfd_executable(ulib::string_view name, const void *image, size_t size)
+        : mHandle(-1), mSize(size), mName(name)
+    {
+        mName.MarkZeroEnd();
+
+#ifdef __linux__
+        mHandle = detail::memfd_create_executable(mName.c_str());
+
+        // one allocation up front, the writes below never extend the file piecemeal
+        if (::ftruncate(mHandle, off_t(size)) == -1)
+        {
+            int error = errno;
+            close();
+            throw process_internal_error{ulib::format("ftruncate failed: {}", std::strerror(error))};
+        }
+
+        const char *data = (const char *)image;
+        size_t written = 0;
+        while (written < size)
+        {
+            ssize_t rv = ::pwrite(mHandle, data + written, size - written, off_t(written));
+            if (rv == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                int error = errno;
+                close();
+                throw process_internal_error{ulib::format("memfd write failed: {}", std::strerror(error))};
+            }
+
+            written += size_t(rv);
+        }
+
+        if (::fcntl(mHandle, F_ADD_SEALS, detail::memfd_exec_seals | F_SEAL_SEAL) == -1)
+        {
+            int error = errno;
+            close();
+            throw process_internal_error{ulib::format("sealing memfd failed: {}", std::strerror(error))};
+        }
+#else
+        (void)image;
+        throw process_internal_error{"memfd executables are only supported on linux"};
+#endif
+    }
+
+    memfd_executable::memfd_executable(memfd_executable &&other)
+        : mHandle(other.mHandle), mSize(other.mSize), mName(std::move(other.mName))
+    {
+        other.mHandle = -1;
+        other.mSize = 0;
+    }
+
+    memfd_executable &memfd_executable::operator=(memfd_executable &&other)
+    {
+        close();
+
+        mHandle = other.mHandle;
+        mSize = other.mSize;
+        mName = std::move(other.mName);
+        other.mHandle = -1;
+        other.mSize = 0;
+
+        return *this;
+    }
+
+    memfd_executable memfd_executable::adopt(ulib::string_view name, int fd)
+    {
+#ifdef __linux__
+        int seals = ::fcntl(fd, F_GET_SEALS);
+        if (seals == -1 || (seals & detail::memfd_exec_seals) != detail::memfd_exec_seals)
+            throw process_invalid_options_error{"memfd must be sealed against writes, shrinking and growing"};
+
+        struct stat st;
+        if (::fstat(fd, &st) == -1)
+            throw process_internal_error{ulib::format("fstat failed: {}", std::strerror(errno))};
+
+        memfd_executable result;
+        result.mHandle = fd;
+        result.mSize = size_t(st.st_size);
+        result.mName = name;
+        result.mName.MarkZeroEnd();
+        return result;
+#else
+        (void)name;
+        (void)fd;
+        throw process_internal_error{"memfd executables are only supported on linux"};
+#endif
+    }
+
+    const memfd_executable &memfd_executable::cached(ulib::string_view name, const void *image, size_t size)
+    {
+        using cache_key = std::pair<const void *, size_t>;
+
+        // never destroyed: children may still be spawned from static destructors
+        static std::mutex *mutex = new std::mutex;
+        static auto *cache = new std::map<cache_key, std::unique_ptr<memfd_executable>>;
+
+        std::lock_guard lock{*mutex};
+
+        auto &entry = (*cache)[cache_key{image, size}];
+        if (!entry)
+            entry = std::make_unique<memfd_executable>(name, image, size);
+
+        return *entry;
+    }
+
+    void memfd_executable::close()
+    {
+        if (mHandle != -1)
+        {
+            ::close(mHandle);
+            mHandle = -1;
+        }
+    }
+
+    mapped_output::mapped_output(int fd) : mData(nullptr), mSize(0)
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == -1)
+            throw process_internal_error{ulib::format("fstat failed: {}", std::strerror(errno))};
+
+        // mmap refuses empty mappings, an empty view needs none
+        if (st.st_size == 0)
+            return;
+
+        void *mapping = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+            throw process_internal_error{ulib::format("mmap failed: {}", std::strerror(errno))};
+
+        mData = (const char *)mapping;
+        mSize = size_t(st.st_size);
+    }
+
+    mapped_output::mapped_output(mapped_output &&other) : mData(other.mData), mSize(other.mSize)
+    {
+        other.mData = nullptr;
+        other.mSize = 0;
+    }
+
+    mapped_output &mapped_output::operator=(mapped_output &&other)
+    {
+        reset();
+
+        mData = other.mData;
+        mSize = other.mSize;
+        other.mData = nullptr;
+        other.mSize = 0;
+
+        return *this;
+    }
+
+    void mapped_output::reset()
+    {
+        if (mData)
+        {
+            ::munmap((void *)mData, mSize);
+            mData = nullptr;
+            mSize = 0;
+        }
+    }
+
+    memory_capture &memory_capture::operator=(memory_capture &&other)
+    {
+        close();
+
+        mHandle = other.mHandle;
+        other.mHandle = -1;
+
+        return *this;
+    }
+
+    memory_capture memory_capture::create()
+    {
+        memory_capture result;
+
+#ifdef __linux__
+        result.mHandle = int(::syscall(__NR_memfd_create, "ulib-process-capture", MFD_CLOEXEC));
+        if (result.mHandle != -1)
+            return result;
+
+        if (errno != ENOSYS)
+            throw process_internal_error{ulib::format("memfd_create failed: {}", std::strerror(errno))};
+#endif
+
+        const char *dir = std::getenv("TMPDIR");
+        ulib::string path = ulib::format("{}/ulib-process-capture-XXXXXX", dir && *dir ? dir : "/tmp");
+        path.MarkZeroEnd();
+
+        // close-on-exec from the start, setting it afterwards would race with spawns on other threads
+        result.mHandle = ::mkostemp(path.data(), O_CLOEXEC);
+        if (result.mHandle == -1)
+            throw process_internal_error{ulib::format("mkostemp failed: {}", std::strerror(errno))};
+
+        ::unlink(path.c_str());
+        return result;
+    }
+
+    void memory_capture::close()
+    {
+        if (mHandle != -1)
+        {
+            ::close(mHandle);
+            mHandle = -1;
+        }
+    }
+
+    size_t memory_capture::size() const
+    {
+        struct stat st;
+        if (::fstat(mHandle, &st) == -1)
+            throw process_internal_error{ulib::format("fstat failed: {}", std::strerror(errno))};
+
+        return size_t(st.st_size);
+    }
+
+    mapped_output memory_capture::map() const
+    {
+        if (mHandle == -1)
+            throw process_internal_error{"memory capture is not open"};
+
+        return mapped_output{mHandle};
+    }
+} // namespace ulib
+
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <cstddef>
+#include <span>
+
+namespace ulib
+{
+    // An executable image in a sealed memfd, run with process(exe, args) through execveat(AT_EMPTY_PATH) without
+    // touching the filesystem. The seals make the image immutable, so one memfd serves any number of launches and
+    // threads. The descriptor is close-on-exec: ELF images run fine, but #! scripts fail since the interpreter
+    // cannot reopen it. Linux only, elsewhere creating one throws.
+    class memfd_executable
+    {
+    public:
+        memfd_executable() : mHandle(-1), mSize(0) {}
+
+        // copies image into a new memfd and seals it against writes, shrinking and growing; name is argv[0] and
+        // shows up as /memfd:name in /proc/<pid>/exe
+        memfd_executable(ulib::string_view name, const void *image, size_t size);
+        memfd_executable(ulib::string_view name, std::span<const std::byte> image)
+            : memfd_executable(name, image.data(), image.size())
+        {
+        }
+
+        memfd_executable(const memfd_executable &) = delete;
+        memfd_executable(memfd_executable &&other);
+        ~memfd_executable() { close(); }
+
+        memfd_executable &operator=(memfd_executable &&other);
+
+        // takes ownership of fd, which must already be sealed against writes, shrinking and growing
+        static memfd_executable adopt(ulib::string_view name, int fd);
+
+        // One memfd per image for the life of the process, keyed by the address and size of image: meant for
+        // images embedded in the binary, later calls do no copying or system calls at all.
+        static const memfd_executable &cached(ulib::string_view name, const void *image, size_t size);
+
+        inline int native_handle() const { return mHandle; }
+        inline bool is_open() const { return mHandle != -1; }
+        inline size_t size() const { return mSize; }
+        inline const ulib::string &name() const { return mName; }
+        void close();
+
+    private:
+        int mHandle;
+        size_t mSize;
+        ulib::string mName;
+    };
+
+    // Read-only mapping of a whole file, pages are loaded lazily as they are touched. Stays valid after the file
+    // and the process that wrote it are closed, but touching pages the writer has since truncated raises SIGBUS.
+    class mapped_output
+    {
+    public:
+        mapped_output() : mData(nullptr), mSize(0) {}
+        explicit mapped_output(int fd); // borrows fd, maps its current size
+        mapped_output(const mapped_output &) = delete;
+        mapped_output(mapped_output &&other);
+        ~mapped_output() { reset(); }
+
+        mapped_output &operator=(mapped_output &&other);
+
+        inline const char *data() const { return mData; }
+        inline size_t size() const { return mSize; }
+        inline bool empty() const { return mSize == 0; }
+        inline ulib::string_view view() const { return ulib::string_view{mData, mData + mSize}; }
+        inline std::span<const std::byte> bytes() const { return {(const std::byte *)mData, mSize}; }
+        void reset();
+
+    private:
+        const char *mData;
+        size_t mSize;
+    };
+
+    // An anonymous in-memory file: a memfd, or an unlinked temporary file where there is no memfd_create. With
+    // process::capture_stdout the child writes to it directly, no pipe and no copy through the parent.
+    class memory_capture
+    {
+    public:
+        memory_capture() : mHandle(-1) {}
+        memory_capture(const memory_capture &) = delete;
+        memory_capture(memory_capture &&other) : mHandle(other.mHandle) { other.mHandle = -1; }
+        ~memory_capture() { close(); }
+
+        memory_capture &operator=(memory_capture &&other);
+
+        static memory_capture create(); // close-on-exec
+
+        inline int native_handle() const { return mHandle; }
+        inline bool is_open() const { return mHandle != -1; }
+        void close();
+
+        size_t size() const; // bytes written so far
+        mapped_output map() const;
+
+    private:
+        int mHandle;
+    };
+} // namespace ulib
+
+#endif
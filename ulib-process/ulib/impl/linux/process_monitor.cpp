@@ -0,0 +1,319 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_monitor.h"
+#include "process.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cstring>
+#include <ulib/format.h>
+
+namespace ulib
+{
+    namespace detail
+    {
+        uint64 parse_u64(const char *&p, const char *end)
+        {
+            while (p < end && *p == ' ')
+                p++;
+
+            uint64 value = 0;
+            while (p < end && *p >= '0' && *p <= '9')
+                value = value * 10 + uint64(*p++ - '0');
+
+            return value;
+        }
+
+        void skip_fields(const char *&p, const char *end, int count)
+        {
+            for (int i = 0; i < count && p < end; i++)
+            {
+                while (p < end && *p == ' ')
+                    p++;
+                while (p < end && *p != ' ')
+                    p++;
+            }
+        }
+
+        uint64 io_field(const char *buf, const char *end, const char *key)
+        {
+            size_t len = std::strlen(key);
+            for (const char *p = buf; p < end;)
+            {
+                const char *line = p;
+                while (p < end && *p != '\n')
+                    p++;
+
+                if (size_t(p - line) > len && std::memcmp(line, key, len) == 0 && line[len] == ':')
+                {
+                    const char *value = line + len + 1;
+                    return parse_u64(value, p);
+                }
+
+                p++;
+            }
+
+            return 0;
+        }
+    } // namespace detail
+
+    process_monitor::process_monitor() : process_monitor(options{}) {}
+
+    process_monitor::process_monitor(const options &opts) : mOptions(opts)
+    {
+        mClockTicks = ::sysconf(_SC_CLK_TCK);
+        mPageSize = ::sysconf(_SC_PAGESIZE);
+        mStopping = false;
+    }
+
+    process_monitor::~process_monitor()
+    {
+        stop();
+
+        for (auto &e : mEntries)
+            close_entry(e);
+    }
+
+    void process_monitor::add(process &proc, std::optional<rss_limit> limit) { add(proc.pid(), limit); }
+
+    void process_monitor::add(int pid, std::optional<rss_limit> limit)
+    {
+        entry e;
+        e.statFd = ::open(ulib::format("/proc/{}/stat", pid).c_str(), O_RDONLY | O_CLOEXEC);
+        if (e.statFd == -1)
+            throw process_internal_error{ulib::format("failed to open /proc/{}/stat", pid)};
+
+        if (mOptions.sample_io)
+            e.ioFd = ::open(ulib::format("/proc/{}/io", pid).c_str(), O_RDONLY | O_CLOEXEC);
+
+        e.limit = limit;
+        e.sample.pid = pid;
+
+        std::lock_guard lock{mMutex};
+        sample_entry(e, std::chrono::steady_clock::now());
+        e.sample.cpu_percent = 0;
+
+        auto it = mIndex.find(pid);
+        if (it != mIndex.end())
+        {
+            close_entry(mEntries[it->second]);
+            mEntries[it->second] = std::move(e);
+            return;
+        }
+
+        mIndex[pid] = mEntries.size();
+        mEntries.push_back(std::move(e));
+    }
+
+    void process_monitor::remove(int pid)
+    {
+        std::lock_guard lock{mMutex};
+
+        auto it = mIndex.find(pid);
+        if (it == mIndex.end())
+            return;
+
+        size_t idx = it->second;
+        mIndex.erase(it);
+        close_entry(mEntries[idx]);
+
+        if (idx != mEntries.size() - 1)
+        {
+            mEntries[idx] = std::move(mEntries.back());
+            mIndex[mEntries[idx].sample.pid] = idx;
+        }
+
+        mEntries.pop_back();
+    }
+
+    size_t process_monitor::size() const
+    {
+        std::lock_guard lock{mMutex};
+        return mEntries.size();
+    }
+
+    void process_monitor::on_terminate(callback cb)
+    {
+        std::lock_guard lock{mMutex};
+        mOnTerminate = std::move(cb);
+    }
+
+    void process_monitor::start()
+    {
+        if (mThread.joinable())
+            return;
+
+        mStopping = false;
+        mThread = std::thread{[this] { thread_main(); }};
+    }
+
+    void process_monitor::stop()
+    {
+        if (!mThread.joinable())
+            return;
+
+        {
+            std::lock_guard lock{mMutex};
+            mStopping = true;
+        }
+
+        mWake.notify_all();
+        mThread.join();
+    }
+
+    void process_monitor::tick()
+    {
+        callback cb;
+        std::vector<process_sample> killed;
+        {
+            std::lock_guard lock{mMutex};
+
+            auto now = std::chrono::steady_clock::now();
+            for (auto &e : mEntries)
+                sample_entry(e, now);
+
+            if (mKilled.empty())
+                return;
+
+            killed.swap(mKilled);
+            cb = mOnTerminate;
+        }
+
+        // outside the lock, so callbacks may call back into the monitor
+        if (cb)
+            for (auto &s : killed)
+                cb(s);
+    }
+
+    std::optional<process_sample> process_monitor::sample(int pid) const
+    {
+        std::lock_guard lock{mMutex};
+
+        auto it = mIndex.find(pid);
+        if (it == mIndex.end())
+            return std::nullopt;
+
+        return mEntries[it->second].sample;
+    }
+
+    ulib::list<process_sample> process_monitor::snapshot() const
+    {
+        ulib::list<process_sample> result;
+
+        std::lock_guard lock{mMutex};
+        for (auto &e : mEntries)
+            result.push_back(e.sample);
+
+        return result;
+    }
+
+    void process_monitor::close_entry(entry &e)
+    {
+        if (e.statFd != -1)
+        {
+            ::close(e.statFd);
+            e.statFd = -1;
+        }
+
+        if (e.ioFd != -1)
+        {
+            ::close(e.ioFd);
+            e.ioFd = -1;
+        }
+    }
+
+    void process_monitor::sample_entry(entry &e, std::chrono::steady_clock::time_point now)
+    {
+        process_sample &s = e.sample;
+        if (!s.alive && s.time.time_since_epoch().count() != 0)
+            return; // exited, keep the last sample
+
+        char buf[1024];
+        ssize_t rv = ::pread(e.statFd, buf, sizeof(buf), 0);
+        if (rv <= 0)
+        {
+            s.alive = false;
+            s.cpu_percent = 0;
+            s.time = now;
+            return;
+        }
+
+        // "pid (comm) state ppid ..." - comm may contain spaces and parentheses, fields start after the last ')'
+        const char *end = buf + rv;
+        const char *p = end;
+        while (p > buf && *(p - 1) != ')')
+            p--;
+
+        if (p + 2 > end)
+            return;
+
+        p++; // space
+        s.state = *p++;
+
+        detail::skip_fields(p, end, 10); // ppid .. cmajflt
+        uint64 ticks = detail::parse_u64(p, end); // utime
+        ticks += detail::parse_u64(p, end);       // stime
+        detail::skip_fields(p, end, 4);           // cutime cstime priority nice
+        s.threads = uint32(detail::parse_u64(p, end));
+        detail::skip_fields(p, end, 3); // itrealvalue starttime vsize
+        s.rss_bytes = detail::parse_u64(p, end) * uint64(mPageSize);
+
+        double elapsed = std::chrono::duration<double>(now - s.time).count();
+        if (s.time.time_since_epoch().count() != 0 && elapsed > 0 && ticks >= e.lastTicks)
+            s.cpu_percent = double(ticks - e.lastTicks) / double(mClockTicks) / elapsed * 100.0;
+
+        e.lastTicks = ticks;
+        s.alive = s.state != 'Z' && s.state != 'X';
+        s.time = now;
+
+        if (e.ioFd != -1)
+        {
+            rv = ::pread(e.ioFd, buf, sizeof(buf), 0);
+            if (rv > 0)
+            {
+                s.io_read_bytes = detail::io_field(buf, buf + rv, "rchar");
+                s.io_write_bytes = detail::io_field(buf, buf + rv, "wchar");
+                s.disk_read_bytes = detail::io_field(buf, buf + rv, "read_bytes");
+                s.disk_write_bytes = detail::io_field(buf, buf + rv, "write_bytes");
+            }
+        }
+
+        if (!e.limit || !s.alive || s.terminated)
+            return;
+
+        if (s.rss_bytes <= e.limit->max_rss_bytes)
+        {
+            e.overSince.reset();
+            return;
+        }
+
+        if (!e.overSince)
+            e.overSince = now;
+
+        if (now - *e.overSince >= e.limit->grace)
+        {
+            if (::kill(s.pid, e.limit->signal) == 0)
+            {
+                s.terminated = true;
+                mKilled.push_back(s);
+            }
+        }
+    }
+
+    void process_monitor::thread_main()
+    {
+        std::unique_lock lock{mMutex};
+        while (!mStopping)
+        {
+            lock.unlock();
+            tick();
+            lock.lock();
+
+            mWake.wait_for(lock, mOptions.interval, [this] { return mStopping; });
+        }
+    }
+} // namespace ulib
+
+#endif
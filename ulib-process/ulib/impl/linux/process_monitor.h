@@ -0,0 +1,117 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <signal.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ulib
+{
+    class process;
+
+    struct process_sample
+    {
+        int pid = 0;
+        bool alive = false; // false once the child exited (zombie) or was reaped
+        char state = '?';   // /proc/<pid>/stat state letter
+
+        double cpu_percent = 0; // over the last interval, 100 is one full core
+        uint64 rss_bytes = 0;
+        uint32 threads = 0;
+
+        // /proc/<pid>/io, only with process_monitor::options::sample_io
+        uint64 io_read_bytes = 0;  // rchar, everything passed to read-like calls
+        uint64 io_write_bytes = 0; // wchar
+        uint64 disk_read_bytes = 0;
+        uint64 disk_write_bytes = 0;
+
+        bool terminated = false; // killed by a monitor policy
+        std::chrono::steady_clock::time_point time;
+    };
+
+    // terminate the child once its RSS stayed above max_rss_bytes for longer than grace
+    struct rss_limit
+    {
+        uint64 max_rss_bytes;
+        std::chrono::milliseconds grace{0};
+        int signal = SIGKILL;
+    };
+
+    // Samples registered children from a single thread. /proc files are opened once per child and
+    // re-read with pread(2), a tick costs one syscall per child (two with sample_io) and no allocations.
+    class process_monitor
+    {
+    public:
+        using callback = std::function<void(const process_sample &)>;
+
+        struct options
+        {
+            std::chrono::milliseconds interval{1000};
+            bool sample_io = false;
+        };
+
+        process_monitor();
+        process_monitor(const options &opts);
+        process_monitor(const process_monitor &) = delete;
+        ~process_monitor();
+
+        // the child must stay unreaped (or be removed) while registered, otherwise its pid may be reused
+        void add(process &proc, std::optional<rss_limit> limit = std::nullopt);
+        void add(int pid, std::optional<rss_limit> limit = std::nullopt);
+        void remove(int pid);
+        size_t size() const;
+
+        // called from the sampling thread after a policy terminated a child
+        void on_terminate(callback cb);
+
+        void start();
+        void stop();
+        inline bool is_running() const { return mThread.joinable(); }
+
+        // samples every child once, done by the monitor thread every interval
+        void tick();
+
+        std::optional<process_sample> sample(int pid) const;
+        ulib::list<process_sample> snapshot() const;
+
+    private:
+        struct entry
+        {
+            int statFd = -1;
+            int ioFd = -1;
+            uint64 lastTicks = 0;
+            std::optional<rss_limit> limit;
+            std::optional<std::chrono::steady_clock::time_point> overSince;
+            process_sample sample;
+        };
+
+        void close_entry(entry &e);
+        void sample_entry(entry &e, std::chrono::steady_clock::time_point now);
+        void thread_main();
+
+        options mOptions;
+        long mClockTicks;
+        long mPageSize;
+
+        mutable std::mutex mMutex;
+        std::vector<entry> mEntries;
+        std::unordered_map<int, size_t> mIndex;
+        std::vector<process_sample> mKilled;
+        callback mOnTerminate;
+
+        std::condition_variable mWake;
+        bool mStopping;
+        std::thread mThread;
+    };
+} // namespace ulib
+
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <filesystem>
+#include <optional>
+#include <sys/resource.h>
+
+#include "process_cgroup.h"
+#include "process_channel.h"
+
+namespace ulib
+{
+    // set_mempolicy(2) applied in the child, values match MPOL_*
+    struct numa_policy
+    {
+        enum mode
+        {
+            default_policy = 0,
+            preferred = 1,
+            bind = 2,
+            interleave = 3,
+            local = 4,
+        };
+
+        mode policy = default_policy;
+        ulib::list<int> nodes;
+    };
+
+    // scheduling policy of the child, values match SCHED_*
+    enum class sched_policy
+    {
+        other = 0,
+        batch = 3,
+        idle = 5,
+    };
+
+    // ioprio_set(2) class and level (0 is the highest priority, 7 the lowest)
+    struct io_priority
+    {
+        enum io_class
+        {
+            realtime = 1,
+            best_effort = 2,
+            idle = 3,
+        };
+
+        io_class cls = best_effort;
+        int level = 4;
+    };
+
+    // setrlimit(2) applied in the child, e.g. {RLIMIT_NOFILE, 1024, 1024}
+    struct resource_limit
+    {
+        int resource;
+        rlim_t soft;
+        rlim_t hard;
+    };
+
+    // TIOCSWINSZ for process::pty
+    struct terminal_size
+    {
+        uint32 rows = 24;
+        uint32 cols = 80;
+    };
+
+    // Installs a descriptor in the child at child_fd, besides the stdio wired up by process::flag
+    struct fd_mapping
+    {
+        enum kind
+        {
+            inherit,      // parent_fd of this process, which stays open here
+            child_input,  // a new pipe the child reads from, written through process::input(child_fd)
+            child_output, // a new pipe the child writes to, read through process::output(child_fd)
+        };
+
+        int child_fd;
+        kind type = inherit;
+        int parent_fd = -1;
+
+        static fd_mapping from_parent(int parent_fd, int child_fd) { return {child_fd, inherit, parent_fd}; }
+        static fd_mapping input(int child_fd) { return {child_fd, child_input}; }
+        static fd_mapping output(int child_fd) { return {child_fd, child_output}; }
+    };
+
+    // Linux-only spawn settings that do not fit into process::flag. Everything here is prepared in the
+    // parent, so the child only issues syscalls between fork and exec.
+    struct spawn_options
+    {
+        // place the child into an existing group owned by the caller
+        cgroup *group = nullptr;
+
+        // place the child into its own cgroup with these limits, removed once the child is reaped;
+        // created under cgroup_parent, or under the cgroup of this process when empty. Spawning throws
+        // process_invalid_options_error when the limits cannot be applied, which is usually the case for the
+        // default: a cgroup holding processes (ours) cannot delegate controllers to its children.
+        std::optional<cgroup_limits> limits;
+        std::filesystem::path cgroup_parent;
+
+        // sched_setaffinity(2) for the child, empty keeps the inherited mask
+        ulib::list<int> cpus;
+
+        // NUMA memory policy, ignored on kernels without NUMA support
+        std::optional<numa_policy> memory_policy;
+
+        // applied in this order: rlimits, scheduler, nice, io priority
+        ulib::list<resource_limit> rlimits;
+        std::optional<sched_policy> scheduler;
+        std::optional<int> nice;
+        std::optional<io_priority> io;
+
+        // count cycles, instructions, cache and branch misses and task-clock from exec to exit,
+        // reported in wait_result::perf
+        bool profile = false;
+
+        // connect the piped stdio through AF_UNIX socketpairs instead of pipes, so in()/out()/err() can carry
+        // descriptors (see send_fds) and the child may use them in both directions
+        std::optional<socket_kind> stdio_sockets;
+
+        // an extra socketpair: the child's end is installed as descriptor channel_fd (> 2), ours is
+        // process::channel()
+        std::optional<socket_kind> channel;
+        int channel_fd = 3;
+
+        // terminal created by process::pty; without echo what is written to in() does not come back on out().
+        // Output still goes through the line discipline, so newlines arrive as "\r\n".
+        terminal_size pty_size;
+        bool pty_echo = false;
+
+        // more descriptors for the child, e.g. fd_mapping::output(3) for a tool taking --status-fd=3. Targets
+        // must be distinct and not already taken by piped stdio or the channel; sources may overlap targets in
+        // any order, cycles included. Only the targets lose close-on-exec.
+        ulib::list<fd_mapping> fds;
+    };
+} // namespace ulib
+
+#endif
@@ -0,0 +1,186 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_perf.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <ulib/format.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ulib
+{
+    namespace detail
+    {
+#ifdef __linux__
+        struct perf_counter_desc
+        {
+            uint32 type;
+            uint64 config;
+        };
+
+        // order matches perf_counters fields
+        constexpr perf_counter_desc perf_counter_descs[perf_session::counter_count] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        };
+
+        int perf_open(const perf_counter_desc &desc, int pid, bool excludeKernel)
+        {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = desc.type;
+            attr.config = desc.config;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.disabled = 1;
+            attr.enable_on_exec = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = excludeKernel;
+            attr.exclude_hv = excludeKernel;
+
+            return int(::syscall(__NR_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+
+        ulib::string perf_paranoid_hint()
+        {
+            char buf[16] = {};
+            int fd = ::open("/proc/sys/kernel/perf_event_paranoid", O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                return {};
+
+            ssize_t rv = ::read(fd, buf, sizeof(buf) - 1);
+            ::close(fd);
+            if (rv <= 0)
+                return {};
+
+            return ulib::format(" (perf_event_paranoid = {})", std::atoi(buf));
+        }
+#endif
+    } // namespace detail
+
+    detail::perf_session::perf_session()
+    {
+        for (auto &fd : mFds)
+            fd = -1;
+        mOpened = false;
+    }
+
+    detail::perf_session::perf_session(perf_session &&other) : perf_session() { *this = std::move(other); }
+
+    detail::perf_session::~perf_session() { close(); }
+
+    detail::perf_session &detail::perf_session::operator=(perf_session &&other)
+    {
+        close();
+
+        for (size_t i = 0; i < counter_count; i++)
+        {
+            mFds[i] = other.mFds[i];
+            other.mFds[i] = -1;
+        }
+
+        mError = std::move(other.mError);
+        mOpened = other.mOpened;
+        other.mOpened = false;
+
+        return *this;
+    }
+
+    void detail::perf_session::open(int pid)
+    {
+        close();
+        mOpened = true;
+        mError = ulib::string{};
+
+#ifdef __linux__
+        bool excludeKernel = false;
+        int lastError = 0;
+        for (size_t i = 0; i < counter_count; i++)
+        {
+            mFds[i] = perf_open(perf_counter_descs[i], pid, excludeKernel);
+            if (mFds[i] == -1 && (errno == EACCES || errno == EPERM) && !excludeKernel)
+            {
+                // perf_event_paranoid >= 2 still allows user-space only counting
+                excludeKernel = true;
+                mFds[i] = perf_open(perf_counter_descs[i], pid, excludeKernel);
+            }
+
+            if (mFds[i] == -1)
+                lastError = errno;
+        }
+
+        for (auto fd : mFds)
+            if (fd != -1)
+                return;
+
+        mError = ulib::format("perf_event_open failed: {}{}", ::strerror(lastError),
+                              lastError == EACCES || lastError == EPERM ? perf_paranoid_hint() : ulib::string{});
+#else
+        mError = "perf_event_open is only supported on linux";
+#endif
+    }
+
+    perf_counters detail::perf_session::read()
+    {
+        perf_counters result;
+        if (!mOpened)
+        {
+            result.error = "profiling was not requested";
+            return result;
+        }
+
+        result.error = mError;
+
+        std::optional<uint64> values[counter_count];
+        for (size_t i = 0; i < counter_count; i++)
+        {
+            if (mFds[i] == -1)
+                continue;
+
+            // value, time enabled, time running
+            uint64 data[3] = {};
+            if (::read(mFds[i], data, sizeof(data)) != ssize_t(sizeof(data)))
+                continue;
+
+            result.available = true;
+            if (data[2] == 0)
+                values[i] = data[0];
+            else
+                values[i] = uint64(double(data[0]) * double(data[1]) / double(data[2]));
+        }
+
+        result.cycles = values[0];
+        result.instructions = values[1];
+        result.cache_misses = values[2];
+        result.branch_misses = values[3];
+        if (values[4])
+            result.task_clock = std::chrono::nanoseconds{*values[4]};
+
+        close();
+        return result;
+    }
+
+    void detail::perf_session::close()
+    {
+        for (auto &fd : mFds)
+        {
+            if (fd != -1)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        mOpened = false;
+    }
+} // namespace ulib
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <chrono>
+#include <optional>
+
+namespace ulib
+{
+    // Hardware and software counters of a child and everything it forked, scaled for multiplexing.
+    // Single counters stay empty when the CPU or hypervisor does not expose them.
+    struct perf_counters
+    {
+        bool available = false; // false when perf_event_open(2) is forbidden or unsupported
+        ulib::string error;     // why the counters are unavailable
+
+        std::optional<uint64> cycles;
+        std::optional<uint64> instructions;
+        std::optional<uint64> cache_misses;
+        std::optional<uint64> branch_misses;
+        std::optional<std::chrono::nanoseconds> task_clock;
+    };
+
+    namespace detail
+    {
+        class perf_session
+        {
+        public:
+            static constexpr size_t counter_count = 5;
+
+            perf_session();
+            perf_session(const perf_session &) = delete;
+            perf_session(perf_session &&other);
+            ~perf_session();
+
+            perf_session &operator=(perf_session &&other);
+
+            // attaches inherited counters to a child that has not exec'd yet, they start counting on exec;
+            // never throws, failures are reported by read()
+            void open(int pid);
+            perf_counters read();
+            void close();
+
+            inline bool is_open() const { return mOpened; }
+
+        private:
+            int mFds[counter_count];
+            ulib::string mError;
+            bool mOpened;
+        };
+    } // namespace detail
+} // namespace ulib
+
+#endif
@@ -0,0 +1,152 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_placement.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "../../process_exceptions.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+        ulib::list<int> parse_cpu_list(ulib::string_view str)
+        {
+            ulib::list<int> result;
+
+            size_t pos = 0;
+            while (pos < str.size())
+            {
+                size_t end = str.find(',', pos);
+                if (end == ulib::npos)
+                    end = str.size();
+
+                std::string range{str.data() + pos, end - pos};
+                if (!range.empty() && range.back() == '\n')
+                    range.pop_back();
+
+                if (!range.empty())
+                {
+                    char *next = nullptr;
+                    long first = std::strtol(range.c_str(), &next, 10);
+                    long last = first;
+                    if (*next == '-')
+                        last = std::strtol(next + 1, nullptr, 10);
+
+                    for (long i = first; i <= last; i++)
+                        result.push_back(int(i));
+                }
+
+                pos = end + 1;
+            }
+
+            return result;
+        }
+
+        std::string read_sys_line(const std::filesystem::path &path)
+        {
+            std::ifstream file{path};
+            std::string line;
+            std::getline(file, line);
+            return line;
+        }
+    } // namespace detail
+
+    cpu_topology cpu_topology::current()
+    {
+        cpu_topology result;
+
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (::sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+            throw process_internal_error{"sched_getaffinity failed"};
+
+        auto is_allowed = [&](int cpu) { return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed); };
+
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator{"/sys/devices/system/node", ec})
+        {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit((unsigned char)name[4]))
+                continue;
+
+            numa_node node{std::atoi(name.c_str() + 4), {}};
+            for (int cpu : detail::parse_cpu_list(detail::read_sys_line(entry.path() / "cpulist")))
+                if (is_allowed(cpu))
+                    node.cpus.push_back(cpu);
+
+            if (node.cpus.size())
+                result.mNodes.push_back(std::move(node));
+        }
+
+        std::sort(result.mNodes.begin(), result.mNodes.end(),
+                  [](const numa_node &a, const numa_node &b) { return a.id < b.id; });
+
+        if (result.mNodes.size() == 0)
+        {
+            numa_node node{0, {}};
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (is_allowed(cpu))
+                    node.cpus.push_back(cpu);
+
+            result.mNodes.push_back(std::move(node));
+        }
+
+        // hyperthread siblings go last, so the first children each get a physical core of their own
+        std::vector<std::pair<int, int>> order; // (sibling rank, cpu)
+        for (auto &node : result.mNodes)
+        {
+            for (int cpu : node.cpus)
+            {
+                auto siblings = detail::parse_cpu_list(detail::read_sys_line(
+                    std::filesystem::path{"/sys/devices/system/cpu"} / ("cpu" + std::to_string(cpu)) / "topology" /
+                    "thread_siblings_list"));
+
+                auto it = std::find(siblings.begin(), siblings.end(), cpu);
+                int rank = it == siblings.end() ? 0 : int(it - siblings.begin());
+                order.push_back({rank, cpu});
+            }
+        }
+
+        std::sort(order.begin(), order.end());
+        for (auto &[rank, cpu] : order)
+            result.mCpus.push_back(cpu);
+#endif
+
+        return result;
+    }
+
+    void cpu_topology::place(spawn_options &options, size_t index, spread_mode mode) const
+    {
+        if (mNodes.size() == 0 || mCpus.size() == 0)
+            throw process_invalid_options_error{"cpu topology is empty"};
+
+        options.cpus = ulib::list<int>{};
+
+        if (mode == by_core)
+        {
+            options.cpus.push_back(mCpus[index % mCpus.size()]);
+            return;
+        }
+
+        const numa_node &node = mNodes[index % mNodes.size()];
+        options.cpus = node.cpus;
+
+        numa_policy policy;
+        policy.policy = numa_policy::preferred;
+        policy.nodes.push_back(node.id);
+        options.memory_policy = policy;
+    }
+} // namespace ulib
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+
+#include "process_options.h"
+
+namespace ulib
+{
+    struct numa_node
+    {
+        int id;
+        ulib::list<int> cpus;
+    };
+
+    // CPUs and NUMA nodes this process may place children on, read from /sys/devices/system
+    class cpu_topology
+    {
+    public:
+        enum spread_mode
+        {
+            by_core, // one cpu per child, distinct physical cores before hyperthread siblings
+            by_node, // all cpus of one node per child, memory preferred on that node
+        };
+
+        cpu_topology() = default;
+
+        // restricted to the affinity mask of the calling process; a machine without node information
+        // is reported as a single node 0
+        static cpu_topology current();
+
+        inline const ulib::list<numa_node> &nodes() const { return mNodes; }
+        inline const ulib::list<int> &cpus() const { return mCpus; }
+
+        // fills placement options for the index-th child of a batch, round-robin over cores or nodes
+        void place(spawn_options &options, size_t index, spread_mode mode) const;
+
+    private:
+        ulib::list<numa_node> mNodes;
+        ulib::list<int> mCpus; // in by_core spreading order
+    };
+
+    namespace detail
+    {
+        // parses the kernel cpu/node list format, e.g. "0-3,8,10-11"
+        ulib::list<int> parse_cpu_list(ulib::string_view str);
+    } // namespace detail
+} // namespace ulib
+
+#endif
@@ -0,0 +1,301 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_reaper.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#include <vector>
+
+#include "../../process_exceptions.h"
+#include "../trace_hooks.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+        int reaper_code(const siginfo_t &info)
+        {
+            if (info.si_code == CLD_EXITED)
+                return info.si_status;
+
+            return 128 + info.si_status;
+        }
+    } // namespace detail
+
+    process_reaper &process_reaper::instance()
+    {
+        // never destroyed: children may still be handed over from static destructors
+        static process_reaper *reaper = new process_reaper;
+        return *reaper;
+    }
+
+    process_reaper::process_reaper()
+    {
+        mNextId = 1;
+        mDispatching = 0;
+        mPolled = 0;
+        mEpoll = -1;
+        mWakeFd = -1;
+
+#ifdef __linux__
+        mEpoll = ::epoll_create1(EPOLL_CLOEXEC);
+        mWakeFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (mEpoll == -1 || mWakeFd == -1)
+            throw process_internal_error{"failed to create reaper epoll"};
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        if (::epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWakeFd, &ev) == -1)
+            throw process_internal_error{"failed to register reaper eventfd"};
+#endif
+
+        std::thread thread([this] { this->run(); });
+        mThreadId = thread.get_id();
+        thread.detach();
+    }
+
+    void process_reaper::adopt(int pid, int pidfd, callback cb, bool trace_exit)
+    {
+        this->add(pid, pidfd, true, trace_exit, std::move(cb));
+    }
+
+    process_reaper::watch_id process_reaper::watch(int pid, int pidfd, callback cb)
+    {
+        int fd = pidfd == -1 ? -1 : ::fcntl(pidfd, F_DUPFD_CLOEXEC, 0);
+        return this->add(pid, fd, false, false, std::move(cb));
+    }
+
+    process_reaper::watch_id process_reaper::add(int pid, int pidfd, bool reap, bool traceExit, callback cb)
+    {
+        std::lock_guard lock{mMutex};
+
+        watch_id id = mNextId++;
+
+#ifdef __linux__
+        if (pidfd != -1)
+        {
+            struct epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = id;
+            if (::epoll_ctl(mEpoll, EPOLL_CTL_ADD, pidfd, &ev) == -1)
+            {
+                ::close(pidfd);
+                pidfd = -1;
+            }
+        }
+#else
+        if (pidfd != -1)
+        {
+            ::close(pidfd);
+            pidfd = -1;
+        }
+#endif
+
+        mEntries.emplace(id, entry{pid, pidfd, reap, false, traceExit, std::move(cb)});
+
+        if (pidfd == -1)
+        {
+            // the thread may be sleeping without a timeout
+            if (mPolled++ == 0)
+            {
+#ifdef __linux__
+                uint64_t one = 1;
+                ssize_t rv = ::write(mWakeFd, &one, sizeof(one));
+                (void)rv;
+#endif
+                mCondition.notify_all();
+            }
+        }
+
+        return id;
+    }
+
+    process_reaper::callback process_reaper::unwatch(watch_id id)
+    {
+        std::unique_lock lock{mMutex};
+        if (std::this_thread::get_id() != mThreadId)
+            mCondition.wait(lock, [&] { return mDispatching != id; });
+
+        auto it = mEntries.find(id);
+        if (it == mEntries.end())
+            return {};
+
+        callback cb = std::move(it->second.cb);
+        remove_fd(it->second);
+        mEntries.erase(it);
+        return cb;
+    }
+
+    bool process_reaper::detach(watch_id id, bool trace_exit)
+    {
+        std::lock_guard lock{mMutex};
+
+        auto it = mEntries.find(id);
+        if (it == mEntries.end() || it->second.collected)
+            return false;
+
+        it->second.reap = true;
+        it->second.traceExit = trace_exit;
+        return true;
+    }
+
+    size_t process_reaper::size()
+    {
+        std::lock_guard lock{mMutex};
+        return mEntries.size();
+    }
+
+    void process_reaper::remove_fd(entry &e)
+    {
+        if (e.pidfd != -1)
+        {
+#ifdef __linux__
+            ::epoll_ctl(mEpoll, EPOLL_CTL_DEL, e.pidfd, nullptr);
+#endif
+            ::close(e.pidfd);
+            e.pidfd = -1;
+        }
+        else if (!e.collected)
+        {
+            mPolled--;
+        }
+    }
+
+    void process_reaper::dispatch(watch_id id)
+    {
+        std::unique_lock lock{mMutex};
+
+        auto it = mEntries.find(id);
+        if (it == mEntries.end() || it->second.collected)
+            return;
+
+        entry &e = it->second;
+
+        // called as the pidfd fires, or on the next poll without one: about when the child exited
+        detail::trace_scope tracing{e.reap};
+        uint64 seen = tracing ? detail::trace_clock() : 0;
+
+        siginfo_t info = {};
+        int rv;
+        do
+        {
+            rv = ::waitid(P_PID, id_t(e.pid), &info, WEXITED | WNOHANG | (e.reap ? 0 : WNOWAIT));
+        } while (rv == -1 && errno == EINTR);
+
+        if (rv == 0 && info.si_pid == 0)
+            return; // still running
+
+        if (rv == -1 && !e.reap)
+        {
+            // the owner reaped it in between, it delivers the callback from unwatch()
+            remove_fd(e);
+            e.collected = true;
+            return;
+        }
+
+        int pid = e.pid;
+        int code = rv == 0 ? detail::reaper_code(info) : -1;
+
+        if (tracing && rv == 0)
+        {
+            if (e.traceExit)
+                detail::trace_record(tracing.ring(), trace_event_type::exit, pid, seen);
+
+            detail::trace_record(tracing.ring(), trace_event_type::reap, pid, detail::trace_clock());
+        }
+        callback cb = std::move(e.cb);
+
+        remove_fd(e);
+        mEntries.erase(it);
+
+        if (!cb)
+            return;
+
+        mDispatching = id;
+        lock.unlock();
+
+        try
+        {
+            cb(pid, code);
+        }
+        catch (...)
+        {
+            // a throwing callback must not take the reaper down
+        }
+
+        lock.lock();
+        mDispatching = 0;
+        mCondition.notify_all();
+    }
+
+    void process_reaper::poll_fallback()
+    {
+        std::vector<watch_id> ids;
+        {
+            std::lock_guard lock{mMutex};
+            for (auto &[id, e] : mEntries)
+                if (e.pidfd == -1 && !e.collected)
+                    ids.push_back(id);
+        }
+
+        for (auto id : ids)
+            this->dispatch(id);
+    }
+
+    void process_reaper::run()
+    {
+        constexpr int pollMs = 20;
+
+#ifdef __linux__
+        struct epoll_event events[256];
+        while (true)
+        {
+            int timeout;
+            {
+                std::lock_guard lock{mMutex};
+                timeout = mPolled ? pollMs : -1;
+            }
+
+            int count = ::epoll_wait(mEpoll, events, 256, timeout);
+            if (count == -1 && errno != EINTR)
+                break;
+
+            for (int i = 0; i < count; i++)
+            {
+                if (events[i].data.u64 == 0)
+                {
+                    uint64_t value;
+                    ssize_t rv = ::read(mWakeFd, &value, sizeof(value));
+                    (void)rv;
+                    continue;
+                }
+
+                this->dispatch(events[i].data.u64);
+            }
+
+            if (timeout != -1)
+                this->poll_fallback();
+        }
+#else
+        while (true)
+        {
+            {
+                std::unique_lock lock{mMutex};
+                mCondition.wait(lock, [&] { return mPolled != 0; });
+            }
+
+            this->poll_fallback();
+            std::this_thread::sleep_for(std::chrono::milliseconds{pollMs});
+        }
+#endif
+    }
+} // namespace ulib
+
+#endif
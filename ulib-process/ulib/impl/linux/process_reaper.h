@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace ulib
+{
+    // Library-wide background reaper. Only pids handed to it are ever waited for (never waitpid(-1)), so it does
+    // not steal statuses from other code. On linux a single thread sleeps in epoll over the children's pidfds;
+    // children without a pidfd (old kernels, macOS) are polled every 20 ms.
+    class process_reaper
+    {
+    public:
+        // code is the exit code, 128 + signal for killed children, or -1 if the status was already collected
+        using callback = std::function<void(int pid, int code)>;
+        using watch_id = uint64;
+
+        static process_reaper &instance();
+
+        // reap pid once it exits, then call cb; takes ownership of pidfd (-1 if there is none). While a tracer is
+        // active the exit and the reap are traced, trace_exit false leaves out an exit traced already.
+        void adopt(int pid, int pidfd, callback cb = {}, bool trace_exit = true);
+
+        // call cb on the reaper thread once pid exits, leaving the status for the owner to collect;
+        // pidfd is borrowed and duplicated
+        watch_id watch(int pid, int pidfd, callback cb);
+
+        // Stops watching. Returns the callback if it has not been called yet, so the owner can deliver it with
+        // the status it collected itself; waits while the callback is running on the reaper thread.
+        callback unwatch(watch_id id);
+
+        // turns a watch into adopt(): the reaper now collects the status before calling back;
+        // false if the callback already ran
+        bool detach(watch_id id, bool trace_exit = true);
+
+        size_t size();
+
+    private:
+        struct entry
+        {
+            int pid;
+            int pidfd;
+            bool reap;
+            bool collected; // the owner reaped it first, only unwatch() is left
+            bool traceExit;
+            callback cb;
+        };
+
+        process_reaper();
+
+        watch_id add(int pid, int pidfd, bool reap, bool traceExit, callback cb);
+        void remove_fd(entry &e);
+        void dispatch(watch_id id);
+        void poll_fallback();
+        void run();
+
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::unordered_map<watch_id, entry> mEntries;
+        watch_id mNextId;
+        watch_id mDispatching;
+        size_t mPolled; // entries without a pidfd
+
+        int mEpoll;
+        int mWakeFd;
+        std::thread::id mThreadId;
+    };
+} // namespace ulib
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <chrono>
+#include <optional>
+
+#include "process_cgroup.h"
+#include "process_perf.h"
+
+namespace ulib
+{
+    // How a child ended and what it cost, collected with wait4(2) when the child is reaped
+    struct wait_result
+    {
+        std::optional<int> exit_code; // set when the child called exit()
+        std::optional<int> signal;    // set when the child was killed by a signal
+        bool core_dumped = false;
+
+        std::chrono::microseconds user_time{};
+        std::chrono::microseconds system_time{};
+        uint64 max_rss_bytes = 0;
+        uint64 minor_faults = 0;
+        uint64 major_faults = 0;
+        uint64 voluntary_switches = 0;
+        uint64 involuntary_switches = 0;
+
+        // monotonic, taken right before spawning and right after reaping
+        std::chrono::steady_clock::time_point start_time;
+        std::chrono::steady_clock::time_point end_time;
+
+        // dedicated cgroup accounting (spawn_options::limits)
+        std::optional<cgroup_stats> cgroup;
+
+        // counters of the child and its descendants (spawn_options::profile)
+        std::optional<perf_counters> perf;
+
+        inline std::chrono::steady_clock::duration wall_time() const { return end_time - start_time; }
+        inline bool succeeded() const { return exit_code && *exit_code == 0; }
+
+        // exit code, or 128 + signal number the way shells report it
+        inline int code() const { return exit_code ? *exit_code : 128 + signal.value_or(0); }
+    };
+} // namespace ulib
+
+#endif
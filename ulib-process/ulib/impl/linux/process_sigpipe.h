@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <pthread.h>
+
+namespace ulib
+{
+    namespace detail
+    {
+        // Blocks SIGPIPE on the calling thread for its lifetime, so writing to a pipe whose reader is gone fails
+        // with EPIPE instead of killing the process. A SIGPIPE raised meanwhile is consumed before the old mask is
+        // restored; one that was already pending belongs to someone else and is left alone. Sockets don't need
+        // it, send(MSG_NOSIGNAL) does the same per call.
+        class sigpipe_guard
+        {
+        public:
+            explicit sigpipe_guard(bool enable = true) : mEnabled(enable), mWasPending(false)
+            {
+                if (!mEnabled)
+                    return;
+
+                sigset_t set;
+                sigemptyset(&set);
+                sigaddset(&set, SIGPIPE);
+                ::pthread_sigmask(SIG_BLOCK, &set, &mOld);
+
+                sigset_t pending;
+                ::sigpending(&pending);
+                mWasPending = sigismember(&pending, SIGPIPE) == 1;
+            }
+            sigpipe_guard(const sigpipe_guard &) = delete;
+
+            ~sigpipe_guard()
+            {
+                if (!mEnabled)
+                    return;
+
+                int error = errno; // the failed write's errno is still to be reported by the caller
+                if (!mWasPending)
+                {
+                    sigset_t pending;
+                    ::sigpending(&pending);
+                    if (sigismember(&pending, SIGPIPE) == 1)
+                    {
+                        sigset_t set;
+                        sigemptyset(&set);
+                        sigaddset(&set, SIGPIPE);
+
+                        struct timespec zero = {0, 0};
+                        while (::sigtimedwait(&set, nullptr, &zero) == -1 && errno == EINTR)
+                        {
+                        }
+                    }
+                }
+
+                ::pthread_sigmask(SIG_SETMASK, &mOld, nullptr);
+                errno = error;
+            }
+
+        private:
+            bool mEnabled;
+            bool mWasPending;
+            sigset_t mOld;
+        };
+    } // namespace detail
+} // namespace ulib
+
+#endif
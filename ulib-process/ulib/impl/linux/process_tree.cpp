@@ -0,0 +1,281 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_tree.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "../../process_exceptions.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+        // numeric directory name, or -1
+        int parse_pid(const char *name)
+        {
+            if (!*name)
+                return -1;
+
+            int pid = 0;
+            for (; *name; name++)
+            {
+                if (*name < '0' || *name > '9')
+                    return -1;
+                pid = pid * 10 + (*name - '0');
+            }
+
+            return pid;
+        }
+
+        void skip_stat_fields(const char *&p, const char *end, int count)
+        {
+            for (int i = 0; i < count && p < end; i++)
+            {
+                while (p < end && *p == ' ')
+                    p++;
+                while (p < end && *p != ' ')
+                    p++;
+            }
+        }
+
+        long long parse_stat_number(const char *&p, const char *end)
+        {
+            while (p < end && *p == ' ')
+                p++;
+
+            bool negative = p < end && *p == '-';
+            if (negative)
+                p++;
+
+            long long value = 0;
+            while (p < end && *p >= '0' && *p <= '9')
+                value = value * 10 + (*p++ - '0');
+
+            return negative ? -value : value;
+        }
+    } // namespace detail
+
+    process_tree::process_tree()
+    {
+        mProcFd = ::open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mProcFd == -1)
+            throw process_internal_error{"failed to open /proc"};
+
+        mGeneration = 0;
+        mKeptFds = 0;
+        mDents.resize(32 * 1024);
+    }
+
+    process_tree::~process_tree()
+    {
+        for (auto &[pid, n] : mNodes)
+            close_node(n);
+
+        ::close(mProcFd);
+    }
+
+    bool process_tree::read_stat(int fd, process_entry &entry)
+    {
+        char buf[512];
+        ssize_t rv = ::pread(fd, buf, sizeof(buf), 0);
+        if (rv <= 0)
+            return false;
+
+        // "pid (comm) state ppid ... starttime" - fields are counted after the last ')'
+        const char *end = buf + rv;
+        const char *p = end;
+        while (p > buf && *(p - 1) != ')')
+            p--;
+
+        if (p == buf || p + 2 > end)
+            return false;
+
+        p++;
+        entry.state = *p++;
+        entry.ppid = int(detail::parse_stat_number(p, end));
+        detail::skip_stat_fields(p, end, 17); // pgrp .. itrealvalue
+        entry.start_time = uint64(detail::parse_stat_number(p, end));
+        return true;
+    }
+
+    void process_tree::close_node(node &n)
+    {
+        if (n.statFd != -1)
+        {
+            ::close(n.statFd);
+            n.statFd = -1;
+            mKeptFds--;
+        }
+    }
+
+    void process_tree::refresh()
+    {
+#ifdef __linux__
+        struct linux_dirent64
+        {
+            uint64 d_ino;
+            int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+
+        mGeneration++;
+
+        if (::lseek(mProcFd, 0, SEEK_SET) == -1)
+            throw process_internal_error{"failed to rewind /proc"};
+
+        while (true)
+        {
+            long rv = ::syscall(SYS_getdents64, mProcFd, mDents.data(), mDents.size());
+            if (rv == -1)
+                throw process_internal_error{"getdents64 on /proc failed"};
+            if (rv == 0)
+                break;
+
+            for (long off = 0; off < rv;)
+            {
+                auto *d = reinterpret_cast<linux_dirent64 *>(mDents.data() + off);
+                off += d->d_reclen;
+
+                if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+                    continue;
+
+                int pid = detail::parse_pid(d->d_name);
+                if (pid <= 0)
+                    continue;
+
+                auto it = mNodes.find(pid);
+                if (it != mNodes.end())
+                {
+                    node &n = it->second;
+                    process_entry fresh = n.entry;
+
+                    // a failed read means the process we had the fd for is gone and the pid was reused
+                    if (n.statFd != -1 && read_stat(n.statFd, fresh) && fresh.start_time == n.entry.start_time)
+                    {
+                        n.entry = fresh;
+                        n.generation = mGeneration;
+                        continue;
+                    }
+
+                    close_node(n);
+                    mNodes.erase(it);
+                }
+
+                char path[32];
+                std::snprintf(path, sizeof(path), "%d/stat", pid);
+
+                int fd = ::openat(mProcFd, path, O_RDONLY | O_CLOEXEC);
+                if (fd == -1)
+                {
+                    if (errno == EMFILE || errno == ENFILE)
+                        throw process_internal_error{"out of descriptors while reading /proc"};
+
+                    continue; // exited in between
+                }
+
+                node n;
+                n.entry.pid = pid;
+                n.generation = mGeneration;
+                n.statFd = -1;
+                if (!read_stat(fd, n.entry))
+                {
+                    ::close(fd);
+                    continue;
+                }
+
+                if (mKeptFds < max_kept_fds)
+                {
+                    n.statFd = fd;
+                    mKeptFds++;
+                }
+                else
+                {
+                    ::close(fd);
+                }
+
+                mNodes.emplace(pid, n);
+            }
+        }
+
+        for (auto it = mNodes.begin(); it != mNodes.end();)
+        {
+            if (it->second.generation != mGeneration)
+            {
+                close_node(it->second);
+                it = mNodes.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        mEdges.clear();
+        for (auto &[pid, n] : mNodes)
+            mEdges.push_back({n.entry.ppid, pid});
+
+        std::sort(mEdges.begin(), mEdges.end());
+#endif
+    }
+
+    bool process_tree::contains(int pid) const { return mNodes.find(pid) != mNodes.end(); }
+
+    const process_entry *process_tree::find(int pid) const
+    {
+        auto it = mNodes.find(pid);
+        if (it == mNodes.end())
+            return nullptr;
+
+        return &it->second.entry;
+    }
+
+    ulib::list<int> process_tree::children(int pid) const
+    {
+        ulib::list<int> result;
+
+        auto it = std::lower_bound(mEdges.begin(), mEdges.end(), std::pair<int, int>{pid, 0});
+        for (; it != mEdges.end() && it->first == pid; ++it)
+            result.push_back(it->second);
+
+        return result;
+    }
+
+    ulib::list<int> process_tree::descendants(int pid) const
+    {
+        ulib::list<int> result = children(pid);
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            int cur = result[i];
+            auto it = std::lower_bound(mEdges.begin(), mEdges.end(), std::pair<int, int>{cur, 0});
+            for (; it != mEdges.end() && it->first == cur; ++it)
+                result.push_back(it->second);
+        }
+
+        return result;
+    }
+
+    ulib::list<process_entry> process_tree::entries() const
+    {
+        ulib::list<process_entry> result;
+        for (auto &[pid, n] : mNodes)
+            result.push_back(n.entry);
+
+        std::sort(result.begin(), result.end(),
+                  [](const process_entry &a, const process_entry &b) { return a.pid < b.pid; });
+        return result;
+    }
+} // namespace ulib
+
+#endif
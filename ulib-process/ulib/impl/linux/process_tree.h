@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include <ulib/string.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ulib
+{
+    struct process_entry
+    {
+        int pid = 0;
+        int ppid = 0;
+        char state = '?';     // /proc/<pid>/stat state letter, 'Z' for zombies
+        uint64 start_time = 0; // clock ticks after boot, tells a reused pid apart
+    };
+
+    // Snapshot of all processes with a parent -> children index, read from /proc. Refreshes are incremental:
+    // /proc is listed with getdents64(2) on a kept directory fd and up to max_kept_fds known processes are re-read
+    // with pread(2) on a kept stat fd; the rest are opened and closed on every refresh, so a busy host does not
+    // eat into the application's descriptor limit. Running out of descriptors anyway throws rather than leaving
+    // processes out of the tree.
+    class process_tree
+    {
+    public:
+        static constexpr size_t max_kept_fds = 128;
+
+        process_tree();
+        process_tree(const process_tree &) = delete;
+        ~process_tree();
+
+        void refresh();
+
+        inline size_t size() const { return mNodes.size(); }
+        bool contains(int pid) const;
+        const process_entry *find(int pid) const;
+
+        ulib::list<int> children(int pid) const;
+        ulib::list<int> descendants(int pid) const; // breadth-first, without pid itself
+        ulib::list<process_entry> entries() const;
+
+    private:
+        struct node
+        {
+            process_entry entry;
+            int statFd; // -1 past max_kept_fds
+            uint64 generation;
+        };
+
+        bool read_stat(int fd, process_entry &entry);
+        void close_node(node &n);
+
+        int mProcFd;
+        uint64 mGeneration;
+        size_t mKeptFds;
+        std::unordered_map<int, node> mNodes;
+        std::vector<std::pair<int, int>> mEdges; // (ppid, pid), sorted
+        std::vector<char> mDents;
+    };
+} // namespace ulib
+
+#endif
@@ -0,0 +1,233 @@
+#include "../archdef.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "process_wait.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace ulib
+{
+    namespace detail
+    {
+        std::optional<std::chrono::steady_clock::time_point> wait_deadline(
+            std::optional<std::chrono::milliseconds> timeout)
+        {
+            if (!timeout)
+                return std::nullopt;
+
+            return std::chrono::steady_clock::now() + *timeout;
+        }
+    } // namespace detail
+
+    process_waiter::process_waiter(std::span<process> processes)
+        : mProcesses(processes), mPidfds(processes.size(), -1), mWatched(processes.size(), false), mRemaining(0)
+    {
+#ifdef __linux__
+        mEpoll = ::epoll_create1(EPOLL_CLOEXEC);
+        if (mEpoll == -1)
+            throw process_internal_error{"epoll_create1 failed"};
+#else
+        mEpoll = -1;
+#endif
+        for (size_t i = 0; i < processes.size(); i++)
+            this->add(i);
+    }
+
+    void process_waiter::add(size_t index)
+    {
+        process &proc = mProcesses[index];
+        if (mWatched[index] || !proc.is_bound() || proc.result())
+            return;
+
+        mWatched[index] = true;
+        mRemaining++;
+#ifdef __linux__
+        // our own duplicate: the process closes its pidfd when it is reaped elsewhere, and a closed
+        // descriptor could not be taken out of the set anymore
+        int fd = proc.pidfd() == -1 ? -1 : ::fcntl(proc.pidfd(), F_DUPFD_CLOEXEC, 0);
+        if (fd != -1)
+        {
+            struct epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = index;
+            if (::epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &ev) == 0)
+            {
+                mPidfds[index] = fd;
+                return;
+            }
+
+            ::close(fd);
+        }
+#endif
+        mPolled.push_back(index);
+    }
+
+    process_waiter::~process_waiter()
+    {
+        for (int fd : mPidfds)
+        {
+            if (fd != -1)
+                ::close(fd);
+        }
+
+        if (mEpoll != -1)
+            ::close(mEpoll);
+    }
+
+    void process_waiter::unregister(size_t index)
+    {
+        int &fd = mPidfds[index];
+        if (fd == -1)
+            return;
+
+#ifdef __linux__
+        ::epoll_ctl(mEpoll, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+        ::close(fd);
+        fd = -1;
+    }
+
+    void process_waiter::drop(size_t index)
+    {
+        unregister(index);
+
+        auto it = std::find(mPolled.begin(), mPolled.end(), index);
+        if (it != mPolled.end())
+            mPolled.erase(it);
+
+        mWatched[index] = false;
+        mRemaining--;
+    }
+
+    std::optional<size_t> process_waiter::reap_polled()
+    {
+        for (size_t j = 0; j < mPolled.size();)
+        {
+            size_t index = mPolled[j];
+            process &proc = mProcesses[index];
+
+            // reaped elsewhere since we were set up
+            if (proc.result())
+            {
+                drop(index);
+                continue;
+            }
+
+            if (proc.check())
+            {
+                drop(index);
+                return index;
+            }
+
+            j++;
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<size_t> process_waiter::next_index(std::optional<std::chrono::steady_clock::time_point> deadline)
+    {
+        auto delay = std::chrono::microseconds{100};
+        while (mRemaining)
+        {
+            if (auto index = this->reap_polled())
+                return index;
+
+            if (!mRemaining)
+                break;
+
+            int timeout = -1;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline)
+            {
+                if (now >= *deadline)
+                    return std::nullopt;
+
+                timeout = int(std::chrono::ceil<std::chrono::milliseconds>(*deadline - now).count());
+            }
+
+            if (mPolled.size())
+            {
+                int slice = int(std::chrono::ceil<std::chrono::milliseconds>(delay).count());
+                timeout = timeout == -1 ? slice : std::min(timeout, slice);
+                delay = std::min(delay * 2, std::chrono::microseconds{10000});
+            }
+
+#ifdef __linux__
+            struct epoll_event events[64];
+            int count = ::epoll_wait(mEpoll, events, 64, timeout);
+            if (count == -1 && errno != EINTR)
+                throw process_internal_error{"epoll_wait failed"};
+
+            for (int i = 0; i < count; i++)
+            {
+                // the rest are level triggered and reported again by the next call
+                size_t index = size_t(events[i].data.u64);
+                process &proc = mProcesses[index];
+
+                if (proc.result())
+                {
+                    drop(index);
+                    continue;
+                }
+
+                if (proc.check())
+                {
+                    drop(index);
+                    return index;
+                }
+
+                // readable but not reapable yet, fall back to polling it
+                unregister(index);
+                mPolled.push_back(index);
+            }
+#else
+            std::this_thread::sleep_for(std::chrono::milliseconds{timeout == -1 ? 10 : timeout});
+#endif
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<process_exit> process_waiter::next(std::optional<std::chrono::milliseconds> timeout)
+    {
+        auto index = this->next_index(detail::wait_deadline(timeout));
+        if (!index)
+            return std::nullopt;
+
+        return process_exit{*index, *mProcesses[*index].result()};
+    }
+
+    bool process_waiter::wait_all(std::optional<std::chrono::milliseconds> timeout)
+    {
+        auto deadline = detail::wait_deadline(timeout);
+        while (mRemaining)
+        {
+            if (!this->next_index(deadline) && mRemaining)
+                return false;
+        }
+
+        return true;
+    }
+
+    std::optional<process_exit> wait_any(std::span<process> processes, std::optional<std::chrono::milliseconds> timeout)
+    {
+        process_waiter waiter{processes};
+        return waiter.next(timeout);
+    }
+
+    bool wait_all(std::span<process> processes, std::optional<std::chrono::milliseconds> timeout)
+    {
+        process_waiter waiter{processes};
+        return waiter.wait_all(timeout);
+    }
+} // namespace ulib
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../archdef.h"
+#ifdef ULIB_PROCESS_LINUX
+
+#include "process.h"
+
+#include <chrono>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace ulib
+{
+    struct process_exit
+    {
+        size_t index; // into the span passed to wait_any
+        wait_result result;
+    };
+
+    // Hands out the processes of a span as they exit, for loops over many children: one epoll set over
+    // duplicates of their pidfds is built up front and each child is dropped from it once handed out, so every
+    // wakeup costs O(ready) (children without a pidfd are polled). Processes that are not running when it is
+    // created, or that get reaped elsewhere in the meantime, are skipped unless add()ed later. The span must
+    // outlive the waiter.
+    class process_waiter
+    {
+    public:
+        explicit process_waiter(std::span<process> processes);
+        process_waiter(const process_waiter &) = delete;
+        ~process_waiter();
+
+        // reaps and returns the next process to exit; nullopt when none is left or the timeout expires
+        std::optional<process_exit> next(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+        // reaps every remaining process; false if the timeout expired first
+        bool wait_all(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+        // starts watching processes[index], for children spawned into the span after the waiter was created;
+        // ignored when it is not running or already watched
+        void add(size_t index);
+
+        inline size_t remaining() const { return mRemaining; }
+
+    private:
+        std::optional<size_t> next_index(std::optional<std::chrono::steady_clock::time_point> deadline);
+        std::optional<size_t> reap_polled();
+        void unregister(size_t index);
+        void drop(size_t index);
+
+        std::span<process> mProcesses;
+        std::vector<int> mPidfds; // our duplicates by index, -1 when polled or done
+        std::vector<size_t> mPolled;
+        std::vector<bool> mWatched; // by index, until handed out or dropped
+        size_t mRemaining;
+        int mEpoll;
+    };
+
+    // Reaps and returns the first process in the span to exit. Processes that are not running or were already
+    // reaped are ignored, so calling it in a loop hands out every child once; nullopt when none is left or the
+    // timeout expires. Each call sets up a process_waiter, loops should keep one instead.
+    std::optional<process_exit> wait_any(std::span<process> processes,
+                                         std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+    // Reaps every running process in the span; false if the timeout expired first.
+    bool wait_all(std::span<process> processes, std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+} // namespace ulib
+
+#endif
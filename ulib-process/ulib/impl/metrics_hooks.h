@@ -0,0 +1,80 @@
+#pragma once
+
+// Recording hooks for process_metrics, used by the platform implementations only. Every hook is gated on
+// process_metrics::enable() with one relaxed load, and a disabled timestamp is 0 so phases that straddle the
+// switch are dropped. With ULIB_PROCESS_NO_METRICS every hook expands to nothing, including its timestamps.
+
+#include "../process_metrics.h"
+
+#ifndef ULIB_PROCESS_NO_METRICS
+
+#include <atomic>
+
+namespace ulib
+{
+    namespace detail
+    {
+        enum metrics_counter
+        {
+            metrics_spawns,
+            metrics_spawn_failures,
+            metrics_exec_failures,
+            metrics_read_calls,
+            metrics_write_calls,
+            metrics_bytes_in,
+            metrics_bytes_out,
+            metrics_bytes_err,
+            metrics_counter_count,
+        };
+
+        // steady_clock is CLOCK_MONOTONIC, so the child's timestamps compare with the parent's
+        inline uint64 metrics_clock()
+        {
+            return uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now().time_since_epoch())
+                              .count());
+        }
+
+        extern std::atomic<bool> metrics_active;
+
+        inline bool metrics_on() { return metrics_active.load(std::memory_order_relaxed); }
+
+        void metrics_record(spawn_phase phase, uint64 ns);
+        void metrics_count(metrics_counter counter, uint64 n);
+
+        inline void metrics_stream_bytes(process_stream stream, uint64 n)
+        {
+            metrics_count(metrics_counter(metrics_bytes_in + int(stream)), n);
+        }
+    } // namespace detail
+} // namespace ulib
+
+#define ULIB_PROCESS_METRICS_TIMESTAMP(var)                                                                          \
+    const auto var = ::ulib::detail::metrics_on() ? ::ulib::detail::metrics_clock() : 0
+#define ULIB_PROCESS_METRICS_PHASE(phase, from, to)                                                                  \
+    do                                                                                                               \
+    {                                                                                                                \
+        if ((from) != 0 && (to) != 0 && ::ulib::detail::metrics_on())                                               \
+            ::ulib::detail::metrics_record(::ulib::spawn_phase::phase, (to) > (from) ? (to) - (from) : 0);          \
+    } while (false)
+#define ULIB_PROCESS_METRICS_COUNT(counter, n)                                                                       \
+    do                                                                                                               \
+    {                                                                                                                \
+        if (::ulib::detail::metrics_on())                                                                            \
+            ::ulib::detail::metrics_count(::ulib::detail::metrics_##counter, n);                                     \
+    } while (false)
+#define ULIB_PROCESS_METRICS_BYTES(stream, n)                                                                        \
+    do                                                                                                               \
+    {                                                                                                                \
+        if (::ulib::detail::metrics_on())                                                                            \
+            ::ulib::detail::metrics_stream_bytes(stream, n);                                                         \
+    } while (false)
+
+#else
+
+#define ULIB_PROCESS_METRICS_TIMESTAMP(var)
+#define ULIB_PROCESS_METRICS_PHASE(phase, from, to)
+#define ULIB_PROCESS_METRICS_COUNT(counter, n)
+#define ULIB_PROCESS_METRICS_BYTES(stream, n)
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+// Recording side of process_tracer, used by the platform implementations only.
+
+#include "../process_tracer.h"
+
+#include <atomic>
+
+namespace ulib
+{
+    namespace detail
+    {
+        class trace_ring;
+
+        extern std::atomic<trace_ring *> active_trace_ring;
+        extern std::atomic<uint64> trace_ring_users; // hooks currently holding a ring, see trace_scope
+
+        inline trace_ring *active_trace() { return active_trace_ring.load(std::memory_order_acquire); }
+
+        // Holds the active ring, if any, for as long as it lives: process_tracer only frees a replaced ring once
+        // no scope holds one. While stopped this costs a single atomic load.
+        class trace_scope
+        {
+        public:
+            explicit trace_scope(bool enable = true) : mRing(nullptr)
+            {
+                if (!enable || !active_trace_ring.load(std::memory_order_relaxed))
+                    return;
+
+                // announce ourselves before taking the pointer, so a start() that swaps it later sees us
+                trace_ring_users.fetch_add(1, std::memory_order_seq_cst);
+                mRing = active_trace_ring.load(std::memory_order_seq_cst);
+                if (!mRing)
+                    trace_ring_users.fetch_sub(1, std::memory_order_release);
+            }
+            trace_scope(const trace_scope &) = delete;
+
+            ~trace_scope()
+            {
+                if (mRing)
+                    trace_ring_users.fetch_sub(1, std::memory_order_release);
+            }
+
+            inline trace_ring *ring() const { return mRing; }
+            inline explicit operator bool() const { return mRing != nullptr; }
+
+        private:
+            trace_ring *mRing;
+        };
+
+        uint64 trace_clock();
+        void trace_record(trace_ring *ring, trace_event_type type, int pid, uint64 time_ns,
+                          process_stream stream = process_stream::out, const char *name = nullptr);
+
+        inline void trace(trace_event_type type, int pid, process_stream stream = process_stream::out)
+        {
+            trace_scope scope;
+            if (scope)
+                trace_record(scope.ring(), type, pid, trace_clock(), stream);
+        }
+    } // namespace detail
+} // namespace ulib
@@ -12,6 +12,8 @@
 #include <chrono>
 #include <optional>
 
+#include "../../process_capture.h"
+#include "../../process_cmd.h"
 #include "../../process_exceptions.h"
 
 namespace ulib
@@ -30,29 +32,45 @@ namespace ulib
 
             die_with_parent = 16,
             create_new_console = 32,
+            new_process_group = 64, // CREATE_NEW_PROCESS_GROUP, terminate(grace) sends CTRL_BREAK_EVENT first
+            new_session = 128,       // same as new_process_group on windows
+            pty = 256,               // not supported on windows, rejected with process_invalid_flags_error
+            capture_stdout = 512,    // not supported on windows, rejected with process_invalid_flags_error
         };
 
         class bpipe
         {
         public:
-            bpipe() { mHandle = 0; }
-            bpipe(void *handle) : mHandle(handle) {}
+            bpipe()
+            {
+                mHandle = 0;
+                mNonblocking = false;
+            }
+            bpipe(void *handle) : mHandle(handle), mNonblocking(false) {}
             bpipe(const bpipe &) = delete;
             bpipe(bpipe &&other)
             {
                 mHandle = other.mHandle;
+                mNonblocking = other.mNonblocking;
                 other.mHandle = 0;
             }
             ~bpipe();
 
             bpipe &operator=(bpipe &&other);
 
-            // inline void *native_handle() { return mHandle; }
+            inline void *native_handle() { return mHandle; }
             inline bool is_open() { return mHandle != 0; }
             void close();
 
+            // PIPE_NOWAIT on our end: writes take what fits and an empty pipe fails plain read(), use try_read()
+            void set_nonblocking(bool enable = true);
+            inline bool is_nonblocking() { return mNonblocking; }
+
         protected:
+            friend class process;
+
             void *mHandle;
+            bool mNonblocking;
         };
 
         class rpipe : public bpipe
@@ -72,6 +90,18 @@ namespace ulib
             size_t read(void *buf, size_t size);
             ulib::string read_all();
 
+            // never blocks: nullopt when no data is available yet, 0 at eof
+            std::optional<size_t> try_read(void *buf, size_t size);
+
+            // waits for data until deadline, nullopt if the deadline passed first
+            std::optional<size_t> read(void *buf, size_t size, std::chrono::steady_clock::time_point deadline);
+
+            // true once read() would not block (data or eof), waiting at most timeout
+            bool readable(std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+            // reads until eof keeping only the first head_limit and last tail_limit bytes
+            bounded_capture read_bounded(size_t head_limit, size_t tail_limit);
+
             char getchar();
             ulib::string getline();
 
@@ -95,6 +125,19 @@ namespace ulib
             size_t write(const void *buf, size_t size);
             size_t write(ulib::string_view str);
 
+            // loops over partial writes (and EINTR) until every byte is written, throws if the pipe breaks
+            void write_all(const void *buf, size_t size);
+            void write_all(ulib::string_view str) { this->write_all(str.data(), str.size()); }
+
+            // never blocks: nullopt when the pipe is full, otherwise the bytes written (possibly fewer than size)
+            std::optional<size_t> try_write(const void *buf, size_t size);
+
+            // writes until everything is written or deadline passes, returns the bytes written
+            size_t write(const void *buf, size_t size, std::chrono::steady_clock::time_point deadline);
+
+            // anonymous pipes cannot report free space, so this only checks that the pipe is still open
+            bool writable(std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
         private:
         };
 
@@ -103,6 +146,8 @@ namespace ulib
                 std::optional<std::filesystem::path> workingDirectory = std::nullopt);
         process(ulib::u8string_view line, uint32 flags = noflags,
                 std::optional<std::filesystem::path> workingDirectory = std::nullopt);
+        process(const command_line &cmd, uint32 flags = noflags,
+                std::optional<std::filesystem::path> workingDirectory = std::nullopt);
         process(const process &) = delete;
         process(process &&other);
         ~process();
@@ -113,6 +158,8 @@ namespace ulib
                  std::optional<std::filesystem::path> workingDirectory = std::nullopt);
         void run(ulib::u8string_view line, uint32 flags = noflags,
                  std::optional<std::filesystem::path> workingDirectory = std::nullopt);
+        void run(const command_line &cmd, uint32 flags = noflags,
+                 std::optional<std::filesystem::path> workingDirectory = std::nullopt);
 
         std::optional<int> wait(std::chrono::milliseconds ms);
         int wait();
@@ -121,6 +168,7 @@ namespace ulib
         bool is_finished();
         void detach();
         void terminate();
+        int terminate(std::chrono::milliseconds grace);
 
         std::optional<int> check();
         inline bool is_bound() { return mHandle != 0; }
@@ -130,6 +178,10 @@ namespace ulib
         inline rpipe &out() { return mOutPipe; }
         inline rpipe &err() { return mErrPipe; }
 
+        // Reads stdout and stderr through one poller until both reach eof, keeping each chunk with its stream and
+        // the time it was read. Needs pipe_stdout and/or pipe_stderr; pipe_output already merges them untagged.
+        stream_log read_merged();
+
 
 
     private:
@@ -147,6 +199,7 @@ namespace ulib
 
         win32::process::KillOnCloseJob mJob;
         int mPid;
+        uint32 mFlags;
         bool mWaited;
     };
 } // namespace ulib
@@ -13,6 +13,7 @@ namespace ulib
         close();
 
         mHandle = other.mHandle;
+        mNonblocking = other.mNonblocking;
         other.mHandle = nullptr;
 
         return *this;
@@ -29,6 +30,16 @@ namespace ulib
         }
     }
 
+    void process::bpipe::set_nonblocking(bool enable)
+    {
+        DWORD mode = enable ? PIPE_NOWAIT : PIPE_WAIT;
+        if (!::SetNamedPipeHandleState(mHandle, &mode, NULL, NULL))
+            throw process_internal_error(
+                ulib::format("SetNamedPipeHandleState failed: {}", win32::detail::GetLastErrorAsString()));
+
+        mNonblocking = enable;
+    }
+
     size_t process::rpipe::read(void *buf, size_t size)
     {
         DWORD readen = 0;
@@ -67,6 +78,91 @@ namespace ulib
         return output;
     }
 
+    bounded_capture process::rpipe::read_bounded(size_t head_limit, size_t tail_limit)
+    {
+        bounded_capture capture{head_limit, tail_limit};
+
+        char buf[16 * 1024];
+        while (true)
+        {
+            DWORD readen = 0;
+            if (!::ReadFile(mHandle, buf, sizeof(buf), &readen, NULL))
+            {
+                if (::GetLastError() == ERROR_BROKEN_PIPE)
+                    break;
+
+                throw process_internal_error(
+                    ulib::format("ReadFile failed: {}", win32::detail::GetLastErrorAsString()));
+            }
+
+            if (readen == 0)
+                break;
+
+            capture.append(buf, size_t(readen));
+        }
+
+        return capture;
+    }
+
+    std::optional<size_t> process::rpipe::try_read(void *buf, size_t size)
+    {
+        DWORD available = 0;
+        if (!::PeekNamedPipe(mHandle, NULL, 0, NULL, &available, NULL))
+        {
+            if (::GetLastError() == ERROR_BROKEN_PIPE)
+                return 0;
+
+            throw process_internal_error(
+                ulib::format("PeekNamedPipe failed: {}", win32::detail::GetLastErrorAsString()));
+        }
+
+        if (!available)
+            return std::nullopt;
+
+        DWORD readen = 0;
+        DWORD toRead = available < size ? available : DWORD(size);
+        if (!::ReadFile(mHandle, buf, toRead, &readen, NULL))
+        {
+            if (::GetLastError() == ERROR_BROKEN_PIPE)
+                return 0;
+
+            throw process_internal_error(ulib::format("ReadFile failed: {}", win32::detail::GetLastErrorAsString()));
+        }
+
+        return size_t(readen);
+    }
+
+    std::optional<size_t> process::rpipe::read(void *buf, size_t size, std::chrono::steady_clock::time_point deadline)
+    {
+        // anonymous pipes cannot be waited on, poll every millisecond
+        while (true)
+        {
+            if (auto rv = this->try_read(buf, size))
+                return rv;
+
+            if (std::chrono::steady_clock::now() >= deadline)
+                return std::nullopt;
+
+            ::Sleep(1);
+        }
+    }
+
+    bool process::rpipe::readable(std::chrono::milliseconds timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true)
+        {
+            DWORD available = 0;
+            if (!::PeekNamedPipe(mHandle, NULL, 0, NULL, &available, NULL) || available)
+                return true; // eof or an error, read() returns right away too
+
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+
+            ::Sleep(1);
+        }
+    }
+
     char process::rpipe::getchar()
     {
         char ch;
@@ -105,11 +201,86 @@ namespace ulib
         return this->write(str.data(), str.size());
     }
 
+    void process::wpipe::write_all(const void *buf, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(buf);
+        while (size)
+        {
+            size_t written = this->write(bytes, size);
+            if (!written)
+                ::Sleep(1); // PIPE_NOWAIT and the pipe is full
+
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    std::optional<size_t> process::wpipe::try_write(const void *buf, size_t size)
+    {
+        // a PIPE_NOWAIT write takes what fits and returns, switch to it for this call if needed
+        DWORD nowait = PIPE_NOWAIT;
+        if (!mNonblocking && !::SetNamedPipeHandleState(mHandle, &nowait, NULL, NULL))
+            throw process_internal_error(
+                ulib::format("SetNamedPipeHandleState failed: {}", win32::detail::GetLastErrorAsString()));
+
+        DWORD written = 0;
+        BOOL ok = ::WriteFile(mHandle, buf, DWORD(size), &written, NULL);
+        DWORD error = ::GetLastError();
+
+        if (!mNonblocking)
+        {
+            DWORD wait = PIPE_WAIT;
+            ::SetNamedPipeHandleState(mHandle, &wait, NULL, NULL);
+        }
+
+        if (!ok)
+        {
+            ::SetLastError(error);
+            throw process_internal_error(ulib::format("WriteFile failed: {}", win32::detail::GetLastErrorAsString()));
+        }
+
+        if (!written && size)
+            return std::nullopt;
+
+        return size_t(written);
+    }
+
+    size_t process::wpipe::write(const void *buf, size_t size, std::chrono::steady_clock::time_point deadline)
+    {
+        const char *bytes = static_cast<const char *>(buf);
+        size_t written = 0;
+
+        while (written < size)
+        {
+            if (auto rv = this->try_write(bytes + written, size - written))
+            {
+                written += *rv;
+                continue;
+            }
+
+            if (std::chrono::steady_clock::now() >= deadline)
+                break;
+
+            ::Sleep(1);
+        }
+
+        return written;
+    }
+
+    bool process::wpipe::writable(std::chrono::milliseconds timeout)
+    {
+        (void)timeout;
+
+        DWORD flags = 0;
+        return ::GetNamedPipeInfo(mHandle, &flags, NULL, NULL, NULL) != FALSE;
+    }
+
     process::process()
     {
         mHandle = 0;
         mWaited = false;
         mPid = 0;
+        mFlags = noflags;
     }
     process::process(const std::filesystem::path &path, const ulib::list<ulib::u8string> &args, uint32 flags,
                      std::optional<std::filesystem::path> workingDirectory)
@@ -117,6 +288,7 @@ namespace ulib
         mHandle = 0;
         mWaited = false;
         mPid = 0;
+        mFlags = noflags;
         this->run(path, args, flags, workingDirectory);
     }
     process::process(ulib::u8string_view line, uint32 flags, std::optional<std::filesystem::path> workingDirectory)
@@ -124,8 +296,17 @@ namespace ulib
         mHandle = 0;
         mWaited = false;
         mPid = 0;
+        mFlags = noflags;
         this->run(line, flags, workingDirectory);
     }
+    process::process(const command_line &cmd, uint32 flags, std::optional<std::filesystem::path> workingDirectory)
+    {
+        mHandle = 0;
+        mWaited = false;
+        mPid = 0;
+        mFlags = noflags;
+        this->run(cmd, flags, workingDirectory);
+    }
     process::process(process &&other) { this->move_init(std::move(other)); }
     process::~process() { this->finish(); }
 
@@ -155,8 +336,29 @@ namespace ulib
         this->run(wline, flags, workingDirectory);
     }
 
+    void process::run(const command_line &cmd, uint32 flags, std::optional<std::filesystem::path> workingDirectory)
+    {
+        using ChT = typename ulib::u8string_view::value_type;
+
+        // CreateProcess takes one string, so the words are quoted back by run(path, args)
+        ulib::list<ulib::u8string> args;
+        for (size_t i = 1; i < cmd.argc; i++)
+        {
+            auto arg = (const ChT *)cmd.argv[i];
+            args.push_back(ulib::u8string_view{arg, arg + strlen(cmd.argv[i])});
+        }
+
+        this->run(std::filesystem::path{std::u8string_view{(const char8_t *)cmd.path}}, args, flags, workingDirectory);
+    }
+
     void check_flags(uint32 flags)
     {
+        if (flags & process::pty)
+            throw process_invalid_flags_error{"pty flag is not supported on windows"};
+
+        if (flags & process::capture_stdout)
+            throw process_invalid_flags_error{"capture_stdout flag is not supported on windows"};
+
         if (flags & process::pipe_output)
         {
             if (flags & process::pipe_stdout)
@@ -230,6 +432,9 @@ namespace ulib
             if (flags & create_new_console)
                 dwCreationFlags |= CREATE_NEW_CONSOLE;
 
+            if (flags & (new_process_group | new_session))
+                dwCreationFlags |= CREATE_NEW_PROCESS_GROUP;
+
             line.MarkZeroEnd();
             PROCESS_INFORMATION pi = {};
             if (CreateProcessW(0, line.data(), 0, 0, useRedirect ? TRUE : FALSE, dwCreationFlags, 0,
@@ -237,6 +442,7 @@ namespace ulib
             {
                 mHandle = pi.hProcess;
                 mPid = pi.dwProcessId;
+                mFlags = flags;
 
                 mInPipe = wpipe{inputPipe.RedirectHandle()};
                 mOutPipe = rpipe{outputPipe.RedirectHandle()};
@@ -304,11 +510,84 @@ namespace ulib
         mWaited = true;
     }
 
+    int process::terminate(std::chrono::milliseconds grace)
+    {
+        // console processes in their own group can be asked to stop, everything else is killed right away
+        if (!is_finished())
+        {
+            bool asked = (mFlags & (new_process_group | new_session)) &&
+                         ::GenerateConsoleCtrlEvent(CTRL_BREAK_EVENT, DWORD(mPid));
+
+            if (!asked || !wait(grace))
+                terminate();
+        }
+
+        return wait();
+    }
+
     std::optional<int> process::check()
     {
         return wait(std::chrono::milliseconds(0));
     }
 
+    stream_log process::read_merged()
+    {
+        // anonymous pipes cannot be waited on, so this polls both with PeekNamedPipe and sleeps when neither
+        // has data
+        stream_log log;
+
+        rpipe *pipes[2] = {&mOutPipe, &mErrPipe};
+        process_stream streams[2] = {process_stream::out, process_stream::err};
+        bool open[2] = {mOutPipe.is_open(), mErrPipe.is_open()};
+
+        char buf[16 * 1024];
+        while (open[0] || open[1])
+        {
+            bool progress = false;
+            for (size_t i = 0; i < 2; i++)
+            {
+                if (!open[i])
+                    continue;
+
+                DWORD available = 0;
+                if (!::PeekNamedPipe(pipes[i]->mHandle, NULL, 0, NULL, &available, NULL))
+                {
+                    if (::GetLastError() != ERROR_BROKEN_PIPE)
+                        throw process_internal_error(
+                            ulib::format("PeekNamedPipe failed: {}", win32::detail::GetLastErrorAsString()));
+
+                    open[i] = false;
+                    continue;
+                }
+
+                if (!available)
+                    continue;
+
+                DWORD readen = 0;
+                DWORD toRead = available < sizeof(buf) ? available : DWORD(sizeof(buf));
+                if (!::ReadFile(pipes[i]->mHandle, buf, toRead, &readen, NULL))
+                {
+                    if (::GetLastError() != ERROR_BROKEN_PIPE)
+                        throw process_internal_error(
+                            ulib::format("ReadFile failed: {}", win32::detail::GetLastErrorAsString()));
+
+                    open[i] = false;
+                    continue;
+                }
+
+                auto now = std::chrono::steady_clock::now().time_since_epoch();
+                log.append(streams[i], uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), buf,
+                           size_t(readen));
+                progress = true;
+            }
+
+            if (!progress && (open[0] || open[1]))
+                ::Sleep(1);
+        }
+
+        return log;
+    }
+
     void process::destroy_pipes()
     {
         mInPipe.close();
@@ -355,6 +634,7 @@ namespace ulib
 
         mWaited = other.mWaited;
         mPid = other.mPid;
+        mFlags = other.mFlags;
     }
 
 } // namespace ulib
@@ -0,0 +1,628 @@
+#include "process_cache.h"
+
+#include <ulib/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#ifdef ULIB_PROCESS_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "process_exceptions.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+        constexpr uint32 cache_magic = 0x43525055; // "UPRC"
+        constexpr uint32 cache_version = 2; // 2: executables resolved from the working directory
+
+        // Entry file layout: this header, then stdout, then stderr. Native endianness, the cache is per machine.
+        struct cache_entry_header
+        {
+            uint32 magic;
+            uint32 version;
+            int32_t code;
+            uint32 reserved;
+            uint64 outSize;
+            uint64 errSize;
+            uint64 keyHi;
+            uint64 keyLo;
+        };
+
+        inline uint64 rotl64(uint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline uint64 fmix64(uint64 k)
+        {
+            k ^= k >> 33;
+            k *= 0xff51afd7ed558ccdull;
+            k ^= k >> 33;
+            k *= 0xc4ceb9fe1a85ec53ull;
+            k ^= k >> 33;
+            return k;
+        }
+
+        // Streaming 128-bit hash in the style of MurmurHash3: two lanes over 8 byte words, fmix64 finalizer
+        class cache_hasher
+        {
+        public:
+            void update(const void *data, size_t size)
+            {
+                const unsigned char *bytes = static_cast<const unsigned char *>(data);
+                mLength += size;
+
+                while (size)
+                {
+                    size_t take = std::min(size, sizeof(mTail) - mTailSize);
+                    std::memcpy(mTail + mTailSize, bytes, take);
+                    mTailSize += take;
+                    bytes += take;
+                    size -= take;
+
+                    if (mTailSize == sizeof(mTail))
+                    {
+                        uint64 word;
+                        std::memcpy(&word, mTail, sizeof(word));
+                        mix(word);
+                        mTailSize = 0;
+                    }
+                }
+            }
+
+            // length-prefixed, so adjacent fields cannot run into each other
+            void field(ulib::string_view str)
+            {
+                uint64 size = str.size();
+                update(&size, sizeof(size));
+                update(str.data(), str.size());
+            }
+
+            void field(uint64 value) { update(&value, sizeof(value)); }
+
+            result_cache::key finish()
+            {
+                uint64 word = 0;
+                std::memcpy(&word, mTail, mTailSize);
+                mix(word ^ mLength);
+
+                uint64 hi = fmix64(mA + mB);
+                uint64 lo = fmix64(mB + hi);
+                return {hi, lo};
+            }
+
+        private:
+            void mix(uint64 word)
+            {
+                mA = rotl64(mA ^ (word * 0x87c37b91114253d5ull), 31) * 0x4cf5ad432745937full;
+                mA = rotl64(mA, 27) + mB;
+                mB = rotl64(mB ^ (word * 0x4cf5ad432745937full), 33) * 0x87c37b91114253d5ull;
+                mB = rotl64(mB, 31) + mA * 5 + 0x38495ab5;
+            }
+
+            uint64 mA = 0x9e3779b97f4a7c15ull;
+            uint64 mB = 0xc2b2ae3d27d4eb4full;
+            uint64 mLength = 0;
+            unsigned char mTail[8];
+            size_t mTailSize = 0;
+        };
+
+        ulib::string_view path_bytes(const std::filesystem::path &path)
+        {
+            auto &native = path.native();
+            return ulib::string_view{reinterpret_cast<const char *>(native.data()),
+                                     native.size() * sizeof(native[0])};
+        }
+
+        bool is_executable_file(const std::filesystem::path &path)
+        {
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(path, ec))
+                return false;
+
+#ifdef ULIB_PROCESS_WINDOWS
+            return true;
+#else
+            return ::access(path.c_str(), X_OK) == 0;
+#endif
+        }
+
+        // The file the child would run. On posix the child changes to workingDirectory and then tries execve(path)
+        // before execvp(path), so relative paths, bare names and relative PATH entries all count from there;
+        // CreateProcess resolves against our own directory.
+        std::filesystem::path resolve_executable(const std::filesystem::path &path,
+                                                 const std::optional<std::filesystem::path> &workingDirectory)
+        {
+            if (path.is_absolute())
+                return path;
+
+            std::error_code ec;
+            std::filesystem::path base = std::filesystem::current_path(ec);
+#ifndef ULIB_PROCESS_WINDOWS
+            if (workingDirectory)
+                base = workingDirectory->is_absolute() ? *workingDirectory : base / *workingDirectory;
+#else
+            (void)workingDirectory;
+#endif
+
+            std::filesystem::path direct = base / path;
+            if (path.has_parent_path() || is_executable_file(direct))
+                return direct;
+
+#ifdef ULIB_PROCESS_WINDOWS
+            constexpr char separator = ';';
+#else
+            constexpr char separator = ':';
+#endif
+
+            const char *env = std::getenv("PATH");
+            ulib::string_view dirs = env ? env : "";
+            while (true)
+            {
+                size_t end = dirs.find(separator);
+                ulib::string_view dir = dirs.substr(0, end);
+                if (dir.size())
+                {
+                    std::filesystem::path candidate =
+                        base / std::filesystem::path{std::string{dir.data(), dir.size()}} / path;
+                    if (is_executable_file(candidate))
+                        return candidate;
+                }
+
+                if (end == ulib::string_view::npos)
+                    break;
+
+                dirs = dirs.substr(end + 1);
+            }
+
+            return direct;
+        }
+
+        void hash_executable(cache_hasher &hasher, const std::filesystem::path &path,
+                             const std::optional<std::filesystem::path> &workingDirectory, bool content)
+        {
+            std::filesystem::path exe = resolve_executable(path, workingDirectory);
+            hasher.field(path_bytes(exe.lexically_normal()));
+
+            if (content)
+            {
+                std::ifstream file{exe, std::ios::binary};
+                if (!file)
+                    throw process_file_not_found_error{ulib::format("cannot read {}", exe.string())};
+
+                char buf[64 * 1024];
+                while (file)
+                {
+                    file.read(buf, sizeof(buf));
+                    hasher.update(buf, size_t(file.gcount()));
+                }
+
+                return;
+            }
+
+#ifdef ULIB_PROCESS_WINDOWS
+            std::error_code ec;
+            std::filesystem::file_time_type mtime;
+            auto size = std::filesystem::file_size(exe, ec);
+            if (!ec)
+                mtime = std::filesystem::last_write_time(exe, ec);
+            if (ec)
+                throw process_file_not_found_error{ulib::format("cannot stat {}", exe.string())};
+
+            hasher.field(uint64(size));
+            hasher.field(uint64(mtime.time_since_epoch().count()));
+#else
+            struct stat st;
+            if (::stat(exe.c_str(), &st) == -1)
+                throw process_file_not_found_error{ulib::format("cannot stat {}", exe.string())};
+
+            // a rebuilt binary changes mtime, a replaced one (rename over it) the inode as well
+            hasher.field(uint64(st.st_dev));
+            hasher.field(uint64(st.st_ino));
+            hasher.field(uint64(st.st_size));
+#ifdef __APPLE__
+            hasher.field(uint64(st.st_mtimespec.tv_sec));
+            hasher.field(uint64(st.st_mtimespec.tv_nsec));
+#else
+            hasher.field(uint64(st.st_mtim.tv_sec));
+            hasher.field(uint64(st.st_mtim.tv_nsec));
+#endif
+#endif
+        }
+
+        void touch_entry(const std::filesystem::path &path)
+        {
+            std::error_code ec;
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        }
+    } // namespace detail
+
+    cached_result::cached_result(cached_result &&other)
+        : mMapping(other.mMapping), mMappingSize(other.mMappingSize), mOwned(std::move(other.mOwned)),
+          mOut(other.mOut), mErr(other.mErr), mCode(other.mCode), mHit(other.mHit)
+    {
+        other.mMapping = nullptr;
+        other.mMappingSize = 0;
+    }
+
+    cached_result::~cached_result() { release(); }
+
+    cached_result &cached_result::operator=(cached_result &&other)
+    {
+        release();
+
+        mMapping = other.mMapping;
+        mMappingSize = other.mMappingSize;
+        mOwned = std::move(other.mOwned);
+        mOut = other.mOut;
+        mErr = other.mErr;
+        mCode = other.mCode;
+        mHit = other.mHit;
+
+        other.mMapping = nullptr;
+        other.mMappingSize = 0;
+
+        return *this;
+    }
+
+    ulib::string_view cached_result::out() const { return ulib::string_view{data() + mOut.offset, mOut.size}; }
+    ulib::string_view cached_result::err() const { return ulib::string_view{data() + mErr.offset, mErr.size}; }
+
+    const char *cached_result::data() const
+    {
+        return mMapping ? static_cast<const char *>(mMapping) : mOwned.data();
+    }
+
+    void cached_result::release()
+    {
+#ifndef ULIB_PROCESS_WINDOWS
+        if (mMapping)
+            ::munmap(mMapping, mMappingSize);
+#endif
+        mMapping = nullptr;
+        mMappingSize = 0;
+    }
+
+    ulib::string result_cache::key::hex() const { return ulib::format("{:016x}{:016x}", hi, lo); }
+
+    result_cache::result_cache(const std::filesystem::path &directory, uint64 max_bytes)
+        : mDirectory(directory), mMaxBytes(max_bytes), mBytes(0), mHits(0), mMisses(0), mEvictions(0)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(mDirectory, ec);
+        if (ec)
+            throw process_internal_error{ulib::format("failed to create cache directory: {}", ec.message())};
+
+        mBytes = scan();
+    }
+
+    result_cache::key result_cache::make_key(const command &cmd) const
+    {
+        detail::cache_hasher hasher;
+        hasher.field(uint64(detail::cache_version));
+
+        detail::hash_executable(hasher, cmd.path, cmd.workingDirectory, cmd.hash_executable);
+
+        hasher.field(uint64(cmd.args.size()));
+        for (auto &arg : cmd.args)
+            hasher.field(ulib::string_view{reinterpret_cast<const char *>(arg.data()), arg.size()});
+
+        std::error_code ec;
+        std::filesystem::path cwd = cmd.workingDirectory ? std::filesystem::absolute(*cmd.workingDirectory, ec)
+                                                         : std::filesystem::current_path(ec);
+        hasher.field(detail::path_bytes(cwd));
+
+        hasher.field(uint64(cmd.env.size()));
+        for (auto &name : cmd.env)
+        {
+            hasher.field(name);
+
+            // unset and empty differ
+            const char *value = std::getenv(name.c_str());
+            hasher.field(uint64(value != nullptr));
+            hasher.field(value ? ulib::string_view{value} : ulib::string_view{});
+        }
+
+        hasher.field(cmd.input);
+        return hasher.finish();
+    }
+
+    std::filesystem::path result_cache::entry_path(const key &k) const
+    {
+        ulib::string name = k.hex();
+        return mDirectory / (std::string{name.data(), name.size()} + ".res");
+    }
+
+    std::optional<cached_result> result_cache::lookup(const key &k)
+    {
+        std::filesystem::path path = entry_path(k);
+        cached_result result;
+        detail::cache_entry_header header;
+
+#ifdef ULIB_PROCESS_WINDOWS
+        std::ifstream file{path, std::ios::binary};
+        if (!file)
+            return std::nullopt;
+
+        std::string content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        file.close();
+        if (content.size() < sizeof(header))
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            return std::nullopt;
+        }
+
+        std::memcpy(&header, content.data(), sizeof(header));
+        result.mOwned = ulib::string{ulib::string_view{content.data(), content.size()}};
+        size_t size = content.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return std::nullopt;
+
+        struct stat st;
+        if (::fstat(fd, &st) == -1)
+        {
+            ::close(fd);
+            return std::nullopt;
+        }
+
+        if (size_t(st.st_size) < sizeof(header))
+        {
+            ::close(fd);
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            return std::nullopt;
+        }
+
+        size_t size = size_t(st.st_size);
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        // mtime is the LRU clock
+        ::futimens(fd, nullptr);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED)
+            return std::nullopt;
+
+        result.mMapping = mapping;
+        result.mMappingSize = size;
+        std::memcpy(&header, mapping, sizeof(header));
+#endif
+
+        if (header.magic != detail::cache_magic || header.version != detail::cache_version || header.keyHi != k.hi ||
+            header.keyLo != k.lo || header.outSize > size - sizeof(header) ||
+            header.errSize > size - sizeof(header) - header.outSize)
+        {
+            // truncated or foreign, drop it so it is rebuilt
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            return std::nullopt;
+        }
+
+#ifdef ULIB_PROCESS_WINDOWS
+        detail::touch_entry(path);
+#endif
+
+        result.mOut = {sizeof(header), size_t(header.outSize)};
+        result.mErr = {sizeof(header) + size_t(header.outSize), size_t(header.errSize)};
+        result.mCode = header.code;
+        result.mHit = true;
+        return result;
+    }
+
+    void result_cache::store(const key &k, int code, ulib::string_view out, ulib::string_view err)
+    {
+        static std::atomic<uint64> counter{0};
+
+        std::filesystem::path path = entry_path(k);
+        std::filesystem::path temp = path;
+        temp += ulib::format(".{}.{}.tmp",
+#ifdef ULIB_PROCESS_WINDOWS
+                             uint64(::GetCurrentProcessId()),
+#else
+                             uint64(::getpid()),
+#endif
+                             counter++)
+                    .c_str();
+
+        detail::cache_entry_header header = {};
+        header.magic = detail::cache_magic;
+        header.version = detail::cache_version;
+        header.code = code;
+        header.outSize = out.size();
+        header.errSize = err.size();
+        header.keyHi = k.hi;
+        header.keyLo = k.lo;
+
+        {
+            std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(out.data(), std::streamsize(out.size()));
+            file.write(err.data(), std::streamsize(err.size()));
+            if (!file)
+            {
+                file.close();
+                std::error_code ec;
+                std::filesystem::remove(temp, ec);
+                return; // a full disk only costs the cache entry
+            }
+        }
+
+        // readers see either no entry or a complete one
+        std::error_code ec;
+        std::filesystem::rename(temp, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+
+        if ((mBytes += sizeof(header) + out.size() + err.size()) > mMaxBytes)
+            evict();
+    }
+
+    uint64 result_cache::scan()
+    {
+        uint64 total = 0;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator{mDirectory, ec})
+        {
+            if (entry.path().extension() == ".res")
+                total += entry.file_size(ec);
+        }
+
+        return total;
+    }
+
+    void result_cache::evict()
+    {
+        std::lock_guard lock{mEvictMutex};
+
+        struct file
+        {
+            std::filesystem::file_time_type used;
+            uint64 size;
+            std::filesystem::path path;
+        };
+
+        // other processes may share the directory, so the sizes are re-read rather than trusted
+        std::vector<file> files;
+        uint64 total = 0;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator{mDirectory, ec})
+        {
+            if (entry.path().extension() != ".res")
+                continue;
+
+            file f{entry.last_write_time(ec), entry.file_size(ec), entry.path()};
+            if (ec)
+                continue;
+
+            total += f.size;
+            files.push_back(std::move(f));
+        }
+
+        // down to 7/8 of the limit so that the next few stores do not scan again
+        uint64 target = mMaxBytes - mMaxBytes / 8;
+        if (total > mMaxBytes)
+        {
+            std::sort(files.begin(), files.end(), [](const file &a, const file &b) { return a.used < b.used; });
+
+            for (auto &f : files)
+            {
+                if (total <= target)
+                    break;
+
+                if (std::filesystem::remove(f.path, ec))
+                {
+                    total -= f.size;
+                    mEvictions++;
+                }
+            }
+        }
+
+        mBytes = total;
+    }
+
+    void result_cache::clear()
+    {
+        std::lock_guard lock{mEvictMutex};
+
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator{mDirectory, ec})
+        {
+            if (entry.path().extension() == ".res")
+                std::filesystem::remove(entry.path(), ec);
+        }
+
+        mBytes = 0;
+    }
+
+    result_cache::stats result_cache::statistics() const
+    {
+        stats result;
+        result.hits = mHits;
+        result.misses = mMisses;
+        result.evictions = mEvictions;
+        result.bytes = mBytes;
+        return result;
+    }
+
+    cached_result result_cache::run(const command &cmd)
+    {
+        key k = make_key(cmd);
+        if (auto cached = lookup(k))
+        {
+            mHits++;
+            return std::move(*cached);
+        }
+
+        mMisses++;
+
+        process proc{cmd.path, cmd.args, process::pipe_stdin | process::pipe_stdout | process::pipe_stderr,
+                     cmd.workingDirectory};
+
+        // stdin is fed from a second thread while this one drains stdout and stderr, so neither side can stall
+        // on a full pipe
+        std::thread feeder;
+        if (cmd.input.size())
+        {
+            feeder = std::thread([&] {
+                // write_all throws rather than raising SIGPIPE when the child exits without reading
+                try
+                {
+                    proc.in().write_all(cmd.input);
+                }
+                catch (const process_error &)
+                {
+                }
+
+                proc.in().close();
+            });
+        }
+        else
+        {
+            proc.in().close();
+        }
+
+        stream_log log = proc.read_merged();
+        if (feeder.joinable())
+            feeder.join();
+
+#ifdef ULIB_PROCESS_WINDOWS
+        int code = proc.wait();
+        bool signaled = false;
+#else
+        const wait_result &res = proc.wait_for_result();
+        int code = res.code();
+        bool signaled = res.signal.has_value();
+#endif
+
+        cached_result result;
+        result.mOwned = log.str(process_stream::out);
+        result.mOwned.append(log.str(process_stream::err));
+        result.mOut = {0, size_t(log.bytes(process_stream::out))};
+        result.mErr = {size_t(log.bytes(process_stream::out)), size_t(log.bytes(process_stream::err))};
+        result.mCode = code;
+        result.mHit = false;
+
+        // killed from outside (oom, a timeout, SIGKILL): says nothing about the command, so never replay it
+        if (!signaled)
+            store(k, code, result.out(), result.err());
+
+        return result;
+    }
+} // namespace ulib
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "process.h"
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+
+namespace ulib
+{
+    // Output and exit code of one cached run. On posix the entry file is mapped read-only and out()/err() point
+    // straight into it, so a hit copies nothing.
+    class cached_result
+    {
+    public:
+        cached_result() : mMapping(nullptr), mMappingSize(0), mOut{0, 0}, mErr{0, 0}, mCode(0), mHit(false) {}
+        cached_result(const cached_result &) = delete;
+        cached_result(cached_result &&other);
+        ~cached_result();
+
+        cached_result &operator=(cached_result &&other);
+
+        inline int code() const { return mCode; }
+        inline bool hit() const { return mHit; } // false when the command was run for this result
+        ulib::string_view out() const;
+        ulib::string_view err() const;
+
+    private:
+        friend class result_cache;
+
+        struct range
+        {
+            size_t offset;
+            size_t size;
+        };
+
+        void release();
+        const char *data() const;
+
+        void *mMapping;
+        size_t mMappingSize;
+        ulib::string mOwned; // misses, and hits where mapping is not available
+
+        // into the mapping or mOwned, which may move
+        range mOut;
+        range mErr;
+        int mCode;
+        bool mHit;
+    };
+
+    // Memoizes deterministic commands on disk. The key hashes the executable's identity (path, size, mtime and
+    // inode, or its content), argv, the working directory, the values of selected environment variables and the
+    // stdin bytes; the value is stdout, stderr and the exit code. Entries are one file each, named by key, and the
+    // least recently used ones are deleted once the directory grows past max_bytes. The hash is not
+    // cryptographic: anyone who can write to the directory can plant results.
+    class result_cache
+    {
+    public:
+        struct command
+        {
+            std::filesystem::path path;
+            ulib::list<ulib::u8string> args;
+            std::optional<std::filesystem::path> workingDirectory;
+
+            ulib::list<ulib::string> env; // names of the environment variables the output depends on
+            ulib::string input;           // written to stdin, which is closed afterwards
+
+            bool hash_executable = false; // hash the executable's content instead of its size, mtime and inode
+        };
+
+        struct key
+        {
+            uint64 hi = 0;
+            uint64 lo = 0;
+
+            ulib::string hex() const;
+            inline bool operator==(const key &other) const { return hi == other.hi && lo == other.lo; }
+        };
+
+        struct stats
+        {
+            uint64 hits = 0;
+            uint64 misses = 0;
+            uint64 evictions = 0;
+            uint64 bytes = 0; // size of all entries as last seen
+        };
+
+        explicit result_cache(const std::filesystem::path &directory, uint64 max_bytes = 256ull << 20);
+
+        // looks up cmd and only runs it on a miss, storing the result
+        cached_result run(const command &cmd);
+
+        key make_key(const command &cmd) const;
+        std::optional<cached_result> lookup(const key &k);
+        void store(const key &k, int code, ulib::string_view out, ulib::string_view err);
+
+        void evict(); // deletes least recently used entries until the cache fits max_bytes
+        void clear();
+
+        stats statistics() const;
+        inline const std::filesystem::path &directory() const { return mDirectory; }
+
+    private:
+        std::filesystem::path entry_path(const key &k) const;
+        uint64 scan();
+
+        std::filesystem::path mDirectory;
+        uint64 mMaxBytes;
+
+        std::mutex mEvictMutex;
+        std::atomic<uint64> mBytes;
+        std::atomic<uint64> mHits;
+        std::atomic<uint64> mMisses;
+        std::atomic<uint64> mEvictions;
+    };
+} // namespace ulib
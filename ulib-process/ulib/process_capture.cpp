@@ -0,0 +1,181 @@
+#include "process_capture.h"
+
+#include <ulib/format.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace ulib
+{
+    namespace detail
+    {
+        // time, size, stream; copied in and out with memcpy so records need no alignment
+        constexpr size_t stream_record_header = sizeof(uint64) + sizeof(uint32) + 1;
+    } // namespace detail
+
+    bounded_capture::bounded_capture(size_t head_limit, size_t tail_limit) : mHeadLimit(head_limit), mRing(tail_limit)
+    {
+        mHead.reserve(head_limit);
+        mRingStart = 0;
+        mRingSize = 0;
+        mTotal = 0;
+        mOmitted = 0;
+    }
+
+    void bounded_capture::append(const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        mTotal += size;
+
+        size_t toHead = std::min(size, mHeadLimit - mHead.size());
+        if (toHead)
+        {
+            mHead.append(ulib::string_view{bytes, toHead});
+            bytes += toHead;
+            size -= toHead;
+        }
+
+        if (!size)
+            return;
+
+        size_t capacity = mRing.size();
+        if (size >= capacity)
+        {
+            // the chunk alone fills the ring, everything older is dropped
+            mOmitted += mRingSize + (size - capacity);
+            if (capacity)
+                std::memcpy(mRing.data(), bytes + (size - capacity), capacity);
+
+            mRingStart = 0;
+            mRingSize = capacity;
+            return;
+        }
+
+        size_t overflow = mRingSize + size > capacity ? mRingSize + size - capacity : 0;
+        mOmitted += overflow;
+        mRingStart = (mRingStart + overflow) % capacity;
+        mRingSize -= overflow;
+
+        size_t end = (mRingStart + mRingSize) % capacity;
+        size_t first = std::min(size, capacity - end);
+        std::memcpy(mRing.data() + end, bytes, first);
+        std::memcpy(mRing.data(), bytes + first, size - first);
+        mRingSize += size;
+    }
+
+    void bounded_capture::clear()
+    {
+        mHead.clear();
+        mRingStart = 0;
+        mRingSize = 0;
+        mTotal = 0;
+        mOmitted = 0;
+    }
+
+    ulib::string bounded_capture::tail() const
+    {
+        ulib::string result;
+        result.reserve(mRingSize);
+
+        size_t first = std::min(mRingSize, mRing.size() - mRingStart);
+        result.append(ulib::string_view{mRing.data() + mRingStart, first});
+        result.append(ulib::string_view{mRing.data(), mRingSize - first});
+        return result;
+    }
+
+    ulib::string bounded_capture::str() const
+    {
+        ulib::string result = mHead;
+        if (truncated())
+            result.append(ulib::format("\n[... {} bytes omitted ...]\n", mOmitted));
+
+        result.append(tail());
+        return result;
+    }
+
+    stream_record stream_log::iterator::operator*() const
+    {
+        uint64 time;
+        uint32 size;
+        std::memcpy(&time, mPos, sizeof(time));
+        std::memcpy(&size, mPos + sizeof(time), sizeof(size));
+
+        stream_record record;
+        record.stream = process_stream(uint8_t(mPos[sizeof(time) + sizeof(size)]));
+        record.time_ns = time;
+        record.data = ulib::string_view{mPos + detail::stream_record_header, size};
+        return record;
+    }
+
+    stream_log::iterator &stream_log::iterator::operator++()
+    {
+        uint32 size;
+        std::memcpy(&size, mPos + sizeof(uint64), sizeof(size));
+        mPos += detail::stream_record_header + size;
+        return *this;
+    }
+
+    stream_log::stream_log()
+    {
+        mRecords = 0;
+        mBytes[0] = mBytes[1] = mBytes[2] = 0;
+    }
+
+    void stream_log::append(process_stream stream, uint64 time_ns, const void *data, size_t size)
+    {
+        if (!size)
+            return;
+
+        // chunks come from single reads, split anything that does not fit the 32 bit length
+        const char *bytes = static_cast<const char *>(data);
+        do
+        {
+            uint32 chunk = uint32(std::min<size_t>(size, UINT32_MAX));
+
+            size_t offset = mArena.size();
+            mArena.resize(offset + detail::stream_record_header + chunk);
+
+            char *pos = mArena.data() + offset;
+            std::memcpy(pos, &time_ns, sizeof(time_ns));
+            std::memcpy(pos + sizeof(time_ns), &chunk, sizeof(chunk));
+            pos[sizeof(time_ns) + sizeof(chunk)] = char(stream);
+            std::memcpy(pos + detail::stream_record_header, bytes, chunk);
+
+            mRecords++;
+            mBytes[size_t(stream)] += chunk;
+            bytes += chunk;
+            size -= chunk;
+        } while (size);
+    }
+
+    void stream_log::clear()
+    {
+        mArena.clear();
+        mRecords = 0;
+        mBytes[0] = mBytes[1] = mBytes[2] = 0;
+    }
+
+    uint64 stream_log::bytes(process_stream stream) const { return mBytes[size_t(stream)]; }
+
+    ulib::string stream_log::str() const
+    {
+        ulib::string result;
+        result.reserve(size_t(mBytes[0] + mBytes[1] + mBytes[2]));
+        for (auto record : *this)
+            result.append(record.data);
+
+        return result;
+    }
+
+    ulib::string stream_log::str(process_stream stream) const
+    {
+        ulib::string result;
+        result.reserve(size_t(mBytes[size_t(stream)]));
+        for (auto record : *this)
+            if (record.stream == stream)
+                result.append(record.data);
+
+        return result;
+    }
+} // namespace ulib
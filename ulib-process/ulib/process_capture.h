@@ -0,0 +1,105 @@
+#pragma once
+
+#include "process_metrics.h"
+
+#include <ulib/string.h>
+#include <iterator>
+#include <vector>
+
+namespace ulib
+{
+    // Keeps the first head_limit bytes and the last tail_limit bytes of a stream and only counts what falls in
+    // between, so memory stays at head_limit + tail_limit however much the child prints.
+    class bounded_capture
+    {
+    public:
+        bounded_capture(size_t head_limit, size_t tail_limit);
+
+        void append(const void *data, size_t size);
+        void clear();
+
+        inline uint64 total() const { return mTotal; }     // bytes seen
+        inline uint64 omitted() const { return mOmitted; } // bytes counted but not kept
+        inline bool truncated() const { return mOmitted != 0; }
+
+        inline const ulib::string &head() const { return mHead; }
+        ulib::string tail() const;
+
+        // head and tail joined by a marker line when bytes were omitted, the whole stream otherwise
+        ulib::string str() const;
+
+    private:
+        size_t mHeadLimit;
+        ulib::string mHead;
+
+        std::vector<char> mRing;
+        size_t mRingStart; // oldest byte
+        size_t mRingSize;
+
+        uint64 mTotal;
+        uint64 mOmitted;
+    };
+
+    struct stream_record
+    {
+        process_stream stream;
+        uint64 time_ns;        // steady_clock when the chunk was read
+        ulib::string_view data; // points into the stream_log, valid until it is cleared or appended to
+    };
+
+    // Interleaved stdout/stderr chunks in the order they were read, each tagged with its stream and time.
+    // Records live back to back in one growing arena as a 13 byte header followed by the data, so appending
+    // never allocates per record and iteration is a linear walk.
+    class stream_log
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = stream_record;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const stream_record *;
+            using reference = const stream_record &;
+
+            iterator() : mPos(nullptr) {}
+            explicit iterator(const char *pos) : mPos(pos) {}
+
+            stream_record operator*() const;
+            iterator &operator++();
+            iterator operator++(int)
+            {
+                iterator prev = *this;
+                ++*this;
+                return prev;
+            }
+
+            bool operator==(const iterator &other) const { return mPos == other.mPos; }
+            bool operator!=(const iterator &other) const { return mPos != other.mPos; }
+
+        private:
+            const char *mPos;
+        };
+
+        stream_log();
+
+        void append(process_stream stream, uint64 time_ns, const void *data, size_t size);
+        void clear();
+        void reserve(size_t bytes) { mArena.reserve(bytes); }
+
+        inline size_t size() const { return mRecords; } // records
+        inline bool empty() const { return mRecords == 0; }
+        uint64 bytes(process_stream stream) const;
+
+        inline iterator begin() const { return iterator{mArena.data()}; }
+        inline iterator end() const { return iterator{mArena.data() + mArena.size()}; }
+
+        ulib::string str() const;                       // all chunks in order
+        ulib::string str(process_stream stream) const; // one stream only
+
+    private:
+        std::vector<char> mArena;
+        size_t mRecords;
+        uint64 mBytes[3];
+    };
+} // namespace ulib
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "impl/archdef.h"
+#include "process.h"
+
+#ifdef ULIB_PROCESS_LINUX
+#include "impl/linux/process_channel.h"
+#endif
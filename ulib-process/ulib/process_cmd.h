@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace ulib
+{
+    // A command tokenized at compile time by operator""_cmd. Everything points into static tables.
+    struct command_line
+    {
+        const char *path;        // the first word as written, resolved like the path of process::run
+        const char *const *argv; // argv[0] is the file name part of path, terminated by nullptr
+        size_t argc;
+        const char *line; // the literal itself
+    };
+
+    namespace detail
+    {
+        // Command line grammar shared by operator""_cmd and the runtime parser: words are separated by spaces
+        // and tabs; single quotes keep everything up to the next single quote; double quotes group and take \"
+        // and \\ as escapes; outside quotes a backslash escapes any character. Quotes may join parts of one word
+        // (a"b c"d is one word) and "" or '' is an empty word.
+        // The sink gets begin() and end() around every word and put() for each character; returns an error
+        // message, or nullptr when the line is well formed.
+        template <class CharT, class Sink>
+        constexpr const char *cmd_scan(const CharT *str, size_t size, Sink &sink)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                if (str[i] == CharT(0))
+                    return "embedded NUL in command line";
+            }
+
+            bool inWord = false;
+            for (size_t i = 0; i < size; i++)
+            {
+                char ch = char(str[i]);
+                if (ch == ' ' || ch == '\t')
+                {
+                    if (inWord)
+                    {
+                        sink.end();
+                        inWord = false;
+                    }
+
+                    continue;
+                }
+
+                if (!inWord)
+                {
+                    sink.begin();
+                    inWord = true;
+                }
+
+                if (ch == '\'')
+                {
+                    for (i++; i < size && char(str[i]) != '\''; i++)
+                        sink.put(char(str[i]));
+
+                    if (i == size)
+                        return "unterminated single quote in command line";
+                }
+                else if (ch == '\"')
+                {
+                    for (i++; i < size && char(str[i]) != '\"'; i++)
+                    {
+                        bool escape = char(str[i]) == '\\' && i + 1 < size &&
+                                      (char(str[i + 1]) == '\"' || char(str[i + 1]) == '\\');
+                        if (escape)
+                            i++;
+
+                        sink.put(char(str[i]));
+                    }
+
+                    if (i == size)
+                        return "unterminated double quote in command line";
+                }
+                else if (ch == '\\')
+                {
+                    if (++i == size)
+                        return "trailing backslash in command line";
+
+                    sink.put(char(str[i]));
+                }
+                else
+                {
+                    sink.put(ch);
+                }
+            }
+
+            if (inWord)
+                sink.end();
+
+            return nullptr;
+        }
+
+        template <class CharT, size_t N>
+        struct cmd_string
+        {
+            consteval cmd_string(const CharT (&str)[N])
+            {
+                for (size_t i = 0; i < N; i++)
+                    data[i] = char(str[i]);
+            }
+
+            char data[N] = {};
+        };
+
+        struct cmd_counts
+        {
+            size_t chars = 0; // including one NUL per word
+            size_t words = 0;
+
+            constexpr void begin() { words++; }
+            constexpr void put(char) { chars++; }
+            constexpr void end() { chars++; }
+        };
+
+        template <size_t Chars, size_t Words>
+        struct cmd_words
+        {
+            char chars[Chars + 1] = {};
+            size_t offsets[Words + 1] = {};
+            size_t name = 0; // start of the file name part of the first word
+
+            size_t size = 0;
+            size_t count = 0;
+
+            constexpr void begin() { offsets[count++] = size; }
+            constexpr void put(char ch) { chars[size++] = ch; }
+            constexpr void end() { chars[size++] = 0; }
+        };
+
+        // not constexpr: reaching it while evaluating a literal is the compile error for a malformed command
+        inline void malformed_command_literal(const char *error) { (void)error; }
+
+        template <cmd_string S>
+        consteval cmd_counts cmd_count()
+        {
+            cmd_counts counts;
+            if (const char *error = cmd_scan(S.data, sizeof(S.data) - 1, counts))
+                malformed_command_literal(error);
+
+            if (counts.words == 0)
+                malformed_command_literal("empty command literal");
+
+            return counts;
+        }
+
+        template <cmd_string S>
+        struct cmd_table
+        {
+            static constexpr cmd_counts counts = cmd_count<S>();
+
+            static constexpr cmd_words<counts.chars, counts.words> words = [] {
+                cmd_words<counts.chars, counts.words> result;
+                cmd_scan(S.data, sizeof(S.data) - 1, result);
+
+                for (size_t i = 0; result.chars[i]; i++)
+                {
+                    if (result.chars[i] == '/')
+                        result.name = i + 1;
+                }
+
+                return result;
+            }();
+
+            static constexpr std::array<const char *, counts.words + 1> argv = [] {
+                std::array<const char *, counts.words + 1> result = {};
+                result[0] = words.chars + words.name;
+                for (size_t i = 1; i < counts.words; i++)
+                    result[i] = words.chars + words.offsets[i];
+
+                return result;
+            }();
+        };
+    } // namespace detail
+
+    inline namespace literals
+    {
+        // "git log --oneline"_cmd: the words and the argv table are built by the compiler, so running a literal
+        // command parses nothing at runtime, and a malformed literal fails to compile
+        template <detail::cmd_string S>
+        consteval command_line operator""_cmd()
+        {
+            using table = detail::cmd_table<S>;
+            return command_line{table::words.chars, table::argv.data(), table::counts.words, S.data};
+        }
+    } // namespace literals
+} // namespace ulib
@@ -17,6 +17,12 @@ namespace ulib
         process_invalid_flags_error(ulib::string_view str) : process_error(str) {}
     };
 
+    class process_invalid_options_error : public process_error
+    {
+    public:
+        process_invalid_options_error(ulib::string_view str) : process_error(str) {}
+    };
+
     class process_invalid_working_directory_error : public process_error
     {
     public:
@@ -28,4 +34,10 @@ namespace ulib
     public:
         process_internal_error(ulib::string_view str) : process_error(str) {}
     };
+
+    class process_graph_error : public process_error
+    {
+    public:
+        process_graph_error(ulib::string_view str) : process_error(str) {}
+    };
 } // namespace ulib
\ No newline at end of file
@@ -0,0 +1,448 @@
+#include "process_graph.h"
+
+#include <ulib/format.h>
+
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "process_exceptions.h"
+#include "process_wait.h"
+
+namespace ulib
+{
+    namespace detail
+    {
+        inline std::string graph_key(ulib::u8string_view name)
+        {
+            return std::string{(const char *)name.data(), name.size()};
+        }
+
+        inline double to_seconds(process_graph::duration d) { return std::chrono::duration<double>(d).count(); }
+
+        inline process_graph::duration from_seconds(double s)
+        {
+            return std::chrono::duration_cast<process_graph::duration>(std::chrono::duration<double>(s));
+        }
+
+        const char *graph_state_name(process_graph::node_state state)
+        {
+            switch (state)
+            {
+            case process_graph::node_state::pending:
+                return "pending";
+            case process_graph::node_state::succeeded:
+                return "ok";
+            case process_graph::node_state::failed:
+                return "failed";
+            case process_graph::node_state::skipped:
+                return "skipped";
+            case process_graph::node_state::cancelled:
+                return "cancelled";
+            }
+
+            return "unknown";
+        }
+    } // namespace detail
+
+    std::optional<process_graph::duration> process_graph::history::get(ulib::u8string_view name) const
+    {
+        auto it = mSeconds.find(detail::graph_key(name));
+        if (it == mSeconds.end())
+            return std::nullopt;
+
+        return detail::from_seconds(it->second);
+    }
+
+    void process_graph::history::record(ulib::u8string_view name, duration time)
+    {
+        // exponential moving average, so one outlier does not reorder the whole graph
+        constexpr double kWeight = 0.5;
+
+        double sample = detail::to_seconds(time);
+        auto [it, inserted] = mSeconds.emplace(detail::graph_key(name), sample);
+        if (!inserted)
+            it->second = it->second * (1.0 - kWeight) + sample * kWeight;
+    }
+
+    void process_graph::history::load(const std::filesystem::path &path)
+    {
+        std::ifstream file{path};
+        if (!file)
+            return; // no history yet
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos)
+                continue;
+
+            try
+            {
+                mSeconds[line.substr(tab + 1)] = std::stod(line.substr(0, tab));
+            }
+            catch (const std::exception &)
+            {
+                // ignore malformed lines
+            }
+        }
+    }
+
+    void process_graph::history::save(const std::filesystem::path &path) const
+    {
+        std::ofstream file{path, std::ios::trunc};
+        if (!file)
+            throw process_graph_error{"failed to open history file for writing"};
+
+        for (auto &[name, seconds] : mSeconds)
+            file << seconds << '\t' << name << '\n';
+    }
+
+    bool process_graph::result::succeeded() const
+    {
+        for (auto &node : nodes)
+            if (node.state != node_state::succeeded)
+                return false;
+
+        return true;
+    }
+
+    ulib::string process_graph::result::report() const
+    {
+        using ms = std::chrono::duration<double, std::milli>;
+
+        ulib::list<const node_result *> sorted;
+        for (auto &node : nodes)
+            sorted.push_back(&node);
+
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const node_result *a, const node_result *b) { return a->started_at < b->started_at; });
+
+        ulib::string out = ulib::format("{:<24} {:<9} {:>10} {:>10} {:>10} {:>10} {:>5}\n", "node", "state",
+                                        "start ms", "elapsed ms", "queued ms", "path ms", "exit");
+
+        for (auto node : sorted)
+        {
+            ulib::string_view name{(const char *)node->name.data(), node->name.size()};
+            ulib::string code = node->exit_code ? ulib::format("{}", *node->exit_code) : ulib::string{"-"};
+
+            bool ran = node->state == node_state::succeeded || node->state == node_state::failed ||
+                       node->state == node_state::cancelled;
+
+            if (ran)
+            {
+                out.append(ulib::format("{:<24} {:<9} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>5}\n", name,
+                                        detail::graph_state_name(node->state), ms(node->started_at).count(),
+                                        ms(node->elapsed()).count(), ms(node->queued()).count(),
+                                        ms(node->priority).count(), code));
+            }
+            else
+            {
+                out.append(ulib::format("{:<24} {:<9} {:>10} {:>10} {:>10} {:>10.1f} {:>5}\n", name,
+                                        detail::graph_state_name(node->state), "-", "-", "-",
+                                        ms(node->priority).count(), code));
+            }
+
+            if (!node->error.empty())
+                out.append(ulib::format("    error: {}\n", node->error));
+        }
+
+        out.append(ulib::format("wall {:.1f} ms, estimated critical path {:.1f} ms\n", ms(wall_time).count(),
+                                ms(critical_path).count()));
+        return out;
+    }
+
+    process_graph::node_id process_graph::add(ulib::u8string_view name, command cmd, const ulib::list<node_id> &deps)
+    {
+        node_id id = mNodes.size();
+        mNodes.push_back(node{ulib::u8string{name}, std::move(cmd), {}, {}});
+
+        for (auto dep : deps)
+            depend(id, dep);
+
+        return id;
+    }
+
+    process_graph::node_id process_graph::add(ulib::u8string_view name, const std::filesystem::path &path,
+                                              const ulib::list<ulib::u8string> &args, const ulib::list<node_id> &deps)
+    {
+        command cmd;
+        cmd.path = path;
+        cmd.args = args;
+        return add(name, std::move(cmd), deps);
+    }
+
+    void process_graph::depend(node_id node, node_id on)
+    {
+        if (node >= mNodes.size() || on >= mNodes.size())
+            throw process_graph_error{"invalid node id"};
+
+        if (node == on)
+            throw process_graph_error{"node cannot depend on itself"};
+
+        mNodes[node].deps.push_back(on);
+        mNodes[on].dependents.push_back(node);
+    }
+
+    ulib::list<process_graph::node_id> process_graph::topological_order() const
+    {
+        std::vector<size_t> remaining(mNodes.size());
+        ulib::list<node_id> order;
+
+        for (node_id id = 0; id < mNodes.size(); id++)
+        {
+            remaining[id] = mNodes[id].deps.size();
+            if (remaining[id] == 0)
+                order.push_back(id);
+        }
+
+        for (size_t i = 0; i < order.size(); i++)
+            for (auto dep : mNodes[order[i]].dependents)
+                if (--remaining[dep] == 0)
+                    order.push_back(dep);
+
+        if (order.size() != mNodes.size())
+            throw process_graph_error{"dependency cycle in process graph"};
+
+        return order;
+    }
+
+    process_graph::result process_graph::run() { return run(options{}); }
+
+    process_graph::result process_graph::run(const options &opts)
+    {
+        using clock = std::chrono::steady_clock;
+
+        struct slot
+        {
+            bool running = false;
+            bool terminated = false; // killed by cancel_running()
+        };
+
+        ulib::list<node_id> order = topological_order();
+        size_t count = mNodes.size();
+
+        result res;
+        for (auto &n : mNodes)
+        {
+            node_result nr{};
+            nr.name = n.name;
+            res.nodes.push_back(std::move(nr));
+        }
+
+        // costs: recorded history first, then the node estimate, then the mean of everything known
+        std::vector<std::optional<duration>> known(count);
+        duration knownSum{};
+        size_t knownCount = 0;
+        for (node_id id = 0; id < count; id++)
+        {
+            if (opts.times)
+                known[id] = opts.times->get(mNodes[id].name);
+            if (!known[id])
+                known[id] = mNodes[id].cmd.estimate;
+
+            if (known[id])
+            {
+                knownSum += *known[id];
+                knownCount++;
+            }
+        }
+
+        duration fallback = knownCount ? knownSum / static_cast<duration::rep>(knownCount) : duration{std::chrono::seconds{1}};
+        for (auto it = order.end(); it != order.begin();)
+        {
+            node_id id = *--it;
+            duration longest{};
+            for (auto dep : mNodes[id].dependents)
+                longest = std::max(longest, res.nodes[dep].priority);
+
+            res.nodes[id].priority = known[id].value_or(fallback) + longest;
+            res.critical_path = std::max(res.critical_path, res.nodes[id].priority);
+        }
+
+        size_t jobs = opts.max_jobs ? opts.max_jobs : std::max(1u, std::thread::hardware_concurrency());
+
+        // the span stays put for the waiter, so children are started in place
+        std::vector<process> procs(count);
+        std::vector<slot> slots(count);
+        std::vector<size_t> remaining(count);
+        auto byPriority = [&](node_id a, node_id b) { return res.nodes[a].priority < res.nodes[b].priority; };
+        std::priority_queue<node_id, std::vector<node_id>, decltype(byPriority)> ready{byPriority};
+
+#ifdef ULIB_PROCESS_LINUX
+        // one wait for all running children, however many there are
+        process_waiter waiter{procs};
+#endif
+
+        size_t running = 0;
+        bool stopping = false;
+        clock::time_point start = clock::now();
+        auto now = [&] { return clock::now() - start; };
+
+        auto skip_dependents = [&](node_id id, node_state state) {
+            std::vector<node_id> stack{id};
+            while (!stack.empty())
+            {
+                node_id cur = stack.back();
+                stack.pop_back();
+
+                for (auto dep : mNodes[cur].dependents)
+                {
+                    if (res.nodes[dep].state == node_state::pending)
+                    {
+                        res.nodes[dep].state = state;
+                        stack.push_back(dep);
+                    }
+                }
+            }
+        };
+
+        auto cancel_running = [&] {
+            for (node_id id = 0; id < count; id++)
+            {
+                // children are only reaped by the loop below, so a running node's pid is still its child's
+                slot &s = slots[id];
+                if (s.running && !s.terminated)
+                {
+                    s.terminated = true;
+                    try
+                    {
+                        procs[id].terminate();
+                    }
+                    catch (const process_error &)
+                    {
+                        // already exited
+                    }
+                }
+            }
+        };
+
+        // killed: the child died of cancel_running(), not one that exited on its own before the signal landed
+        auto complete = [&](node_id id, std::optional<int> code, bool killed) {
+            node_result &nr = res.nodes[id];
+            nr.exit_code = code;
+
+            if (killed)
+                nr.state = node_state::cancelled;
+            else if (code && *code == 0)
+                nr.state = node_state::succeeded;
+            else
+                nr.state = node_state::failed;
+
+            if (nr.state == node_state::succeeded)
+            {
+                if (opts.times)
+                    opts.times->record(nr.name, nr.elapsed());
+
+                for (auto dep : mNodes[id].dependents)
+                {
+                    if (--remaining[dep] == 0 && res.nodes[dep].state == node_state::pending)
+                    {
+                        res.nodes[dep].ready_at = nr.finished_at;
+                        ready.push(dep);
+                    }
+                }
+                return;
+            }
+
+            skip_dependents(id, nr.state == node_state::cancelled ? node_state::cancelled : node_state::skipped);
+            if (nr.state == node_state::failed && opts.mode == failure_mode::fail_fast && !stopping)
+            {
+                stopping = true;
+                cancel_running();
+            }
+        };
+
+        auto launch = [&](node_id id) {
+            const command &cmd = mNodes[id].cmd;
+            res.nodes[id].started_at = now();
+
+            try
+            {
+                procs[id].run(cmd.path, cmd.args, cmd.flags, cmd.workingDirectory);
+            }
+            catch (const std::exception &ex)
+            {
+                res.nodes[id].error = ex.what();
+                res.nodes[id].finished_at = now();
+                complete(id, std::nullopt, false);
+                return;
+            }
+
+            running++;
+            slots[id].running = true;
+#ifdef ULIB_PROCESS_LINUX
+            waiter.add(id);
+#endif
+        };
+
+        for (node_id id = 0; id < count; id++)
+        {
+            remaining[id] = mNodes[id].deps.size();
+            if (remaining[id] == 0)
+                ready.push(id);
+        }
+
+        while (true)
+        {
+            while (!stopping && running < jobs && !ready.empty())
+            {
+                node_id id = ready.top();
+                ready.pop();
+                launch(id);
+            }
+
+            if (running == 0)
+                break;
+
+            node_id id = 0;
+            std::optional<int> code;
+            bool killed = false;
+#ifdef ULIB_PROCESS_LINUX
+            auto exit = waiter.next();
+            if (!exit)
+                throw process_graph_error{"a running node was reaped outside of the graph"};
+
+            id = exit->index;
+            code = exit->result.code();
+            killed = slots[id].terminated && exit->result.signal.has_value();
+#else
+            // no waiter here: poll the running children, backing off while none has exited
+            auto delay = std::chrono::microseconds{100};
+            while (!code)
+            {
+                for (node_id i = 0; i < count; i++)
+                {
+                    if (slots[i].running && (code = procs[i].check()))
+                    {
+                        id = i;
+                        break;
+                    }
+                }
+
+                if (!code)
+                {
+                    std::this_thread::sleep_for(delay);
+                    delay = std::min(delay * 2, std::chrono::microseconds{10000});
+                }
+            }
+
+            killed = slots[id].terminated && *code != 0;
+#endif
+            res.nodes[id].finished_at = now();
+            slots[id].running = false;
+            running--;
+            complete(id, code, killed);
+        }
+
+        for (auto &nr : res.nodes)
+            if (nr.state == node_state::pending)
+                nr.state = stopping ? node_state::cancelled : node_state::skipped;
+
+        res.wall_time = now();
+        return res;
+    }
+} // namespace ulib
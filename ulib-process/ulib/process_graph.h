@@ -0,0 +1,122 @@
+#pragma once
+
+#include "process.h"
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace ulib
+{
+    // Runs a dependency graph of commands. Ready nodes are started in order of their longest remaining
+    // critical path, estimated from recorded run times (see process_graph::history) or per-node estimates.
+    // Children inherit the parent's stdio unless flags say otherwise; piped output is not drained.
+    class process_graph
+    {
+    public:
+        using node_id = size_t;
+        using duration = std::chrono::steady_clock::duration;
+
+        enum class failure_mode
+        {
+            fail_fast,  // terminate running nodes and start nothing new
+            keep_going, // skip only the dependents of the failed node
+        };
+
+        enum class node_state
+        {
+            pending,
+            succeeded,
+            failed,
+            skipped,
+            cancelled,
+        };
+
+        struct command
+        {
+            std::filesystem::path path;
+            ulib::list<ulib::u8string> args;
+            uint32 flags = process::noflags;
+            std::optional<std::filesystem::path> workingDirectory;
+
+            // used when there is no recorded run time for the node
+            std::optional<duration> estimate;
+        };
+
+        // Smoothed run times keyed by node name, persisted as "<seconds>\t<name>" lines
+        class history
+        {
+        public:
+            std::optional<duration> get(ulib::u8string_view name) const;
+            void record(ulib::u8string_view name, duration time);
+
+            void load(const std::filesystem::path &path);
+            void save(const std::filesystem::path &path) const;
+
+            inline size_t size() const { return mSeconds.size(); }
+
+        private:
+            std::unordered_map<std::string, double> mSeconds;
+        };
+
+        struct options
+        {
+            size_t max_jobs = 0; // 0 means std::thread::hardware_concurrency()
+            failure_mode mode = failure_mode::fail_fast;
+            history *times = nullptr; // read for priorities, updated with successful runs
+        };
+
+        struct node_result
+        {
+            ulib::u8string name;
+            node_state state = node_state::pending;
+            std::optional<int> exit_code;
+            ulib::string error;
+
+            duration priority{};  // critical path length used for scheduling
+            duration ready_at{};  // offsets from the start of run()
+            duration started_at{};
+            duration finished_at{};
+
+            inline duration queued() const { return started_at - ready_at; }
+            inline duration elapsed() const { return finished_at - started_at; }
+        };
+
+        struct result
+        {
+            ulib::list<node_result> nodes; // indexed by node_id
+            duration wall_time{};
+            duration critical_path{}; // estimated before the run
+
+            bool succeeded() const;
+            ulib::string report() const;
+        };
+
+        process_graph() = default;
+
+        node_id add(ulib::u8string_view name, command cmd, const ulib::list<node_id> &deps = {});
+        node_id add(ulib::u8string_view name, const std::filesystem::path &path, const ulib::list<ulib::u8string> &args,
+                    const ulib::list<node_id> &deps = {});
+        void depend(node_id node, node_id on);
+
+        inline size_t size() const { return mNodes.size(); }
+
+        result run();
+        result run(const options &opts);
+
+    private:
+        struct node
+        {
+            ulib::u8string name;
+            command cmd;
+            ulib::list<node_id> deps;
+            ulib::list<node_id> dependents;
+        };
+
+        ulib::list<node_id> topological_order() const;
+
+        ulib::list<node> mNodes;
+    };
+} // namespace ulib
@@ -0,0 +1,314 @@
+#include "process_metrics.h"
+#include "impl/metrics_hooks.h"
+
+#include <ulib/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <vector>
+
+namespace ulib
+{
+    size_t latency_histogram::bucket_index(uint64 ns)
+    {
+        constexpr uint64 limit = (uint64(1) << (max_exponent + 1)) - 1;
+        ns = std::min(ns, limit);
+
+        if (ns < sub_bucket_count)
+            return size_t(ns);
+
+        size_t exponent = size_t(63 - std::countl_zero(ns));
+        size_t sub = size_t(ns >> (exponent - sub_bucket_bits)) & (sub_bucket_count - 1);
+        return (exponent - sub_bucket_bits + 1) * sub_bucket_count + sub;
+    }
+
+    uint64 latency_histogram::bucket_lower(size_t index)
+    {
+        if (index < sub_bucket_count)
+            return uint64(index);
+
+        size_t exponent = index / sub_bucket_count + sub_bucket_bits - 1;
+        uint64 sub = index % sub_bucket_count;
+        return (sub_bucket_count + sub) << (exponent - sub_bucket_bits);
+    }
+
+    uint64 latency_histogram::bucket_upper(size_t index)
+    {
+        if (index + 1 < bucket_count)
+            return bucket_lower(index + 1);
+
+        return uint64(1) << (max_exponent + 1);
+    }
+
+    std::chrono::nanoseconds latency_histogram::percentile(double q) const
+    {
+        if (count == 0)
+            return {};
+
+        uint64 rank = uint64(std::clamp(q, 0.0, 1.0) * double(count - 1)) + 1;
+        uint64 seen = 0;
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+                return std::chrono::nanoseconds{bucket_upper(i)};
+        }
+
+        return std::chrono::nanoseconds{bucket_upper(bucket_count - 1)};
+    }
+
+    std::chrono::nanoseconds latency_histogram::mean() const
+    {
+        return std::chrono::nanoseconds{count ? sum_ns / count : 0};
+    }
+
+    uint64 latency_histogram::count_below(uint64 ns) const
+    {
+        uint64 result = 0;
+        for (size_t i = 0; i < bucket_count && bucket_upper(i) <= ns; i++)
+            result += buckets[i];
+
+        return result;
+    }
+
+#ifndef ULIB_PROCESS_NO_METRICS
+    namespace detail
+    {
+#ifdef ULIB_PROCESS_METRICS
+        std::atomic<bool> metrics_active{true};
+#else
+        std::atomic<bool> metrics_active{false};
+#endif
+
+        struct metrics_shard
+        {
+            std::atomic<uint64> buckets[spawn_phase_count][latency_histogram::bucket_count] = {};
+            std::atomic<uint64> counts[spawn_phase_count] = {};
+            std::atomic<uint64> sums[spawn_phase_count] = {};
+            std::atomic<uint64> counters[metrics_counter_count] = {};
+
+            void add_to(metrics_snapshot &snap) const
+            {
+                for (size_t p = 0; p < spawn_phase_count; p++)
+                {
+                    latency_histogram &h = snap.phases[p];
+                    for (size_t i = 0; i < latency_histogram::bucket_count; i++)
+                        h.buckets[i] += buckets[p][i].load(std::memory_order_relaxed);
+
+                    h.count += counts[p].load(std::memory_order_relaxed);
+                    h.sum_ns += sums[p].load(std::memory_order_relaxed);
+                }
+
+                auto counter = [&](metrics_counter c) { return counters[c].load(std::memory_order_relaxed); };
+                snap.spawns += counter(metrics_spawns);
+                snap.spawn_failures += counter(metrics_spawn_failures);
+                snap.exec_failures += counter(metrics_exec_failures);
+                snap.read_calls += counter(metrics_read_calls);
+                snap.write_calls += counter(metrics_write_calls);
+                snap.bytes[size_t(process_stream::in)] += counter(metrics_bytes_in);
+                snap.bytes[size_t(process_stream::out)] += counter(metrics_bytes_out);
+                snap.bytes[size_t(process_stream::err)] += counter(metrics_bytes_err);
+            }
+
+            void merge_into(metrics_shard &other) const
+            {
+                auto move = [](const std::atomic<uint64> &from, std::atomic<uint64> &to) {
+                    to.fetch_add(from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                };
+
+                for (size_t p = 0; p < spawn_phase_count; p++)
+                {
+                    for (size_t i = 0; i < latency_histogram::bucket_count; i++)
+                        move(buckets[p][i], other.buckets[p][i]);
+
+                    move(counts[p], other.counts[p]);
+                    move(sums[p], other.sums[p]);
+                }
+
+                for (size_t c = 0; c < metrics_counter_count; c++)
+                    move(counters[c], other.counters[c]);
+            }
+
+            void clear()
+            {
+                for (size_t p = 0; p < spawn_phase_count; p++)
+                {
+                    for (auto &b : buckets[p])
+                        b.store(0, std::memory_order_relaxed);
+
+                    counts[p].store(0, std::memory_order_relaxed);
+                    sums[p].store(0, std::memory_order_relaxed);
+                }
+
+                for (auto &c : counters)
+                    c.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        struct metrics_registry
+        {
+            std::mutex mutex;
+            std::vector<metrics_shard *> live;
+            metrics_shard retired; // shards of exited threads
+        };
+
+        // never destroyed: threads may still exit after static destructors ran
+        metrics_registry &metrics_global()
+        {
+            static metrics_registry *registry = new metrics_registry;
+            return *registry;
+        }
+
+        struct metrics_shard_owner
+        {
+            metrics_shard *shard;
+
+            metrics_shard_owner() : shard(new metrics_shard)
+            {
+                auto &reg = metrics_global();
+                std::lock_guard lock{reg.mutex};
+                reg.live.push_back(shard);
+            }
+
+            ~metrics_shard_owner()
+            {
+                auto &reg = metrics_global();
+                std::lock_guard lock{reg.mutex};
+                shard->merge_into(reg.retired);
+                reg.live.erase(std::find(reg.live.begin(), reg.live.end(), shard));
+                delete shard;
+            }
+        };
+
+        metrics_shard &metrics_local()
+        {
+            thread_local metrics_shard_owner owner;
+            return *owner.shard;
+        }
+
+        void metrics_record(spawn_phase phase, uint64 ns)
+        {
+            metrics_shard &shard = metrics_local();
+            size_t p = size_t(phase);
+
+            shard.buckets[p][latency_histogram::bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+            shard.counts[p].fetch_add(1, std::memory_order_relaxed);
+            shard.sums[p].fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        void metrics_count(metrics_counter counter, uint64 n)
+        {
+            metrics_local().counters[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+    } // namespace detail
+#endif
+
+    void process_metrics::enable(bool on)
+    {
+#ifndef ULIB_PROCESS_NO_METRICS
+        detail::metrics_active.store(on, std::memory_order_relaxed);
+#else
+        (void)on;
+#endif
+    }
+
+    bool process_metrics::is_enabled()
+    {
+#ifndef ULIB_PROCESS_NO_METRICS
+        return detail::metrics_on();
+#else
+        return false;
+#endif
+    }
+
+    metrics_snapshot process_metrics::snapshot()
+    {
+        metrics_snapshot snap;
+#ifndef ULIB_PROCESS_NO_METRICS
+        auto &reg = detail::metrics_global();
+        std::lock_guard lock{reg.mutex};
+
+        reg.retired.add_to(snap);
+        for (auto shard : reg.live)
+            shard->add_to(snap);
+#endif
+        return snap;
+    }
+
+    void process_metrics::reset()
+    {
+#ifndef ULIB_PROCESS_NO_METRICS
+        auto &reg = detail::metrics_global();
+        std::lock_guard lock{reg.mutex};
+
+        reg.retired.clear();
+        for (auto shard : reg.live)
+            shard->clear();
+#endif
+    }
+
+    ulib::string process_metrics::prometheus() { return prometheus(snapshot()); }
+
+    ulib::string process_metrics::prometheus(const metrics_snapshot &snap)
+    {
+        static const char *phaseNames[spawn_phase_count] = {"pipes",     "fork",      "child_setup",
+                                                            "exec",      "handshake", "total"};
+        static const char *streamNames[process_stream_count] = {"stdin", "stdout", "stderr"};
+
+        // 1us .. ~17s, every bound is a bucket boundary so the cumulative counts are exact
+        constexpr size_t firstBound = 10;
+        constexpr size_t lastBound = 34;
+
+        ulib::string out;
+        out.append("# HELP ulib_process_spawn_phase_seconds Time spent in each phase of process::run.\n");
+        out.append("# TYPE ulib_process_spawn_phase_seconds histogram\n");
+        for (size_t p = 0; p < spawn_phase_count; p++)
+        {
+            const latency_histogram &h = snap.phases[p];
+            for (size_t e = firstBound; e <= lastBound; e++)
+            {
+                uint64 bound = uint64(1) << e;
+                out.append(ulib::format("ulib_process_spawn_phase_seconds_bucket{{phase=\"{}\",le=\"{}\"}} {}\n",
+                                        phaseNames[p], double(bound) / 1e9, h.count_below(bound)));
+            }
+
+            out.append(ulib::format("ulib_process_spawn_phase_seconds_bucket{{phase=\"{}\",le=\"+Inf\"}} {}\n",
+                                    phaseNames[p], h.count));
+            out.append(ulib::format("ulib_process_spawn_phase_seconds_sum{{phase=\"{}\"}} {}\n", phaseNames[p],
+                                    double(h.sum_ns) / 1e9));
+            out.append(ulib::format("ulib_process_spawn_phase_seconds_count{{phase=\"{}\"}} {}\n", phaseNames[p],
+                                    h.count));
+        }
+
+        struct
+        {
+            const char *name;
+            const char *help;
+            uint64 value;
+        } counters[] = {
+            {"ulib_process_spawns_total", "Successful spawns.", snap.spawns},
+            {"ulib_process_spawn_failures_total", "Spawns that failed after fork.", snap.spawn_failures},
+            {"ulib_process_exec_failures_total", "Spawns that failed in execve.", snap.exec_failures},
+            {"ulib_process_pipe_read_calls_total", "read(2) calls on child pipes.", snap.read_calls},
+            {"ulib_process_pipe_write_calls_total", "write(2) calls on child pipes.", snap.write_calls},
+        };
+
+        for (auto &c : counters)
+        {
+            out.append(ulib::format("# HELP {} {}\n# TYPE {} counter\n{} {}\n", c.name, c.help, c.name, c.name,
+                                    c.value));
+        }
+
+        out.append("# HELP ulib_process_pipe_bytes_total Bytes transferred through child pipes.\n");
+        out.append("# TYPE ulib_process_pipe_bytes_total counter\n");
+        for (size_t s = 0; s < process_stream_count; s++)
+        {
+            out.append(
+                ulib::format("ulib_process_pipe_bytes_total{{stream=\"{}\"}} {}\n", streamNames[s], snap.bytes[s]));
+        }
+
+        return out;
+    }
+} // namespace ulib
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <ulib/string.h>
+#include <array>
+#include <chrono>
+
+namespace ulib
+{
+    // phases of process::run, recorded while process_metrics is enabled
+    enum class spawn_phase
+    {
+        pipes,       // pipe creation and option preparation
+        fork,        // the fork/clone3 call in the parent
+        child_setup, // child side: from fork to right before execve
+        exec,        // from the child calling execve to the parent seeing the sink pipe close
+        handshake,   // parent side: from fork returning to the sink pipe result
+        total,       // the whole run() call
+    };
+
+    constexpr size_t spawn_phase_count = 6;
+
+    enum class process_stream
+    {
+        in,
+        out,
+        err,
+    };
+
+    constexpr size_t process_stream_count = 3;
+
+    // Log-linear latency histogram in nanoseconds: 16 linear sub-buckets per power of two, so every
+    // bucket is within 6.25% of its value, up to 2^48 ns (about 78 hours).
+    struct latency_histogram
+    {
+        static constexpr size_t sub_bucket_bits = 4;
+        static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+        static constexpr size_t max_exponent = 47;
+        static constexpr size_t bucket_count = (max_exponent - sub_bucket_bits + 2) * sub_bucket_count;
+
+        std::array<uint64, bucket_count> buckets{};
+        uint64 count = 0;
+        uint64 sum_ns = 0;
+
+        static size_t bucket_index(uint64 ns);
+        static uint64 bucket_lower(size_t index);
+        static uint64 bucket_upper(size_t index); // exclusive
+
+        // upper bound of the bucket holding the q-th quantile, q in [0, 1]
+        std::chrono::nanoseconds percentile(double q) const;
+        std::chrono::nanoseconds mean() const;
+
+        // values below ns, exact when ns is a bucket boundary (e.g. a power of two)
+        uint64 count_below(uint64 ns) const;
+    };
+
+    struct metrics_snapshot
+    {
+        std::array<latency_histogram, spawn_phase_count> phases;
+
+        uint64 spawns = 0;         // successful run() calls
+        uint64 spawn_failures = 0; // run() calls that threw after fork
+        uint64 exec_failures = 0;  // of those, failed in execve
+
+        std::array<uint64, process_stream_count> bytes{}; // written to stdin, read from stdout and stderr
+        uint64 read_calls = 0;
+        uint64 write_calls = 0;
+
+        inline const latency_histogram &phase(spawn_phase p) const { return phases[size_t(p)]; }
+        inline uint64 stream_bytes(process_stream s) const { return bytes[size_t(s)]; }
+    };
+
+    // Process-wide spawn and pipe metrics. Recording goes to a per-thread shard with relaxed atomics, so
+    // spawning threads never contend; snapshot() sums all shards. Recording is off until enable() is called, or
+    // on from the start when the library is built with ULIB_PROCESS_METRICS. ULIB_PROCESS_NO_METRICS compiles the
+    // hooks out entirely: enable() does nothing and snapshots stay empty.
+    class process_metrics
+    {
+    public:
+#ifdef ULIB_PROCESS_NO_METRICS
+        static constexpr bool available = false;
+#else
+        static constexpr bool available = true;
+#endif
+
+        // takes effect for calls that start afterwards, a spawn in flight keeps its phases only if it was on
+        static void enable(bool on = true);
+        static bool is_enabled();
+
+        static metrics_snapshot snapshot();
+        static void reset(); // not atomic with respect to concurrent recording
+
+        // Prometheus text exposition format, histograms in seconds with power-of-two bucket bounds
+        static ulib::string prometheus();
+        static ulib::string prometheus(const metrics_snapshot &snapshot);
+    };
+} // namespace ulib
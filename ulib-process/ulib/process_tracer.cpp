@@ -0,0 +1,405 @@
+#include "process_tracer.h"
+#include "impl/trace_hooks.h"
+
+#include <ulib/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "process_exceptions.h"
+
+#ifdef ULIB_PROCESS_WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace ulib
+{
+    namespace detail
+    {
+        constexpr size_t trace_name_words = 3;
+
+        // Each slot is a seqlock: odd while a writer fills it, 2 * (index + 1) once complete, so readers
+        // detect torn or overwritten slots without blocking writers.
+        struct trace_slot
+        {
+            std::atomic<uint64> seq{0};
+            std::atomic<uint64> time{0};
+            std::atomic<uint64> info{0}; // type | stream << 8 | pid << 32
+            std::atomic<uint64> tid{0};
+            std::atomic<uint64> name[trace_name_words] = {};
+        };
+
+        class trace_ring
+        {
+        public:
+            explicit trace_ring(size_t capacity)
+                : mSlots(new trace_slot[capacity]), mMask(capacity - 1), mHead(0), mBase(0)
+            {
+            }
+
+            inline size_t capacity() const { return size_t(mMask + 1); }
+
+            // starts over for a new session: older events are no longer collected, the slots are simply reused
+            void restart() { mBase.store(mHead.load(std::memory_order_acquire), std::memory_order_release); }
+
+            void push(trace_event_type type, int pid, uint32 tid, uint64 time, process_stream stream,
+                      const char *name)
+            {
+                uint64 index = mHead.fetch_add(1, std::memory_order_relaxed);
+                trace_slot &slot = mSlots[index & mMask];
+
+                slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                slot.time.store(time, std::memory_order_relaxed);
+                slot.info.store(uint64(type) | uint64(stream) << 8 | uint64(uint32(pid)) << 32,
+                                std::memory_order_relaxed);
+                slot.tid.store(tid, std::memory_order_relaxed);
+
+                uint64 words[trace_name_words] = {};
+                if (name)
+                    std::memcpy(words, name, std::min(std::strlen(name), sizeof(words)));
+
+                for (size_t i = 0; i < trace_name_words; i++)
+                    slot.name[i].store(words[i], std::memory_order_relaxed);
+
+                slot.seq.store(2 * index + 2, std::memory_order_release);
+            }
+
+            ulib::list<trace_event> collect() const
+            {
+                uint64 head = mHead.load(std::memory_order_acquire);
+                uint64 capacity = mMask + 1;
+                uint64 first = std::max(head > capacity ? head - capacity : 0, mBase.load(std::memory_order_acquire));
+
+                ulib::list<trace_event> result;
+                for (uint64 index = first; index < head; index++)
+                {
+                    const trace_slot &slot = mSlots[index & mMask];
+
+                    uint64 seq = slot.seq.load(std::memory_order_acquire);
+                    if (seq != 2 * index + 2)
+                        continue; // still being written, or already overwritten
+
+                    uint64 time = slot.time.load(std::memory_order_relaxed);
+                    uint64 info = slot.info.load(std::memory_order_relaxed);
+                    uint64 tid = slot.tid.load(std::memory_order_relaxed);
+                    uint64 words[trace_name_words];
+                    for (size_t i = 0; i < trace_name_words; i++)
+                        words[i] = slot.name[i].load(std::memory_order_relaxed);
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.seq.load(std::memory_order_relaxed) != seq)
+                        continue;
+
+                    trace_event ev;
+                    ev.type = trace_event_type(info & 0xff);
+                    ev.stream = process_stream((info >> 8) & 0xff);
+                    ev.pid = int(uint32(info >> 32));
+                    ev.tid = uint32(tid);
+                    ev.time_ns = time;
+
+                    const char *chars = reinterpret_cast<const char *>(words);
+                    ev.name = ulib::string{ulib::string_view{chars, ::strnlen(chars, sizeof(words))}};
+
+                    result.push_back(std::move(ev));
+                }
+
+                return result;
+            }
+
+        private:
+            std::unique_ptr<trace_slot[]> mSlots;
+            uint64 mMask;
+            std::atomic<uint64> mHead;
+            std::atomic<uint64> mBase; // first index of the current session
+        };
+
+        std::atomic<trace_ring *> active_trace_ring{nullptr};
+        std::atomic<uint64> trace_ring_users{0};
+
+        struct tracer_state
+        {
+            std::mutex mutex;
+            trace_ring *current = nullptr;
+
+            // replaced rings wait here until no trace_scope can still hold them
+            std::vector<std::unique_ptr<trace_ring>> rings;
+
+            void free_replaced()
+            {
+                // a scope that takes the pointer after this sees the current ring or none, see trace_scope
+                if (trace_ring_users.load(std::memory_order_seq_cst) != 0)
+                    return;
+
+                std::erase_if(rings, [&](const std::unique_ptr<trace_ring> &ring) { return ring.get() != current; });
+            }
+        };
+
+        tracer_state &tracer_global()
+        {
+            static tracer_state state;
+            return state;
+        }
+
+        uint32 trace_thread_id()
+        {
+            thread_local uint32 id = [] {
+#if defined(ULIB_PROCESS_WINDOWS)
+                return uint32(::GetCurrentThreadId());
+#elif defined(__linux__)
+                return uint32(::syscall(SYS_gettid));
+#else
+                return uint32(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+#endif
+            }();
+
+            return id;
+        }
+
+        uint64 trace_clock()
+        {
+            return uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now().time_since_epoch())
+                              .count());
+        }
+
+        void trace_record(trace_ring *ring, trace_event_type type, int pid, uint64 time_ns, process_stream stream,
+                          const char *name)
+        {
+            ring->push(type, pid, trace_thread_id(), time_ns, stream, name);
+        }
+
+        void json_escape(ulib::string &out, ulib::string_view str)
+        {
+            for (char ch : str)
+            {
+                if (ch == '"' || ch == '\\')
+                {
+                    out.push_back('\\');
+                    out.push_back(ch);
+                }
+                else if (uint8_t(ch) < 0x20)
+                {
+                    out.append(ulib::format("\\u{:04x}", int(ch)));
+                }
+                else
+                {
+                    out.push_back(ch);
+                }
+            }
+        }
+
+        const char *trace_stream_name(process_stream stream)
+        {
+            switch (stream)
+            {
+            case process_stream::in:
+                return "stdin";
+            case process_stream::out:
+                return "stdout";
+            case process_stream::err:
+                return "stderr";
+            }
+
+            return "unknown";
+        }
+    } // namespace detail
+
+    void process_tracer::start(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < std::max<size_t>(capacity, 2))
+            size <<= 1;
+
+        auto &state = detail::tracer_global();
+        std::lock_guard lock{state.mutex};
+
+        if (state.current && state.current->capacity() == size)
+        {
+            state.current->restart();
+        }
+        else
+        {
+            state.rings.push_back(std::make_unique<detail::trace_ring>(size));
+            state.current = state.rings.back().get();
+        }
+
+        detail::active_trace_ring.store(state.current, std::memory_order_seq_cst);
+        state.free_replaced();
+    }
+
+    void process_tracer::stop()
+    {
+        auto &state = detail::tracer_global();
+        std::lock_guard lock{state.mutex};
+
+        detail::active_trace_ring.store(nullptr, std::memory_order_seq_cst);
+        state.free_replaced();
+    }
+
+    size_t process_tracer::memory_usage()
+    {
+        auto &state = detail::tracer_global();
+        std::lock_guard lock{state.mutex};
+
+        size_t bytes = 0;
+        for (auto &ring : state.rings)
+            bytes += ring->capacity() * sizeof(detail::trace_slot);
+
+        return bytes;
+    }
+
+    bool process_tracer::is_active() { return detail::active_trace() != nullptr; }
+
+    ulib::list<trace_event> process_tracer::events()
+    {
+        auto &state = detail::tracer_global();
+        std::lock_guard lock{state.mutex};
+        if (!state.current)
+            return {};
+
+        ulib::list<trace_event> result = state.current->collect();
+        std::stable_sort(result.begin(), result.end(),
+                         [](const trace_event &a, const trace_event &b) { return a.time_ns < b.time_ns; });
+        return result;
+    }
+
+    ulib::string process_tracer::chrome_json()
+    {
+        struct child
+        {
+            uint64 spawn = 0;
+            uint64 exec = 0;
+            uint64 exit = 0;
+            uint32 spawner = 0;
+            bool running = false;
+        };
+
+        ulib::list<trace_event> evs = events();
+        uint64 base = evs.size() ? evs.front().time_ns : 0;
+        int self = int(
+#ifdef ULIB_PROCESS_WINDOWS
+            ::GetCurrentProcessId()
+#else
+            ::getpid()
+#endif
+        );
+
+        auto us = [&](uint64 ns) { return double(ns - base) / 1000.0; };
+
+        ulib::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out.append(ulib::format("{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"args\":{{\"name\":\"ulib-process\"}}}}",
+                                self));
+
+        auto complete = [&](const char *name, uint32 tid, uint64 from, uint64 to) {
+            out.append(ulib::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":{},\"tid\":{},\"ts\":{},\"dur\":{}}}",
+                                    name, self, tid, us(from), double(to - from) / 1000.0));
+        };
+
+        auto event = [&](const char *name, const char *ph, uint32 tid, uint64 at) {
+            out.append(ulib::format(",\n{{\"name\":\"{}\",\"ph\":\"{}\",\"pid\":{},\"tid\":{},\"ts\":{}{}}}", name, ph,
+                                    self, tid, us(at), *ph == 'i' ? ",\"s\":\"t\"" : ""));
+        };
+
+        std::unordered_map<int, child> children;
+        std::unordered_set<uint32> spawners;
+
+        for (auto &ev : evs)
+        {
+            child &c = children[ev.pid];
+            uint32 track = uint32(ev.pid);
+
+            switch (ev.type)
+            {
+            case trace_event_type::spawn:
+                c = child{};
+                c.spawn = ev.time_ns;
+                c.spawner = ev.tid;
+
+                out.append(ulib::format(
+                    ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":\"", self,
+                    track));
+                detail::json_escape(out, ev.name);
+                out.append(ulib::format(" [{}]\"}}}}", ev.pid));
+
+                if (spawners.insert(ev.tid).second)
+                {
+                    out.append(ulib::format(",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+                                            "\"args\":{{\"name\":\"spawner {}\"}}}}",
+                                            self, ev.tid, ev.tid));
+                }
+                break;
+
+            case trace_event_type::exec:
+                c.exec = ev.time_ns;
+                if (c.spawn)
+                {
+                    complete("spawn", track, c.spawn, c.exec);
+                    complete("spawn", c.spawner, c.spawn, c.exec);
+                }
+
+                event("run", "B", track, c.exec);
+                c.running = true;
+                break;
+
+            case trace_event_type::spawn_failed:
+                if (c.spawn)
+                {
+                    complete("spawn failed", track, c.spawn, ev.time_ns);
+                    complete("spawn failed", c.spawner, c.spawn, ev.time_ns);
+                }
+                break;
+
+            case trace_event_type::first_byte:
+            case trace_event_type::eof:
+                event(ulib::format("{} {}", ev.type == trace_event_type::eof ? "eof" : "first byte",
+                                   detail::trace_stream_name(ev.stream))
+                          .c_str(),
+                      "i", track, ev.time_ns);
+                break;
+
+            case trace_event_type::exit:
+                c.exit = ev.time_ns;
+                if (c.running)
+                {
+                    event("run", "E", track, c.exit);
+                    c.running = false;
+                }
+                break;
+
+            case trace_event_type::reap:
+                if (c.exit)
+                    complete("reap", track, c.exit, ev.time_ns);
+                break;
+            }
+        }
+
+        out.append("\n]}\n");
+        return out;
+    }
+
+    void process_tracer::dump(const std::filesystem::path &path)
+    {
+        std::ofstream file{path, std::ios::trunc | std::ios::binary};
+        if (!file)
+            throw process_internal_error{"failed to open trace file for writing"};
+
+        ulib::string json = chrome_json();
+        file.write(json.data(), std::streamsize(json.size()));
+    }
+} // namespace ulib
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "process_metrics.h"
+
+#include <ulib/string.h>
+#include <filesystem>
+
+namespace ulib
+{
+    enum class trace_event_type
+    {
+        spawn,        // run() was entered, recorded once the pid is known
+        exec,         // the child exec'd and run() returned
+        spawn_failed, // the child failed before or in execve
+        first_byte,   // first data read from a stdout/stderr pipe
+        eof,          // end of file read from a stdout/stderr pipe
+        exit,         // the exit was observed
+        reap,         // the wait status and resource usage were collected
+    };
+
+    struct trace_event
+    {
+        trace_event_type type;
+        process_stream stream = process_stream::out; // first_byte and eof only
+        int pid = 0;                                 // the child
+        uint32 tid = 0;                              // the thread that recorded the event
+        uint64 time_ns = 0;                          // steady_clock
+        ulib::string name;                           // spawn only, argv[0] truncated to 24 bytes
+    };
+
+    // Optional lifecycle tracer for every ulib::process. While started, events go into a fixed-size lock-free
+    // ring that overwrites the oldest entries; when stopped, each hook costs one atomic load.
+    // chrome_json() renders the Chrome trace event format, which Perfetto and chrome://tracing open directly:
+    // one track per child with spawn, run and reap spans, plus one track per spawning thread.
+    class process_tracer
+    {
+    public:
+        static void start(size_t capacity = 65536); // rounded up to a power of two, drops older events
+        static void stop();                          // events stay available until the next start()
+        static bool is_active();
+
+        // bytes held by rings; a restart with the same capacity reuses the ring, a replaced one is freed once no
+        // hook is still writing to it
+        static size_t memory_usage();
+
+        static ulib::list<trace_event> events(); // ordered by time
+        static ulib::string chrome_json();
+        static void dump(const std::filesystem::path &path);
+    };
+} // namespace ulib
@@ -0,0 +1,160 @@
+#include "process_writer.h"
+#include "impl/metrics_hooks.h"
+
+#include <ulib/format.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef ULIB_PROCESS_WINDOWS
+#include <windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "impl/linux/process_sigpipe.h"
+#endif
+
+#include "process_exceptions.h"
+
+namespace ulib
+{
+    buffered_writer::buffered_writer(process::wpipe &pipe, size_t capacity) : mPipe(pipe), mBuffer(capacity)
+    {
+        mSize = 0;
+    }
+
+    buffered_writer::~buffered_writer()
+    {
+        try
+        {
+            if (mPipe.is_open())
+                this->flush();
+        }
+        catch (...)
+        {
+            // the child went away, nothing to deliver to
+        }
+    }
+
+    void buffered_writer::write(const void *data, size_t size)
+    {
+        if (size <= mBuffer.size() - mSize)
+        {
+            std::memcpy(mBuffer.data() + mSize, data, size);
+            mSize += size;
+            return;
+        }
+
+        ulib::string_view part{static_cast<const char *>(data), size};
+        this->write_parts({&part, 1});
+    }
+
+    void buffered_writer::write(std::span<const ulib::string_view> parts)
+    {
+        size_t total = 0;
+        for (auto &part : parts)
+            total += part.size();
+
+        if (total > mBuffer.size() - mSize)
+        {
+            this->write_parts(parts);
+            return;
+        }
+
+        for (auto &part : parts)
+        {
+            std::memcpy(mBuffer.data() + mSize, part.data(), part.size());
+            mSize += part.size();
+        }
+    }
+
+    void buffered_writer::flush()
+    {
+        if (mSize)
+            this->write_parts({});
+    }
+
+    void buffered_writer::close_after_flush()
+    {
+        this->flush();
+        mPipe.close();
+    }
+
+    // writes the buffered bytes followed by parts, the buffer is empty afterwards
+    void buffered_writer::write_parts(std::span<const ulib::string_view> parts)
+    {
+#ifdef ULIB_PROCESS_WINDOWS
+        if (mSize)
+            mPipe.write_all(mBuffer.data(), mSize);
+        mSize = 0;
+
+        for (auto &part : parts)
+            mPipe.write_all(part.data(), part.size());
+#else
+        std::vector<struct iovec> iov;
+        iov.reserve(parts.size() + 1);
+        if (mSize)
+            iov.push_back({mBuffer.data(), mSize});
+        for (auto &part : parts)
+            if (part.size())
+                iov.push_back({const_cast<char *>(part.data()), part.size()});
+
+        mSize = 0;
+
+        bool socket = mPipe.is_socket();
+        detail::sigpipe_guard guard{!socket};
+
+        size_t index = 0;
+        while (index < iov.size())
+        {
+            int count = int(std::min<size_t>(iov.size() - index, IOV_MAX));
+
+            ssize_t rv;
+            if (socket)
+            {
+                struct msghdr msg = {};
+                msg.msg_iov = iov.data() + index;
+                msg.msg_iovlen = size_t(count);
+                rv = ::sendmsg(mPipe.native_handle(), &msg, MSG_NOSIGNAL);
+            }
+            else
+            {
+                rv = ::writev(mPipe.native_handle(), iov.data() + index, count);
+            }
+
+            if (rv == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    struct pollfd pfd = {mPipe.native_handle(), POLLOUT, 0};
+                    ::poll(&pfd, 1, -1);
+                    continue;
+                }
+
+                throw process_internal_error{ulib::format("writev failed: {}", std::strerror(errno))};
+            }
+
+            ULIB_PROCESS_METRICS_COUNT(write_calls, 1);
+            ULIB_PROCESS_METRICS_BYTES(process_stream::in, uint64(rv));
+
+            // drop what was taken, resume inside a partially written part
+            size_t done = size_t(rv);
+            while (index < iov.size() && done >= iov[index].iov_len)
+                done -= iov[index++].iov_len;
+
+            if (done)
+            {
+                iov[index].iov_base = static_cast<char *>(iov[index].iov_base) + done;
+                iov[index].iov_len -= done;
+            }
+        }
+#endif
+    }
+} // namespace ulib
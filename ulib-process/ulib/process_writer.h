@@ -0,0 +1,40 @@
+#pragma once
+
+#include "process.h"
+
+#include <span>
+#include <vector>
+
+namespace ulib
+{
+    // Buffers small writes to a child's stdin and hands them to the pipe in large batches. Writes that do not fit
+    // go out together with the buffered bytes in one writev(2), and every write loops over partial writes, EINTR
+    // and, for non-blocking pipes, EAGAIN until all bytes are taken. Errors such as a closed reader throw
+    // process_internal_error; SIGPIPE is blocked around the writes, so a child that exited does not kill us.
+    class buffered_writer
+    {
+    public:
+        explicit buffered_writer(process::wpipe &pipe, size_t capacity = 64 * 1024);
+        buffered_writer(const buffered_writer &) = delete;
+        ~buffered_writer(); // flushes, dropping the bytes if the pipe is gone
+
+        void write(const void *data, size_t size);
+        void write(ulib::string_view str) { this->write(str.data(), str.size()); }
+
+        // scatter/gather: all parts are buffered or written in one go with the buffered bytes first
+        void write(std::span<const ulib::string_view> parts);
+
+        void flush();
+        void close_after_flush(); // flushes, then closes the pipe so the child sees eof
+
+        inline size_t buffered() const { return mSize; }
+        inline size_t capacity() const { return mBuffer.size(); }
+
+    private:
+        void write_parts(std::span<const ulib::string_view> parts);
+
+        process::wpipe &mPipe;
+        std::vector<char> mBuffer;
+        size_t mSize;
+    };
+} // namespace ulib